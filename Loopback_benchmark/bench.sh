@@ -0,0 +1,266 @@
+#!/usr/bin/env bash
+#
+# Loopback benchmark: builds the stand-in server, the counter shim and both clients, runs every
+# scenario against the server on 127.0.0.1 and prints requests/sec, latency percentiles and the
+# allocations, system calls and CPU time per request of the client.
+#
+#   ./bench.sh                   run and print the table
+#   ./bench.sh -o baseline.txt   ... and save the results as a baseline
+#   ./bench.sh -c baseline.txt   ... and compare with a baseline, exit status 1 on a regression
+#
+# Options:
+#   -n requests    Requests per scenario (default 100000, scaled down for slow scenarios)
+#   -p port        First port for the servers (default 18080)
+#   -t percent     Tolerance for requests/sec, p99 and CPU time in a comparison (default 15)
+#   -s names       Only run these scenarios (comma-separated)
+#
+# The counters only cover the client. They include start-up (resolving, connecting), which
+# matters little over thousands of requests.
+
+set -euo pipefail
+
+HERE="$(cd "$(dirname "${BASH_SOURCE[0]}")" && pwd)"
+ROOT="$(dirname "$HERE")"
+
+REQUESTS=100000
+PORT=18080
+TOLERANCE=15
+COUNTER_TOLERANCE=5       # percent (plus 0.05 absolute) for allocations and system calls
+ONLY=""
+SAVE=""
+COMPARE=""
+
+while getopts "n:p:t:s:o:c:h" option; do
+    case "$option" in
+        n) REQUESTS="$OPTARG" ;;
+        p) PORT="$OPTARG" ;;
+        t) TOLERANCE="$OPTARG" ;;
+        s) ONLY=",$OPTARG," ;;
+        o) SAVE="$OPTARG" ;;
+        c) COMPARE="$OPTARG" ;;
+        *) sed -n '3,18p' "$0" | sed 's/^# \{0,1\}//'; exit 2 ;;
+    esac
+done
+
+BUILD="$(mktemp -d)"
+SERVER_PID=""
+
+cleanup() {
+    if [ -n "$SERVER_PID" ]; then
+        kill "$SERVER_PID" 2>/dev/null || true
+        wait "$SERVER_PID" 2>/dev/null || true
+    fi
+    rm -rf "$BUILD"
+}
+trap cleanup EXIT
+
+# Build ------------------------------------------------------------------------------------------
+
+CC="${CC:-gcc}"
+CFLAGS="${CFLAGS:--O2}"
+LIBHTTP="$ROOT/libhttp"
+SOCKET="$ROOT/Socket_programming_exercise"
+POST="$ROOT/Minimal_POST_HTTP_client"
+
+echo "Building in $BUILD ..."
+$CC $CFLAGS -o "$BUILD/server" "$HERE/server.c" "$SOCKET/timer_wheel.c" -I"$SOCKET" -pthread
+$CC $CFLAGS -shared -fPIC -o "$BUILD/counters.so" "$HERE/counters.c" -ldl
+(cd "$SOCKET" && $CC $CFLAGS -o "$BUILD/loadgen" main.c request.c loadgen.c wsdeque.c arena.c connector.c \
+    replay.c timer_wheel.c uring.c "$LIBHTTP/http_parser.c" "$LIBHTTP/http_scan.c" "$LIBHTTP/http_sink.c" \
+    "$LIBHTTP/resolver.c" "$LIBHTTP/latency.c" "$LIBHTTP/retry.c" -I"$LIBHTTP" -pthread)
+
+# The POST client is configured in config.h: build a copy that talks to the stand-in server
+# $1: port, $2: requests, $3: program to build, $4: Unix domain socket to connect to (optional)
+build_post_client() {
+    local unix_socket="NULL"
+    if [ -n "${4:-}" ]; then
+        unix_socket="\"$4\""
+    fi
+    mkdir -p "$BUILD/post"
+    cp "$POST"/*.c "$POST"/*.h "$BUILD/post/"
+    sed -i -e "s/^const int   PORT = .*;/const int   PORT = $1;/" \
+           -e 's/^const char\* HOST = .*;/const char* HOST = "127.0.0.1";/' \
+           -e "s|^const char\* UNIX_SOCKET = .*;|const char* UNIX_SOCKET = $unix_socket;|" \
+           -e "s/^const int   REQUEST_COUNT = .*;/const int   REQUEST_COUNT = $2;/" \
+           -e "s|^const char\* LATENCY_JSON = .*;|const char* LATENCY_JSON = \"$BUILD/latency.json\";|" \
+           "$BUILD/post/config.h"
+    (cd "$BUILD/post" && $CC $CFLAGS -o "$3" main.c conn_pool.c send_request.c \
+        "$LIBHTTP/http_parser.c" "$LIBHTTP/http_scan.c" "$LIBHTTP/http_sink.c" "$LIBHTTP/http_template.c" \
+        "$LIBHTTP/http_ndjson.c" "$LIBHTTP/resolver.c" "$LIBHTTP/latency.c" "$LIBHTTP/retry.c" \
+        -I"$LIBHTTP" -pthread)
+}
+
+# Runs ------------------------------------------------------------------------------------------
+
+# Starts the server with the given options and waits until it listens
+start_server() {
+    PORT=$((PORT + 1))
+    "$BUILD/server" -p "$PORT" "$@" > "$BUILD/server.log" 2>&1 &
+    SERVER_PID=$!
+    for _ in $(seq 50); do
+        grep -q "^Listening" "$BUILD/server.log" 2>/dev/null && return
+        sleep 0.1
+    done
+    echo "The server did not start:" >&2
+    cat "$BUILD/server.log" >&2
+    exit 1
+}
+
+stop_server() {
+    kill "$SERVER_PID" 2>/dev/null || true
+    wait "$SERVER_PID" 2>/dev/null || true
+    SERVER_PID=""
+}
+
+# Prints a field of the "total" phase from a latency JSON file, e.g. p99
+latency_field() {
+    sed -n "s/.*\"total\": {.*\"$2\": \([0-9.]*\).*/\1/p" "$1"
+}
+
+# Prints a counter from the shim's output
+counter() {
+    sed -n "s/^$2 //p" "$1"
+}
+
+RESULTS="$BUILD/results.txt"
+: > "$RESULTS"
+
+# Runs a client under the counter shim and records a row of results
+# $1: scenario, $2: requests, remaining: the client command line
+measure() {
+    local name="$1" requests="$2"
+    shift 2
+    local start end rps
+    rm -f "$BUILD/latency.json" "$BUILD/counters.txt"
+
+    start=$(date +%s.%N)
+    COUNTERS_OUT="$BUILD/counters.txt" LD_PRELOAD="$BUILD/counters.so" "$@" > "$BUILD/client.log" 2>&1 || {
+        echo "$name: the client failed:" >&2
+        tail -n 20 "$BUILD/client.log" >&2
+        exit 1
+    }
+    end=$(date +%s.%N)
+
+    # The load generator measures its own rate; the POST client is timed from outside
+    rps=$(sed -n 's/^Requests\/sec: *\([0-9.]*\).*/\1/p' "$BUILD/client.log")
+    if [ -z "$rps" ]; then
+        rps=$(awk -v requests="$requests" -v start="$start" -v end="$end" 'BEGIN { print requests / (end - start) }')
+    fi
+
+    awk -v name="$name" -v requests="$requests" -v rps="$rps" \
+        -v p50="$(latency_field "$BUILD/latency.json" p50)" -v p99="$(latency_field "$BUILD/latency.json" p99)" \
+        -v allocations="$(counter "$BUILD/counters.txt" allocations)" \
+        -v syscalls="$(counter "$BUILD/counters.txt" syscalls)" \
+        -v cpu="$(( $(counter "$BUILD/counters.txt" cpu_user_us) + $(counter "$BUILD/counters.txt" cpu_system_us) ))" \
+        'BEGIN { printf "%s %.1f %.1f %.1f %.3f %.3f %.2f\n", name, rps, p50, p99, allocations / requests,
+                 syscalls / requests, cpu / requests }' \
+        >> "$RESULTS"
+}
+
+# Is the scenario selected with -s?
+selected() {
+    [ -z "$ONLY" ] || [[ "$ONLY" == *",$1,"* ]]
+}
+
+# Scenarios -------------------------------------------------------------------------------------
+
+LOADGEN="$BUILD/loadgen -H 127.0.0.1 -j $BUILD/latency.json"
+
+if selected epoll; then
+    start_server -s 512
+    measure epoll "$REQUESTS" $LOADGEN -p "$PORT" -c 32 -n "$REQUESTS" -B epoll
+    stop_server
+fi
+
+if selected io_uring; then
+    start_server -s 512
+    measure io_uring "$REQUESTS" $LOADGEN -p "$PORT" -c 32 -n "$REQUESTS" -B io_uring
+    stop_server
+fi
+
+if selected pipelined; then
+    start_server -s 512
+    measure pipelined "$REQUESTS" $LOADGEN -p "$PORT" -c 16 -P 8 -n "$REQUESTS"
+    stop_server
+fi
+
+if selected chunked; then
+    start_server -s 65536 -c 4096
+    measure chunked $((REQUESTS / 4)) $LOADGEN -p "$PORT" -c 16 -n $((REQUESTS / 4))
+    stop_server
+fi
+
+if selected close; then
+    # A new connection per request
+    start_server -s 512 -k
+    measure close $((REQUESTS / 10)) $LOADGEN -p "$PORT" -c 16 -n $((REQUESTS / 10))
+    stop_server
+fi
+
+if selected latency; then
+    # 2-4 ms per request: tests the waiting, not the speed
+    start_server -s 512 -l 2,2
+    measure latency $((REQUESTS / 10)) $LOADGEN -p "$PORT" -c 64 -n $((REQUESTS / 10))
+    stop_server
+fi
+
+if selected post; then
+    # One POST at a time over a pooled keep-alive connection
+    start_server -s 512
+    build_post_client "$PORT" $((REQUESTS / 10)) "$BUILD/post_client"
+    measure post $((REQUESTS / 10)) "$BUILD/post_client"
+    stop_server
+fi
+
+if selected post_unix; then
+    # The same over a Unix domain socket instead of TCP
+    start_server -s 512 -u "$BUILD/server.sock"
+    build_post_client "$PORT" $((REQUESTS / 10)) "$BUILD/post_client_unix" "$BUILD/server.sock"
+    measure post_unix $((REQUESTS / 10)) "$BUILD/post_client_unix"
+    stop_server
+fi
+
+# Report ----------------------------------------------------------------------------------------
+
+echo
+awk 'BEGIN { printf "%-10s %12s %10s %10s %12s %12s %12s\n", "scenario", "requests/s", "p50 (us)", "p99 (us)",
+             "allocs/req", "syscalls/req", "cpu/req (us)" }
+     { printf "%-10s %12.1f %10.1f %10.1f %12.3f %12.3f %12.2f\n", $1, $2, $3, $4, $5, $6, $7 }' "$RESULTS"
+
+if [ -n "$SAVE" ]; then
+    cp "$RESULTS" "$SAVE"
+    echo
+    echo "Saved as baseline: $SAVE"
+fi
+
+if [ -n "$COMPARE" ]; then
+    echo
+    # Slower, a longer tail, or more allocations, system calls or CPU time per request than the
+    # baseline (baselines saved before the CPU time was measured have no seventh column)
+    awk -v tolerance="$TOLERANCE" -v counter_tolerance="$COUNTER_TOLERANCE" '
+        NR == FNR { rps[$1] = $2; p99[$1] = $4; allocs[$1] = $5; syscalls[$1] = $6; cpu[$1] = $7; next }
+        !($1 in rps) { next }
+        {
+            if ($2 < rps[$1] * (1 - tolerance / 100)) {
+                printf "REGRESSION %s: %.1f requests/s, baseline %.1f\n", $1, $2, rps[$1]; failed = 1
+            }
+            if ($4 > p99[$1] * (1 + tolerance / 100)) {
+                printf "REGRESSION %s: p99 %.1f us, baseline %.1f us\n", $1, $4, p99[$1]; failed = 1
+            }
+            if ($5 > allocs[$1] * (1 + counter_tolerance / 100) + 0.05) {
+                printf "REGRESSION %s: %.3f allocations per request, baseline %.3f\n", $1, $5, allocs[$1]; failed = 1
+            }
+            if ($6 > syscalls[$1] * (1 + counter_tolerance / 100) + 0.05) {
+                printf "REGRESSION %s: %.3f system calls per request, baseline %.3f\n", $1, $6, syscalls[$1]; failed = 1
+            }
+            if (cpu[$1] != "" && $7 > cpu[$1] * (1 + tolerance / 100)) {
+                printf "REGRESSION %s: %.2f us CPU time per request, baseline %.2f us\n", $1, $7, cpu[$1]; failed = 1
+            }
+        }
+        END {
+            if (!failed) {
+                print "No regressions against the baseline."
+            }
+            exit failed
+        }' "$COMPARE" "$RESULTS"
+fi
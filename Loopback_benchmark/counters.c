@@ -0,0 +1,314 @@
+// Include libraries
+#define _GNU_SOURCE  // RTLD_NEXT
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <stdatomic.h>
+#include <dlfcn.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#include <sys/select.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+
+/*
+ * Counts the memory allocations and the system calls of a program, loaded with LD_PRELOAD:
+ *
+ *     gcc -O2 -shared -fPIC -o counters.so counters.c -ldl
+ *     COUNTERS_OUT=counts.txt LD_PRELOAD=./counters.so ./main ...
+ *
+ * The allocator functions are replaced by wrappers that count and call glibc's own allocator
+ * (__libc_malloc() and friends). The system calls are counted at the libc functions that make
+ * them: the wrappers count and call the next definition (dlsym(RTLD_NEXT)). Calls that libc makes
+ * internally (e.g. the sockets opened by getaddrinfo()) and functions that do not enter the kernel
+ * (clock_gettime() goes through the vDSO) are not counted. The totals, and the CPU time the
+ * program used, are written when it exits, to the file named by COUNTERS_OUT or to stderr.
+ */
+
+// Definition section
+enum counted_call {
+    CALL_SOCKET, CALL_CONNECT, CALL_ACCEPT, CALL_CLOSE, CALL_SHUTDOWN,
+    CALL_READ, CALL_WRITE, CALL_READV, CALL_WRITEV,
+    CALL_RECV, CALL_RECVFROM, CALL_RECVMSG, CALL_SEND, CALL_SENDTO, CALL_SENDMSG, CALL_SENDFILE,
+    CALL_POLL, CALL_SELECT, CALL_EPOLL_CREATE, CALL_EPOLL_CTL, CALL_EPOLL_WAIT,
+    CALL_SETSOCKOPT, CALL_GETSOCKOPT, CALL_FCNTL, CALL_NANOSLEEP, CALL_TIMERFD_SETTIME, CALL_SYSCALL,
+    CALL_COUNT
+};
+
+static const char *call_names[CALL_COUNT] = {
+    "socket", "connect", "accept", "close", "shutdown",
+    "read", "write", "readv", "writev",
+    "recv", "recvfrom", "recvmsg", "send", "sendto", "sendmsg", "sendfile",
+    "poll", "select", "epoll_create", "epoll_ctl", "epoll_wait",
+    "setsockopt", "getsockopt", "fcntl", "nanosleep", "timerfd_settime", "syscall"
+};
+
+// glibc's allocator, under the names it exports for this purpose
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+extern void *__libc_memalign(size_t alignment, size_t size);
+extern void __libc_free(void *pointer);
+
+static atomic_ullong calls[CALL_COUNT];
+static atomic_ullong allocations;
+static atomic_ullong frees;
+static atomic_ullong allocated_bytes;
+
+/**
+ * Counts a call and looks up the libc function it goes to (once).
+ */
+#define NEXT(name, call) \
+    static __typeof__(name) *next_##name; \
+    atomic_fetch_add_explicit(&calls[call], 1, memory_order_relaxed); \
+    if (next_##name == NULL) { \
+        next_##name = (__typeof__(name) *) dlsym(RTLD_NEXT, #name); \
+    }
+
+/**
+ * Counts an allocation of `size` bytes.
+ */
+static void count_allocation(size_t size) {
+    atomic_fetch_add_explicit(&allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&allocated_bytes, size, memory_order_relaxed);
+}
+
+void *malloc(size_t size) {
+    count_allocation(size);
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+    count_allocation(count * size);
+    return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+    count_allocation(size);
+    return __libc_realloc(pointer, size);
+}
+
+void *memalign(size_t alignment, size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) {
+    count_allocation(size);
+    return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **pointer, size_t alignment, size_t size) {
+    count_allocation(size);
+    *pointer = __libc_memalign(alignment, size);
+    return *pointer != NULL ? 0 : 12;  // ENOMEM
+}
+
+void free(void *pointer) {
+    if (pointer != NULL) {
+        atomic_fetch_add_explicit(&frees, 1, memory_order_relaxed);
+    }
+    __libc_free(pointer);
+}
+
+int socket(int domain, int type, int protocol) {
+    NEXT(socket, CALL_SOCKET);
+    return next_socket(domain, type, protocol);
+}
+
+int connect(int fd, const struct sockaddr *address, socklen_t len) {
+    NEXT(connect, CALL_CONNECT);
+    return next_connect(fd, address, len);
+}
+
+int accept(int fd, struct sockaddr *address, socklen_t *len) {
+    NEXT(accept, CALL_ACCEPT);
+    return next_accept(fd, address, len);
+}
+
+int accept4(int fd, struct sockaddr *address, socklen_t *len, int flags) {
+    NEXT(accept4, CALL_ACCEPT);
+    return next_accept4(fd, address, len, flags);
+}
+
+int close(int fd) {
+    NEXT(close, CALL_CLOSE);
+    return next_close(fd);
+}
+
+int shutdown(int fd, int how) {
+    NEXT(shutdown, CALL_SHUTDOWN);
+    return next_shutdown(fd, how);
+}
+
+ssize_t read(int fd, void *buffer, size_t len) {
+    NEXT(read, CALL_READ);
+    return next_read(fd, buffer, len);
+}
+
+ssize_t write(int fd, const void *buffer, size_t len) {
+    NEXT(write, CALL_WRITE);
+    return next_write(fd, buffer, len);
+}
+
+ssize_t readv(int fd, const struct iovec *iov, int count) {
+    NEXT(readv, CALL_READV);
+    return next_readv(fd, iov, count);
+}
+
+ssize_t writev(int fd, const struct iovec *iov, int count) {
+    NEXT(writev, CALL_WRITEV);
+    return next_writev(fd, iov, count);
+}
+
+ssize_t recv(int fd, void *buffer, size_t len, int flags) {
+    NEXT(recv, CALL_RECV);
+    return next_recv(fd, buffer, len, flags);
+}
+
+ssize_t recvfrom(int fd, void *buffer, size_t len, int flags, struct sockaddr *address, socklen_t *address_len) {
+    NEXT(recvfrom, CALL_RECVFROM);
+    return next_recvfrom(fd, buffer, len, flags, address, address_len);
+}
+
+ssize_t recvmsg(int fd, struct msghdr *message, int flags) {
+    NEXT(recvmsg, CALL_RECVMSG);
+    return next_recvmsg(fd, message, flags);
+}
+
+ssize_t send(int fd, const void *buffer, size_t len, int flags) {
+    NEXT(send, CALL_SEND);
+    return next_send(fd, buffer, len, flags);
+}
+
+ssize_t sendto(int fd, const void *buffer, size_t len, int flags, const struct sockaddr *address,
+               socklen_t address_len) {
+    NEXT(sendto, CALL_SENDTO);
+    return next_sendto(fd, buffer, len, flags, address, address_len);
+}
+
+ssize_t sendmsg(int fd, const struct msghdr *message, int flags) {
+    NEXT(sendmsg, CALL_SENDMSG);
+    return next_sendmsg(fd, message, flags);
+}
+
+ssize_t sendfile(int out_fd, int in_fd, off_t *offset, size_t count) {
+    NEXT(sendfile, CALL_SENDFILE);
+    return next_sendfile(out_fd, in_fd, offset, count);
+}
+
+int poll(struct pollfd *fds, nfds_t count, int timeout) {
+    NEXT(poll, CALL_POLL);
+    return next_poll(fds, count, timeout);
+}
+
+int select(int count, fd_set *read_fds, fd_set *write_fds, fd_set *except_fds, struct timeval *timeout) {
+    NEXT(select, CALL_SELECT);
+    return next_select(count, read_fds, write_fds, except_fds, timeout);
+}
+
+int epoll_create1(int flags) {
+    NEXT(epoll_create1, CALL_EPOLL_CREATE);
+    return next_epoll_create1(flags);
+}
+
+int epoll_ctl(int epoll_fd, int operation, int fd, struct epoll_event *event) {
+    NEXT(epoll_ctl, CALL_EPOLL_CTL);
+    return next_epoll_ctl(epoll_fd, operation, fd, event);
+}
+
+int epoll_wait(int epoll_fd, struct epoll_event *events, int max_events, int timeout) {
+    NEXT(epoll_wait, CALL_EPOLL_WAIT);
+    return next_epoll_wait(epoll_fd, events, max_events, timeout);
+}
+
+int setsockopt(int fd, int level, int name, const void *value, socklen_t len) {
+    NEXT(setsockopt, CALL_SETSOCKOPT);
+    return next_setsockopt(fd, level, name, value, len);
+}
+
+int getsockopt(int fd, int level, int name, void *value, socklen_t *len) {
+    NEXT(getsockopt, CALL_GETSOCKOPT);
+    return next_getsockopt(fd, level, name, value, len);
+}
+
+int fcntl(int fd, int command, ...) {
+    va_list args;
+    void *arg;
+
+    NEXT(fcntl, CALL_FCNTL);
+    // The argument is an int or a pointer; both are passed in the same register
+    va_start(args, command);
+    arg = va_arg(args, void *);
+    va_end(args);
+    return next_fcntl(fd, command, arg);
+}
+
+int nanosleep(const struct timespec *duration, struct timespec *remaining) {
+    NEXT(nanosleep, CALL_NANOSLEEP);
+    return next_nanosleep(duration, remaining);
+}
+
+int timerfd_settime(int fd, int flags, const struct itimerspec *value, struct itimerspec *old_value) {
+    NEXT(timerfd_settime, CALL_TIMERFD_SETTIME);
+    return next_timerfd_settime(fd, flags, value, old_value);
+}
+
+long syscall(long number, ...) {
+    va_list args;
+    long arg[6];
+
+    // Raw system calls, e.g. io_uring_enter()
+    NEXT(syscall, CALL_SYSCALL);
+    va_start(args, number);
+    for (int i = 0; i < 6; i++) {
+        arg[i] = va_arg(args, long);
+    }
+    va_end(args);
+    return next_syscall(number, arg[0], arg[1], arg[2], arg[3], arg[4], arg[5]);
+}
+
+/**
+ * Writes the totals when the program exits.
+ */
+__attribute__((destructor))
+static void write_counters(void) {
+    unsigned long long counts[CALL_COUNT];
+    unsigned long long total = 0;
+    unsigned long long allocation_count = atomic_load(&allocations);
+    unsigned long long free_count = atomic_load(&frees);
+    unsigned long long bytes = atomic_load(&allocated_bytes);
+    const char *path = getenv("COUNTERS_OUT");
+    FILE *out = stderr;
+    struct rusage usage;
+
+    // Take the numbers before writing them costs anything
+    for (int i = 0; i < CALL_COUNT; i++) {
+        counts[i] = atomic_load(&calls[i]);
+        total += counts[i];
+    }
+    getrusage(RUSAGE_SELF, &usage);
+    if (path != NULL && (out = fopen(path, "w")) == NULL) {
+        return;
+    }
+    fprintf(out, "allocations %llu\n", allocation_count);
+    fprintf(out, "frees %llu\n", free_count);
+    fprintf(out, "allocated_bytes %llu\n", bytes);
+    fprintf(out, "syscalls %llu\n", total);
+    fprintf(out, "cpu_user_us %lld\n", usage.ru_utime.tv_sec * 1000000LL + usage.ru_utime.tv_usec);
+    fprintf(out, "cpu_system_us %lld\n", usage.ru_stime.tv_sec * 1000000LL + usage.ru_stime.tv_usec);
+    for (int i = 0; i < CALL_COUNT; i++) {
+        if (counts[i] > 0) {
+            fprintf(out, "syscall.%s %llu\n", call_names[i], counts[i]);
+        }
+    }
+    if (out != stderr) {
+        fclose(out);
+    }
+}
@@ -0,0 +1,744 @@
+// Include libraries
+#define _GNU_SOURCE  // accept4
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "timer_wheel.h"
+
+// Definition section
+#define MAX_EVENTS 256
+#define INPUT_BUFFER_SIZE 16384  // Largest request head a client may send
+#define MAX_PIPELINE 128         // Requests of a connection that wait for their response at once
+#define DEFAULT_PORT 5000
+#define DEFAULT_BODY_SIZE 2
+#define DEFAULT_TRICKLE_MS 100
+
+// Deliberately slow behaviours
+enum slow_mode {
+    SLOW_NONE,      // Answer normally
+    SLOW_TRICKLE,   // Send every response one byte at a time, `trickle` ms apart
+    SLOW_STALL,     // Send the head of the first response, then nothing
+    SLOW_SILENT     // Read the requests, never answer
+};
+
+// Settings of the server, from the command line
+struct server_options {
+    int port;               // Port to listen on
+    const char *unix_path;  // Listen on this Unix domain socket instead of the port, or NULL
+    int workers;            // Threads, each with its own listening socket and event loop
+    size_t body_size;       // Bytes in the body of a 200 response
+    int latency;            // Milliseconds before a request is answered
+    int jitter;             // Up to this many milliseconds added to the latency, at random
+    size_t chunk_size;      // Send bodies chunked in chunks of this size, 0 for Content-Length
+    int close;              // Close the connection after every response
+    double error_rate;      // Share of requests answered with 503 Service Unavailable
+    enum slow_mode slow;    // Deliberately slow behaviour
+    int trickle;            // Milliseconds between two bytes in the trickle mode
+};
+
+// A response that is ready to go out, formatted once at start-up
+struct response {
+    char *data;             // Head and body
+    size_t len;
+};
+
+// A request waiting for its response
+struct pending {
+    unsigned long long due; // Tick (ms) at which it may be answered
+    int error;              // Answer with the error response?
+    int close;              // Close the connection after the response?
+};
+
+// State of one client connection
+struct client {
+    int fd;
+    char in[INPUT_BUFFER_SIZE];// Request bytes not parsed yet
+    size_t in_len;
+    unsigned long long body_left;// Bytes of the current request body still to be skipped
+    int chunked;            // Skipping a chunked body: 1 at a chunk size line, 2 in the trailer
+    struct pending queue[MAX_PIPELINE];// Requests waiting for their responses, oldest first
+    int head;
+    int queued;
+    const struct response *out;// Response being written, NULL if none
+    size_t out_pos;         // Bytes of it written
+    unsigned int events;    // Events the client is watched for
+    struct timer timer;     // Fires when the oldest response is due (or the next trickled byte)
+};
+
+// State of one worker thread
+struct worker {
+    const struct server_options *options;
+    int listen_fd;
+    int epoll_fd;
+    struct timer_wheel wheel;
+    struct client **clients;// Indexed by file descriptor
+    int capacity;
+    unsigned long long rng; // xorshift64* state for the jitter and the errors
+    unsigned long long served;// Responses sent completely
+    pthread_t thread;
+};
+
+// Responses, formatted once
+static struct response ok_response;
+static struct response error_response;
+
+// Set by SIGINT and SIGTERM
+static volatile sig_atomic_t stopping = 0;
+
+/**
+ * @return The current time of the monotonic clock in milliseconds (the tick of the timer wheel).
+ */
+static unsigned long long now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000;
+}
+
+/**
+ * @return A random number (xorshift64*).
+ */
+static unsigned long long next_random(struct worker *worker) {
+    worker->rng ^= worker->rng >> 12;
+    worker->rng ^= worker->rng << 25;
+    worker->rng ^= worker->rng >> 27;
+    return worker->rng * 0x2545F4914F6CDD1DULL;
+}
+
+/**
+ * Formats a response with a body of `body_size` bytes, with a Content-Length or, given a
+ * `chunk_size`, chunked. The body is a JSON object padded to the size (or just 'x's if it is too
+ * small for one).
+ */
+static int format_response(struct response *response, const char *status, size_t body_size,
+                           size_t chunk_size, int close) {
+    size_t chunks = chunk_size > 0 ? (body_size + chunk_size - 1) / chunk_size : 0;
+    size_t capacity = 256 + body_size + chunks * 24;
+    char *body = malloc(body_size + 1);
+    char *data = malloc(capacity);
+    size_t len;
+
+    if (body == NULL || data == NULL) {
+        free(body);
+        free(data);
+        return -1;
+    }
+    memset(body, 'x', body_size);
+    if (body_size >= 12) {
+        memcpy(body, "{\"data\": \"", 10);
+        memcpy(body + body_size - 2, "\"}", 2);
+    }
+
+    len = snprintf(data, capacity, "HTTP/1.1 %s\r\nContent-Type: application/json\r\n%s", status,
+                   close ? "Connection: close\r\n" : "");
+    if (chunk_size > 0) {
+        len += snprintf(data + len, capacity - len, "Transfer-Encoding: chunked\r\n\r\n");
+        for (size_t offset = 0; offset < body_size; offset += chunk_size) {
+            size_t size = body_size - offset < chunk_size ? body_size - offset : chunk_size;
+            len += snprintf(data + len, capacity - len, "%zx\r\n", size);
+            memcpy(data + len, body + offset, size);
+            len += size;
+            memcpy(data + len, "\r\n", 2);
+            len += 2;
+        }
+        memcpy(data + len, "0\r\n\r\n", 5);
+        len += 5;
+    } else {
+        len += snprintf(data + len, capacity - len, "Content-Length: %zu\r\n\r\n", body_size);
+        memcpy(data + len, body, body_size);
+        len += body_size;
+    }
+
+    free(body);
+    response->data = data;
+    response->len = len;
+    return 0;
+}
+
+/**
+ * Closes a client connection and forgets it.
+ */
+static void drop_client(struct worker *worker, struct client *client) {
+    timer_wheel_cancel(&worker->wheel, &client->timer);
+    worker->clients[client->fd] = NULL;
+    close(client->fd);
+    free(client);
+}
+
+/**
+ * Watches a client for requests while it has room for them, and for room in the socket buffer
+ * while a response is stuck. The epoll set is only touched when that changes.
+ */
+static void watch(struct worker *worker, struct client *client, int writing) {
+    struct epoll_event event;
+
+    event.events = (client->queued < MAX_PIPELINE ? EPOLLIN : 0) | (writing ? EPOLLOUT : 0);
+    if (event.events == client->events) {
+        return;
+    }
+    client->events = event.events;
+    event.data.fd = client->fd;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_MOD, client->fd, &event);
+}
+
+/**
+ * Finds the end of a line in the input.
+ *
+ * @return The offset just after the "\n", or 0 if the line is not complete yet.
+ */
+static size_t line_end(const struct client *client, size_t start) {
+    const char *newline = memchr(client->in + start, '\n', client->in_len - start);
+    return newline != NULL ? (size_t) (newline - client->in) + 1 : 0;
+}
+
+/**
+ * Queues the response to a request whose head is complete.
+ *
+ * @param head The head, without its empty line.
+ */
+static void queue_request(struct worker *worker, struct client *client, const char *head, size_t len) {
+    const struct server_options *options = worker->options;
+    struct pending *pending = &client->queue[(client->head + client->queued) % MAX_PIPELINE];
+    const char *line = memchr(head, '\n', len);
+    const char *end = head + len;
+    int http_1_0 = line != NULL && line - head >= 9 && memcmp(line - 9, "HTTP/1.0", 8) == 0;
+
+    pending->close = options->close || http_1_0;
+    client->body_left = 0;
+    client->chunked = 0;
+    while (line != NULL && line + 1 < end) {
+        const char *name = line + 1;
+        line = memchr(name, '\n', end - name);
+
+        if (strncasecmp(name, "content-length:", 15) == 0) {
+            client->body_left = strtoull(name + 15, NULL, 10);
+        } else if (strncasecmp(name, "transfer-encoding:", 18) == 0) {
+            client->chunked = 1;
+        } else if (strncasecmp(name, "connection:", 11) == 0) {
+            const char *value = name + 11;
+            while (*value == ' ') {
+                value++;
+            }
+            if (strncasecmp(value, "close", 5) == 0) {
+                pending->close = 1;
+            } else if (strncasecmp(value, "keep-alive", 10) == 0) {
+                pending->close = options->close;
+            }
+        }
+    }
+
+    pending->due = now_ms() + options->latency;
+    if (options->jitter > 0) {
+        pending->due += next_random(worker) % (options->jitter + 1);
+    }
+    pending->error = options->error_rate > 0
+                     && (next_random(worker) >> 11) * (1.0 / 9007199254740992.0) < options->error_rate;
+    if (options->slow != SLOW_SILENT) {
+        // A silent server swallows requests, they never wait for anything
+        client->queued++;
+    }
+}
+
+/**
+ * Parses the requests in the input: heads are queued for an answer, bodies are skipped.
+ */
+static void parse_requests(struct worker *worker, struct client *client) {
+    size_t start = 0;
+
+    while (start < client->in_len && client->queued < MAX_PIPELINE) {
+        if (client->body_left > 0) {
+            // Body bytes are not needed, only counted off
+            size_t skip = client->in_len - start < client->body_left ? client->in_len - start : client->body_left;
+            start += skip;
+            client->body_left -= skip;
+            if (client->body_left == 0 && client->chunked) {
+                client->chunked = 1;  // The CRLF after the chunk data comes before the next size line
+            }
+            continue;
+        }
+        if (client->chunked) {
+            size_t end = line_end(client, start);
+            if (end == 0) {
+                break;
+            }
+            if (client->chunked == 2) {
+                // Trailer: ends with an empty line
+                if (end - start <= 2) {
+                    client->chunked = 0;
+                }
+            } else if (end - start > 2 || client->in[start] != '\r') {
+                unsigned long long size = strtoull(client->in + start, NULL, 16);
+                if (size == 0) {
+                    client->chunked = 2;
+                } else {
+                    client->body_left = size;
+                }
+            }
+            start = end;
+            continue;
+        }
+
+        // A new request: wait for its whole head
+        char *head_end = memmem(client->in + start, client->in_len - start, "\r\n\r\n", 4);
+        if (head_end == NULL) {
+            break;
+        }
+        queue_request(worker, client, client->in + start, head_end + 2 - (client->in + start));
+        start = head_end + 4 - client->in;
+    }
+
+    memmove(client->in, client->in + start, client->in_len - start);
+    client->in_len -= start;
+}
+
+/**
+ * Writes due responses, oldest first. A response that has to wait (latency, trickle) or a full
+ * socket buffer leaves the rest for later.
+ *
+ * @return 0 if the client is still connected, -1 if it was dropped.
+ */
+static int write_responses(struct worker *worker, struct client *client) {
+    const struct server_options *options = worker->options;
+
+    while (client->queued > 0) {
+        struct pending *pending = &client->queue[client->head];
+        unsigned long long now = now_ms();
+        size_t len;
+        ssize_t written;
+
+        if (options->slow == SLOW_SILENT) {
+            return 0;
+        }
+        if (pending->due > now) {
+            timer_wheel_add(&worker->wheel, &client->timer, pending->due);
+            return 0;
+        }
+        if (client->out == NULL) {
+            client->out = pending->error ? &error_response : &ok_response;
+            client->out_pos = 0;
+        }
+
+        len = client->out->len - client->out_pos;
+        if (options->slow == SLOW_TRICKLE) {
+            len = 1;
+        } else if (options->slow == SLOW_STALL) {
+            // Up to the empty line after the head, then silence
+            const char *head_end = memmem(client->out->data, client->out->len, "\r\n\r\n", 4);
+            len = head_end + 4 - client->out->data - client->out_pos;
+            if (len == 0) {
+                return 0;
+            }
+        }
+
+        written = send(client->fd, client->out->data + client->out_pos, len, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                watch(worker, client, 1);
+                return 0;
+            }
+            drop_client(worker, client);
+            return -1;
+        }
+        client->out_pos += written;
+
+        if (client->out_pos < client->out->len) {
+            if (options->slow == SLOW_TRICKLE) {
+                pending->due = now + options->trickle;
+            }
+            continue;
+        }
+
+        // Response complete
+        client->out = NULL;
+        client->head = (client->head + 1) % MAX_PIPELINE;
+        client->queued--;
+        worker->served++;
+        if (pending->close) {
+            drop_client(worker, client);
+            return -1;
+        }
+        // Room for more requests: parse what is buffered already
+        if (client->in_len > 0) {
+            parse_requests(worker, client);
+        }
+    }
+    watch(worker, client, 0);
+    return 0;
+}
+
+/**
+ * Reads requests from a client.
+ */
+static void read_requests(struct worker *worker, struct client *client) {
+    for (;;) {
+        ssize_t received;
+
+        if (client->in_len == sizeof(client->in)) {
+            if (client->queued == MAX_PIPELINE) {
+                // No room for more requests until responses went out
+                watch(worker, client, (client->events & EPOLLOUT) != 0);
+                return;
+            }
+            // A head larger than the buffer
+            drop_client(worker, client);
+            return;
+        }
+        received = recv(client->fd, client->in + client->in_len, sizeof(client->in) - client->in_len, 0);
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                drop_client(worker, client);
+            }
+            return;
+        }
+        if (received == 0) {
+            drop_client(worker, client);
+            return;
+        }
+        client->in_len += received;
+        parse_requests(worker, client);
+        if (write_responses(worker, client) < 0) {
+            return;
+        }
+        if (client->queued == MAX_PIPELINE) {
+            watch(worker, client, (client->events & EPOLLOUT) != 0);
+            return;
+        }
+    }
+}
+
+/**
+ * Accepts every pending connection.
+ */
+static void accept_clients(struct worker *worker) {
+    for (;;) {
+        int fd = accept4(worker->listen_fd, NULL, NULL, SOCK_NONBLOCK);
+        struct epoll_event event;
+        struct client *client;
+        int one = 1;
+
+        if (fd < 0) {
+            return;
+        }
+        if (fd >= worker->capacity) {
+            int capacity = worker->capacity * 2 > fd + 1 ? worker->capacity * 2 : fd + 1;
+            struct client **clients = realloc(worker->clients, capacity * sizeof(*clients));
+            if (clients == NULL) {
+                close(fd);
+                continue;
+            }
+            memset(clients + worker->capacity, 0, (capacity - worker->capacity) * sizeof(*clients));
+            worker->clients = clients;
+            worker->capacity = capacity;
+        }
+        client = calloc(1, sizeof(*client));
+        if (client == NULL) {
+            close(fd);
+            continue;
+        }
+        client->fd = fd;
+        client->events = EPOLLIN;
+        timer_init(&client->timer, fd, 0);
+        worker->clients[fd] = client;
+        if (worker->options->unix_path == NULL) {
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        }
+
+        event.events = EPOLLIN;
+        event.data.fd = fd;
+        epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    }
+}
+
+/**
+ * Timer wheel callback: a response of a client is due.
+ */
+static void response_due(void *ctx, struct timer *timer) {
+    struct worker *worker = ctx;
+    struct client *client = worker->clients[timer->owner];
+
+    if (client != NULL) {
+        write_responses(worker, client);
+    }
+}
+
+/**
+ * Opens the listening socket of a worker. Every worker has its own (SO_REUSEPORT), the kernel
+ * spreads the connections over them.
+ */
+static int open_listener(int port) {
+    struct sockaddr_in address;
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    int one = 1;
+
+    if (fd < 0) {
+        return -1;
+    }
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &one, sizeof(one));
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Opens the listening Unix domain socket at `path`, replacing a socket file left behind by an
+ * earlier run. Unix domain sockets have no SO_REUSEPORT: the workers share this one.
+ */
+static int open_unix_listener(const char *path) {
+    struct sockaddr_un address;
+    int fd;
+
+    if (strlen(path) >= sizeof(address.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    if (fd < 0) {
+        return -1;
+    }
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    strcpy(address.sun_path, path);
+    unlink(path);
+    if (bind(fd, (struct sockaddr *) &address, sizeof(address)) < 0 || listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/**
+ * Runs the event loop of one worker until the server is stopped.
+ */
+static void * run_worker(void *arg) {
+    struct worker *worker = arg;
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+
+    event.events = EPOLLIN;
+    event.data.fd = worker->listen_fd;
+    epoll_ctl(worker->epoll_fd, EPOLL_CTL_ADD, worker->listen_fd, &event);
+    timer_wheel_init(&worker->wheel, now_ms());
+
+    while (!stopping) {
+        long long next = timer_wheel_next(&worker->wheel);
+        int timeout = 1000;
+        int ready;
+
+        if (next >= 0) {
+            long long wait = next - (long long) now_ms();
+            timeout = wait < 0 ? 0 : (wait < timeout ? (int) wait : timeout);
+        }
+        ready = epoll_wait(worker->epoll_fd, events, MAX_EVENTS, timeout);
+        timer_wheel_advance(&worker->wheel, now_ms(), response_due, worker);
+
+        for (int i = 0; i < ready; i++) {
+            struct client *client;
+
+            if (events[i].data.fd == worker->listen_fd) {
+                accept_clients(worker);
+                continue;
+            }
+            client = worker->clients[events[i].data.fd];
+            if (client == NULL) {
+                continue;
+            }
+            if ((events[i].events & EPOLLOUT) && write_responses(worker, client) < 0) {
+                continue;
+            }
+            if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                read_requests(worker, client);
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Stops the server.
+ */
+static void stop(int signal) {
+    (void) signal;
+    stopping = 1;
+}
+
+/**
+ * Prints the command line usage of the server.
+ */
+static void print_usage(const char *program) {
+    printf("Usage: %s [options]\n\n", program);
+    printf("A stand-in HTTP/1.1 server on 127.0.0.1 that answers every request with the same response.\n\n");
+    printf("  -p port         Port to listen on (default %d)\n", DEFAULT_PORT);
+    printf("  -u path         Listen on a Unix domain socket at path instead\n");
+    printf("  -w workers      Threads, each with its own event loop (default 1)\n");
+    printf("  -s bytes        Size of the response body (default %d)\n", DEFAULT_BODY_SIZE);
+    printf("  -l ms[,jitter]  Answer every request after ms milliseconds, plus up to jitter at random\n");
+    printf("  -c chunk_size   Send the body chunked, in chunks of this size\n");
+    printf("  -k              Close the connection after every response (no keep-alive)\n");
+    printf("  -e rate         Answer this share of the requests (0 to 1) with 503 Service Unavailable\n");
+    printf("  -S mode         Misbehave: trickle (one byte every -t ms), stall (head only) or silent\n");
+    printf("  -t ms           Milliseconds between two bytes in the trickle mode (default %d)\n", DEFAULT_TRICKLE_MS);
+}
+
+int main(int argc, char *argv[]) {
+    struct server_options options;
+    struct worker *workers;
+    unsigned long long served = 0;
+    char *comma;
+    int option;
+
+    memset(&options, 0, sizeof(options));
+    options.port = DEFAULT_PORT;
+    options.workers = 1;
+    options.body_size = DEFAULT_BODY_SIZE;
+    options.trickle = DEFAULT_TRICKLE_MS;
+
+    while ((option = getopt(argc, argv, "p:u:w:s:l:c:ke:S:t:h")) != -1) {
+        switch (option) {
+            case 'p':
+                options.port = atoi(optarg);
+                break;
+            case 'u':
+                options.unix_path = optarg;
+                break;
+            case 'w':
+                options.workers = atoi(optarg);
+                break;
+            case 's':
+                options.body_size = strtoull(optarg, NULL, 10);
+                break;
+            case 'l':
+                options.latency = atoi(optarg);
+                comma = strchr(optarg, ',');
+                if (comma != NULL) {
+                    options.jitter = atoi(comma + 1);
+                }
+                break;
+            case 'c':
+                options.chunk_size = strtoull(optarg, NULL, 10);
+                break;
+            case 'k':
+                options.close = 1;
+                break;
+            case 'e':
+                options.error_rate = atof(optarg);
+                break;
+            case 'S':
+                if (strcmp(optarg, "trickle") == 0) {
+                    options.slow = SLOW_TRICKLE;
+                } else if (strcmp(optarg, "stall") == 0) {
+                    options.slow = SLOW_STALL;
+                } else if (strcmp(optarg, "silent") == 0) {
+                    options.slow = SLOW_SILENT;
+                } else {
+                    printf("Error! Unknown mode: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                options.trickle = atoi(optarg);
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+    if (options.port <= 0 || options.port > 65535 || options.workers < 1 || options.latency < 0
+            || options.jitter < 0 || options.error_rate < 0 || options.trickle < 1) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if (format_response(&ok_response, "200 OK", options.body_size, options.chunk_size, options.close) < 0
+            || format_response(&error_response, "503 Service Unavailable", 0, 0, options.close) < 0) {
+        printf("Error! Memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+
+    workers = calloc(options.workers, sizeof(struct worker));
+    if (workers == NULL) {
+        printf("Error! Memory allocation failed\n");
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < options.workers; i++) {
+        workers[i].options = &options;
+        workers[i].rng = (unsigned long long) now_ms() * 2654435761ULL + i + 1;
+        if (options.unix_path == NULL) {
+            workers[i].listen_fd = open_listener(options.port);
+        } else {
+            workers[i].listen_fd = i == 0 ? open_unix_listener(options.unix_path) : workers[0].listen_fd;
+        }
+        workers[i].epoll_fd = epoll_create1(0);
+        if (workers[i].listen_fd < 0 || workers[i].epoll_fd < 0) {
+            if (options.unix_path != NULL) {
+                printf("Error! Cannot listen on %s: %s\n", options.unix_path, strerror(errno));
+            } else {
+                printf("Error! Cannot listen on port %d: %s\n", options.port, strerror(errno));
+            }
+            return EXIT_FAILURE;
+        }
+    }
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+    signal(SIGPIPE, SIG_IGN);
+    if (options.unix_path != NULL) {
+        printf("Listening on %s (%d worker(s), %zu byte bodies)\n", options.unix_path, options.workers,
+               options.body_size);
+    } else {
+        printf("Listening on 127.0.0.1:%d (%d worker(s), %zu byte bodies)\n", options.port, options.workers,
+               options.body_size);
+    }
+    fflush(stdout);
+
+    for (int i = 1; i < options.workers; i++) {
+        pthread_create(&workers[i].thread, NULL, run_worker, &workers[i]);
+    }
+    run_worker(&workers[0]);
+    for (int i = 1; i < options.workers; i++) {
+        pthread_kill(workers[i].thread, SIGTERM);
+        pthread_join(workers[i].thread, NULL);
+    }
+
+    for (int i = 0; i < options.workers; i++) {
+        served += workers[i].served;
+        for (int fd = 0; fd < workers[i].capacity; fd++) {
+            if (workers[i].clients[fd] != NULL) {
+                drop_client(&workers[i], workers[i].clients[fd]);
+            }
+        }
+        free(workers[i].clients);
+        close(workers[i].epoll_fd);
+        if (i == 0 || options.unix_path == NULL) {
+            close(workers[i].listen_fd);
+        }
+    }
+    if (options.unix_path != NULL) {
+        unlink(options.unix_path);
+    }
+    free(workers);
+    free(ok_response.data);
+    free(error_response.data);
+    printf("Served %llu responses\n", served);
+    return EXIT_SUCCESS;
+}
@@ -5,3 +5,38 @@
 const int   PORT = 5000; 
 const char* HOST = "localhost";
 const char* PATH = "/example"; // within the host
+const char* UNIX_SOCKET = NULL; // path of a Unix domain socket to connect to
+                                // instead of HOST:PORT, for a server on the
+                                // same machine (HOST is still sent as the
+                                // Host header); not on Windows
+const char* BODY_FILE = NULL;  // send this file as the body instead of the
+                               // example in main.c (e.g. "prompt.json"),
+                               // "-" streams stdin
+const int   CHUNKED_UPLOAD = 0;// 1: stream BODY_FILE in chunks as it is read
+const char* RESPONSE_FILE = NULL; // write response bodies to this file as
+                                  // they arrive instead of printing them
+const int   STREAM = 0;       // 1: ask for a streamed answer ("stream": true)
+                              // and print every NDJSON record (line) of it
+                              // as soon as it arrives
+
+const int   REQUEST_COUNT = 3;        // POSTs sent over the pooled connection(s)
+const int   BATCH_ITEMS = 0;          // >0: send the REQUEST_COUNT bodies as records
+                                      // of batched POSTs, up to this many per POST
+const int   BATCH_MAX_BYTES = 65536;  // largest body of a batched POST
+const int   BATCH_LINGER_MS = 5;      // most ms a record waits for others
+const int   BATCH_NDJSON = 0;         // 1: batch as NDJSON lines instead of a
+                                      // JSON array (see http_batch.h)
+const int   POOL_MAX_CONNECTIONS = 4; // open sockets kept by the pool
+const int   POOL_IDLE_TIMEOUT = 30;   // seconds before an idle socket is closed
+const char* HOSTS_FILE = NULL;        // hosts-style file that is consulted
+                                      // before DNS (e.g. to test resolution)
+const char* LATENCY_JSON = NULL;      // write the latency percentiles of every
+                                      // phase to this file as JSON ("-": stdout)
+
+const int   RETRIES = 2;              // times a failed POST is sent again
+const int   RETRY_5XX = 1;            // 1: also retry 5xx answers (server errors)
+const int   RETRY_BASE_DELAY = 100;   // ms of backoff before the first retry,
+                                      // doubling (at random) for each next one
+const int   RETRY_MAX_DELAY = 2000;   // most ms of backoff before a retry
+const double RETRY_BUDGET = 0.1;      // retries allowed per POST sent (on top
+                                      // of a small reserve), see retry.h
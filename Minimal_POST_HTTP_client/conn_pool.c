@@ -0,0 +1,285 @@
+/**
+ * Keep-alive connection pool, see conn_pool.h.
+ * @author: Michal Spano
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "platform.h"
+#include "conn_pool.h"
+
+/**
+ * Connects a new (blocking) TCP socket to one resolved address.
+ *
+ * @returns: the socket, or -1 if this address did not work
+ */
+static int connect_address(const struct addrinfo* address, int port) {
+  struct sockaddr_storage server_addr; // large enough for IPv4 and IPv6
+
+  // Socket of the same family (i.e. IPv4 or IPv6) as the address
+  int sock = socket(address->ai_family, SOCK_STREAM, 0);
+  if (sock < 0) {
+    return -1;
+  }
+
+  memset(&server_addr, 0, sizeof(server_addr));
+  memcpy(&server_addr, address->ai_addr, address->ai_addrlen);
+  if (address->ai_family == AF_INET6) {
+    ((struct sockaddr_in6*)&server_addr)->sin6_port = htons(port);
+  } else {
+    ((struct sockaddr_in*)&server_addr)->sin_port = htons(port);
+  }
+
+  if (connect(sock, (struct sockaddr*)&server_addr, (int)address->ai_addrlen) < 0) {
+    close_socket(sock);
+    return -1;
+  }
+  return sock;
+}
+
+#ifndef WINDOWS_PLATFORM
+/**
+ * Connects a new (blocking) socket to the Unix domain socket at `path`. Data
+ * is copied from socket to socket within the kernel, without TCP/IP (no
+ * segments, checksums, acknowledgements or loopback interface).
+ *
+ * @returns: the socket, or -1 on failure
+ */
+static int connect_unix(struct conn_pool* pool, const char* path) {
+  struct sockaddr_un server_addr;
+  long long phase_start = latency_now_ns();
+
+  if (strlen(path) >= sizeof(server_addr.sun_path)) {
+    fprintf(stderr, "Unix socket path too long: %s\n", path);
+    return -1;
+  }
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock < 0) {
+    perror("Failed to create socket");
+    return -1;
+  }
+
+  memset(&server_addr, 0, sizeof(server_addr));
+  server_addr.sun_family = AF_UNIX;
+  strcpy(server_addr.sun_path, path);
+  if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
+    perror("Connection failed");
+    close_socket(sock);
+    return -1;
+  }
+  if (pool->timings != NULL) {
+    http_timings_record(pool->timings, HTTP_PHASE_CONNECT, phase_start, latency_now_ns());
+  }
+  return sock;
+}
+#endif
+
+/**
+ * Opens a fresh (blocking) TCP connection to `host:port`, trying every address
+ * of the host in turn. On Unix the name comes from the pool's resolver, which
+ * caches it for its DNS TTL, so new connections to a known host skip DNS.
+ *
+ * @returns: the socket, or -1 on failure
+ */
+static int open_connection(struct conn_pool* pool, const char* host, int port) {
+  int sock = -1;
+  const struct addrinfo* address;
+  long long phase_start = latency_now_ns();
+
+  // Port 0: `host` is the path of a Unix domain socket
+  if (port == 0) {
+#ifdef WINDOWS_PLATFORM
+    fprintf(stderr, "Unix domain sockets are not supported on Windows\n");
+    return -1;
+#else
+    return connect_unix(pool, host);
+#endif
+  }
+
+#ifdef WINDOWS_PLATFORM
+  struct addrinfo hints, *addresses;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;     // IPv4 or IPv6
+  hints.ai_socktype = SOCK_STREAM; // TCP
+
+  int error = getaddrinfo(host, NULL, &hints, &addresses);
+#else
+  struct resolver_entry* lookup;
+  int error = resolver_lookup(&pool->resolver, host, POOL_DNS_TIMEOUT * 1000, &lookup);
+#endif
+  if (error != 0) {
+    fprintf(stderr, "Failed to resolve host %s: %s\n", host, gai_strerror(error));
+    return -1;
+  }
+  if (pool->timings != NULL) {
+    http_timings_record(pool->timings, HTTP_PHASE_DNS, phase_start, latency_now_ns());
+  }
+  phase_start = latency_now_ns();
+
+#ifdef WINDOWS_PLATFORM
+  for (address = addresses; address != NULL && sock < 0; address = address->ai_next) {
+#else
+  for (address = lookup->addresses; address != NULL && sock < 0; address = address->ai_next) {
+#endif
+    sock = connect_address(address, port);
+  }
+
+  // Try to open a socket connection, handle the case if the connection is refused.
+  if (sock < 0) {
+    perror("Connection failed");
+  } else if (pool->timings != NULL) {
+    http_timings_record(pool->timings, HTTP_PHASE_CONNECT, phase_start, latency_now_ns());
+  }
+#ifdef WINDOWS_PLATFORM
+  freeaddrinfo(addresses);
+#else
+  resolver_release(&pool->resolver, lookup);
+#endif
+  return sock;
+}
+
+/**
+ * Checks whether an idle connection can still be written to. A healthy idle
+ * HTTP connection has nothing to read: if `select` reports it readable, the
+ * peer has either closed it (recv returns 0), reset it (recv fails) or sent
+ * bytes we never asked for. In all three cases the socket must not be reused.
+ *
+ * @returns: 1 if the socket looks alive, 0 otherwise
+ */
+static int connection_alive(int sock) {
+  fd_set read_fds;
+  struct timeval tv = {0, 0}; // poll, do not wait
+
+  FD_ZERO(&read_fds);
+  FD_SET(sock, &read_fds);
+
+  int ready = select(sock + 1, &read_fds, NULL, NULL, &tv);
+  if (ready == 0) {
+    return 1; // nothing pending, still connected
+  }
+  return 0; // readable (EOF, RST or stray data) or select() failed
+}
+
+/**
+ * Closes the socket held by a slot and marks the slot free.
+ */
+static void drop_slot(struct pooled_conn* conn) {
+  close_socket(conn->sock);
+  conn->sock = -1;
+  conn->in_use = 0;
+  conn->host[0] = '\0';
+  conn->requests = 0;
+}
+
+int conn_pool_init(struct conn_pool* pool, int max_connections, int idle_timeout,
+                   const char* hosts_file) {
+  pool->conns = calloc(max_connections, sizeof(struct pooled_conn));
+  if (pool->conns == NULL) {
+    perror("Connection pool allocation failed");
+    return -1;
+  }
+#ifndef WINDOWS_PLATFORM
+  if (resolver_init(&pool->resolver, 1, 0, hosts_file) < 0) {
+    fprintf(stderr, "Failed to start the resolver\n");
+    free(pool->conns);
+    return -1;
+  }
+#else
+  (void)hosts_file;
+#endif
+  for (int i = 0; i < max_connections; i++) {
+    pool->conns[i].sock = -1;
+  }
+  pool->capacity = max_connections;
+  pool->idle_timeout = idle_timeout;
+  pool->timings = NULL;
+  return 0;
+}
+
+int conn_pool_acquire(struct conn_pool* pool, const char* host, int port, int* reused) {
+  time_t now = time(NULL);
+  struct pooled_conn* free_slot = NULL; // first empty slot
+  struct pooled_conn* lru_slot = NULL;  // oldest idle slot (eviction victim)
+
+  *reused = 0;
+
+  for (int i = 0; i < pool->capacity; i++) {
+    struct pooled_conn* conn = &pool->conns[i];
+
+    if (conn->sock >= 0 && !conn->in_use) {
+      // Expired or half-closed sockets are dropped before anybody sees them
+      if (now - conn->last_used > pool->idle_timeout || !connection_alive(conn->sock)) {
+        drop_slot(conn);
+      } else if (conn->port == port && strcmp(conn->host, host) == 0) {
+        conn->in_use = 1;
+        conn->requests++;
+        *reused = 1;
+        return conn->sock;
+      } else if (lru_slot == NULL || conn->last_used < lru_slot->last_used) {
+        lru_slot = conn;
+      }
+    }
+
+    if (conn->sock < 0 && free_slot == NULL) {
+      free_slot = conn;
+    }
+  }
+
+  // No idle connection for this key: make room if the pool is full
+  if (free_slot == NULL) {
+    if (lru_slot == NULL) {
+      fprintf(stderr, "Connection pool exhausted (%d connections in use)\n", pool->capacity);
+      return -1;
+    }
+    drop_slot(lru_slot);
+    free_slot = lru_slot;
+  }
+
+  if (strlen(host) >= POOL_HOST_MAX) {
+    fprintf(stderr, "Host name too long for the connection pool: %s\n", host);
+    return -1;
+  }
+
+  int sock = open_connection(pool, host, port);
+  if (sock < 0) {
+    return -1;
+  }
+
+  strcpy(free_slot->host, host);
+  free_slot->port = port;
+  free_slot->sock = sock;
+  free_slot->in_use = 1;
+  free_slot->requests = 1;
+  return sock;
+}
+
+void conn_pool_release(struct conn_pool* pool, int sock, int keep_alive) {
+  for (int i = 0; i < pool->capacity; i++) {
+    struct pooled_conn* conn = &pool->conns[i];
+    if (conn->sock == sock && conn->in_use) {
+      if (keep_alive) {
+        conn->in_use = 0;
+        conn->last_used = time(NULL);
+      } else {
+        drop_slot(conn);
+      }
+      return;
+    }
+  }
+  // Not a pooled socket (should not happen), do not leak it
+  close_socket(sock);
+}
+
+void conn_pool_destroy(struct conn_pool* pool) {
+  for (int i = 0; i < pool->capacity; i++) {
+    if (pool->conns[i].sock >= 0) {
+      drop_slot(&pool->conns[i]);
+    }
+  }
+  free(pool->conns);
+  pool->conns = NULL;
+  pool->capacity = 0;
+#ifndef WINDOWS_PLATFORM
+  resolver_destroy(&pool->resolver);
+#endif
+}
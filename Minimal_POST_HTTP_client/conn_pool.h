@@ -0,0 +1,91 @@
+/**
+ * A small pool of persistent (keep-alive) HTTP/1.1 connections, keyed by the
+ * host and port they were opened to. Instead of paying for a DNS lookup, a TCP
+ * handshake and a TIME_WAIT socket per request, callers borrow a connection,
+ * send as many requests over it as the server allows and hand it back. Host
+ * names are resolved by a resolver thread and cached for their DNS TTL (on
+ * Windows, `getaddrinfo` is called directly). A server on the same machine can
+ * also be reached through a Unix domain socket, which skips the TCP/IP stack.
+ * @author: Michal Spano
+ */
+#ifndef CONN_POOL_H
+#define CONN_POOL_H
+
+#include <time.h>
+#include "platform.h"
+#include "latency.h"
+#ifndef WINDOWS_PLATFORM
+  #include "resolver.h"
+#endif
+
+#define POOL_HOST_MAX 256  // longest host name kept as a pool key
+#define POOL_DNS_TIMEOUT 30 // seconds to wait for a host name to resolve
+
+/**
+ * One slot of the pool. A slot with `sock == -1` is free.
+ */
+struct pooled_conn {
+  char host[POOL_HOST_MAX]; // key: host name the socket is connected to
+  int port;                 // key: port the socket is connected to
+  int sock;                 // socket descriptor, -1 if the slot is free
+  int in_use;               // borrowed by a caller right now?
+  time_t last_used;         // when the connection was last handed back
+  unsigned long requests;   // number of requests served (for statistics)
+};
+
+struct conn_pool {
+  struct pooled_conn* conns; // fixed array of `capacity` slots
+  int capacity;              // maximum number of open sockets
+  int idle_timeout;          // seconds an idle socket may be kept around
+  struct http_timings* timings; // records DNS and connect times, if not NULL
+#ifndef WINDOWS_PLATFORM
+  struct resolver resolver;  // resolves and caches host names
+#endif
+};
+
+/**
+ * Initializes an empty pool.
+ *
+ * @param pool:            the pool to initialize
+ * @param max_connections: upper bound on open sockets (in use + idle)
+ * @param idle_timeout:    idle sockets older than this (seconds) are closed
+ * @param hosts_file:      hosts-style file consulted before DNS (for tests),
+ *                         or NULL
+ *
+ * @returns: 0 on success, -1 if memory could not be allocated or the
+ *           resolver could not be started
+ */
+int conn_pool_init(struct conn_pool* pool, int max_connections, int idle_timeout,
+                   const char* hosts_file);
+
+/**
+ * Borrows a connection to `host:port`. An idle socket with the same key is
+ * reused if it is still alive; otherwise a new connection is opened. When the
+ * pool is full, the least recently used idle socket is evicted.
+ *
+ * @param pool:   the pool to borrow from
+ * @param host:   the desired host address, or with port 0 the path of a Unix
+ *                domain socket (not on Windows)
+ * @param port:   the desired port, 0 for a Unix domain socket
+ * @param reused: set to 1 if an existing connection was handed out, else 0
+ *
+ * @returns: the socket, or -1 (with a message on stderr) on failure
+ */
+int conn_pool_acquire(struct conn_pool* pool, const char* host, int port, int* reused);
+
+/**
+ * Hands a borrowed connection back to the pool.
+ *
+ * @param pool:       the pool the socket was borrowed from
+ * @param sock:       the socket returned by `conn_pool_acquire`
+ * @param keep_alive: 1 if the socket may serve further requests, 0 if it must
+ *                    be closed (e.g. `Connection: close`, protocol error)
+ */
+void conn_pool_release(struct conn_pool* pool, int sock, int keep_alive);
+
+/**
+ * Closes every socket and frees the pool's memory.
+ */
+void conn_pool_destroy(struct conn_pool* pool);
+
+#endif // CONN_POOL_H
@@ -6,52 +6,276 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include "config.h" /* custom config */
-
-// Detect most common Unix-like system
-#if (defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__)))
-  #include <sys/socket.h>
-  #include <netdb.h>   /* socket, inet */
-  #include <unistd.h>  /* close()      */
-#elif defined(_WIN32) || defined(WIN32) // Windows
-  #include <winsock2.h>
-  #pragma comment(lib,"ws2_32.lib") // needed for linking
-  #define WINDOWS_PLATFORM          // my custom macro (preserves logic directives)
-#else
-  #error "Unknown platform: This cody only suport Unix-like or Windows systems."
-#endif
-// Further reading:
-// https://stackoverflow.com/a/26225829
-// https://handsonnetworkprogramming.com/articles/differences-windows-winsock-linux-unix-bsd-sockets-compatibility
+#include "config.h"      /* custom config      */
+#include "platform.h"    /* sockets, close()   */
+#include "conn_pool.h"   /* keep-alive sockets */
+#include "http_parser.h" /* response framing   */
+#include "http_sink.h"   /* response bodies    */
+#include "send_request.h" /* writev, sendfile */
+#include "latency.h"     /* phase histograms   */
+#include "http_template.h" /* pre-built heads  */
+#include "http_ndjson.h" /* streamed records   */
+#include "retry.h"       /* backoff, budget    */
+#include "http_batch.h"  /* coalesced records  */
 
 #define BUFF_MAX 10240 // = 10KiB (~10kB)
 
 /**
- * A helper function that formats a POST HTTP request (version 1.1).
+ * Reads exactly one HTTP response from a (possibly reused) connection. The
+ * parser finds the end of the body from `Content-Length` or the chunked
+ * encoding, so the socket stays open for the next request. The body is
+ * handed to `sink` as it arrives instead of being accumulated here.
+ *
+ * @param sock:       the connected socket
+ * @param sink:       receives the body (memory, file, ...)
+ * @param keep_alive: set to 1 if the connection may be reused afterwards
+ * @param first_byte: set to the time the first response byte arrived (see
+ *                    latency_now_ns), left alone if nothing arrived
+ * @param status_code: set to the HTTP status of the response
+ *
+ * @returns: 1 on success, 0 if the peer closed before sending a single byte
+ *           (a stale keep-alive socket, safe to retry), -1 on error
+ */
+static int read_response(int sock, struct http_sink* sink, int* keep_alive,
+                         long long* first_byte, int* status_code) {
+  char res_buffer[BUFF_MAX];           // Response buffer for reading from socket
+  struct http_parser parser;           // status line, headers, framing
+  long bytes_received;                 // a long should do for the current BUFF_MAX
+  long total_received = 0;             // incremented per iteration
+
+  *keep_alive = 0;
+
+  http_parser_init(&parser, 0);
+  http_sink_attach(sink, &parser);
+
+  // Continue receiving bytes from the socket until the response is complete
+  while (!http_parser_done(&parser)) {
+    bytes_received = recv(sock, res_buffer, BUFF_MAX, 0);
+    if (bytes_received < 0) {
+      perror("Failed to receive response");
+      return -1;
+    }
+    if (bytes_received == 0) {
+      if (total_received == 0) {
+        return 0; // nothing at all: the server dropped an idle connection
+      }
+      if (http_parser_finish(&parser) < 0) {
+        fprintf(stderr, "Connection closed before the response was complete\n");
+        return -1;
+      }
+      break;
+    }
+    if (total_received == 0) {
+      *first_byte = latency_now_ns();
+    }
+    total_received += bytes_received;
+
+    if (http_parser_feed(&parser, res_buffer, bytes_received) < 0) {
+      fprintf(stderr, "Malformed HTTP response\n");
+      return -1;
+    }
+    if (sink->failed) {
+      perror("Failed to store response body");
+      return -1;
+    }
+  }
+
+  *keep_alive = parser.keep_alive;
+  *status_code = parser.status_code;
+  return 1;
+}
+
+/**
+ * Prints one streamed record as soon as it arrives (see http_ndjson.h).
  *
- * @param host:         the desired host address
- * @param path:         the desired path at the host address
- * @param data:         the contents of the request body
- * @param content_type: the content type (e.g. json, txt, html)
+ * @param ctx:    the FILE* the records go to
+ * @param record: the record, without its newline
+ */
+static void print_record(void* ctx, const char* record, size_t len) {
+  FILE* out = ctx;
+  fwrite(record, 1, len, out);
+  fputc('\n', out);
+  fflush(out); // do not let stdio hold the record back
+}
+
+/**
+ * Sends one request (header block + body) over a pooled connection and reads
+ * its response into `sink`. A reused socket may have been closed by the server
+ * since it was last used; in that case the request is retried once on a fresh
+ * connection. The phases of the request are recorded in `timings`.
+ *
+ * @param records: splits a streamed body into records (the sink feeds it),
+ *                 or NULL
+ * @param status_code: set to the HTTP status of the response
+ *
+ * @returns: 0 on success, -1 on failure
+ */
+static int pooled_post(struct conn_pool* pool, const char* head, size_t head_len,
+                       const struct request_body* body, struct http_sink* sink,
+                       struct http_ndjson* records, struct http_timings* timings,
+                       int* status_code) {
+  for (int attempt = 0; attempt < 2; attempt++) {
+    int reused;
+    // With UNIX_SOCKET the pool connects to that path (port 0) instead
+    int sock = UNIX_SOCKET != NULL ? conn_pool_acquire(pool, UNIX_SOCKET, 0, &reused)
+                                   : conn_pool_acquire(pool, HOST, PORT, &reused);
+    if (sock < 0) {
+      return -1;
+    }
+
+    // Send the request via the socket. Handle the case when sending is refused.
+    long long request_start = latency_now_ns();
+    if (records != NULL) http_ndjson_start(records, timings, request_start);
+    int sent = send_request(sock, head, head_len, body);
+    if (sent < 0) {
+      conn_pool_release(pool, sock, 0);
+      if (reused && sent == -1) continue; // stale socket, try a fresh one
+      perror("Failed to send request");
+      return -1;
+    }
+
+    http_timings_record(timings, HTTP_PHASE_SEND, request_start, latency_now_ns());
+
+    int keep_alive;
+    long long first_byte = 0;
+    int status = read_response(sock, sink, &keep_alive, &first_byte, status_code);
+    conn_pool_release(pool, sock, status > 0 && keep_alive);
+
+    if (status > 0) {
+      if (records != NULL) http_ndjson_finish(records);
+      http_timings_record(timings, HTTP_PHASE_FIRST_BYTE, request_start, first_byte);
+      http_timings_record(timings, HTTP_PHASE_TOTAL, request_start, latency_now_ns());
+      return 0;
+    }
+    if (status < 0 || !reused) {
+      if (status == 0) fprintf(stderr, "Connection closed without a response\n");
+      return -1;
+    }
+    // status == 0 on a reused socket: nothing reached the sink yet, retry
+  }
+  return -1;
+}
+
+/**
+ * What it takes to send a batch of records (see send_batch).
+ */
+struct batch_sender {
+  struct conn_pool* pool;
+  struct http_template* request;    // head of every batched POST
+  struct http_timings* timings;
+  const struct retry_policy* retry;
+  struct retry_budget* budget;
+  unsigned long long* rng;          // state of the backoff's random numbers
+};
+
+/**
+ * Sends one batch of records as a single POST, retried like any other POST:
+ * the body is in memory, so it can always be sent again (see
+ * http_batch_send_cb in http_batch.h).
+ *
+ * @param ctx:      the batch_sender
+ * @param response: collects the body of the answer
+ *
+ * @returns: the HTTP status of the answer, -1 on failure
+ */
+static int send_batch(void* ctx, const char* data, size_t len, size_t items,
+                      struct http_sink* response) {
+  struct batch_sender* sender = ctx;
+  struct request_body body = { data, len, -1, 0, 0 };
+
+  retry_budget_deposit(sender->budget);
+  http_template_set_length(sender->request, len);
+  for (int attempt = 0; ; attempt++) {
+    int status_code = 0;
+    int failed = pooled_post(sender->pool, sender->request->head, sender->request->head_len,
+                             &body, response, NULL, sender->timings, &status_code) < 0;
+    int server_error = !failed && sender->retry->retry_5xx && status_code >= 500 && status_code <= 599;
+
+    if ((!failed && !server_error) || attempt >= sender->retry->max_retries) {
+      return failed ? -1 : status_code;
+    }
+    if (!retry_budget_withdraw(sender->budget)) {
+      fprintf(stderr, "Retry budget exhausted, not retrying\n");
+      return failed ? -1 : status_code;
+    }
+    int delay = retry_backoff_ms(sender->retry, attempt, sender->rng);
+    fprintf(stderr, "Batch of %llu records failed, retrying in %d ms\n",
+            (unsigned long long) items, delay);
+    http_sink_free(response); // a partial answer is not kept
+    http_sink_memory(response, 0);
+    sleep_ms(delay);
+  }
+}
+
+/**
+ * Learns how the batch of one record went (see http_batch_item_cb): keeps its
+ * status and prints the part of the answer that belongs to it, if the server
+ * answered one element per record.
+ *
+ * @param ctx: where the status of the record goes (an int)
+ */
+static void record_done(void* ctx, int status, const char* result, size_t len) {
+  int* record_status = ctx;
+  *record_status = status;
+  if (result != NULL) {
+    printf("Record: %d %.*s\n", status, (int) len, result);
+  }
+}
+
+/**
+ * Sends `record` REQUEST_COUNT times as records of batched POSTs: up to
+ * BATCH_ITEMS records (BATCH_MAX_BYTES bytes) per POST, as a JSON array or as
+ * NDJSON, and no record waits longer than BATCH_LINGER_MS for the others.
  *
- * @returns: formatted string of the request
+ * @returns: 0 if every record was accepted (2xx), -1 otherwise
  */
-char* create_post_req(const char* host,
-                      const char* path,
-                      const char* data,
-                      const char* content_type) {
-
-    char* request = (char*)malloc(BUFF_MAX);
-    snprintf(request, BUFF_MAX,
-        "POST %s HTTP/1.1\r\n"    // add the path on the host
-        "Host: %s\r\n"            // add the host string
-        "Content-Type: %s\r\n"    // type of content
-        "Content-Length: %ld\r\n" // length of the buffer
-        "Connection: close\r\n"
-        "\r\n"                    // separates the body
-        "%s",                     // the body of the request
-        path, host, content_type, strlen(data), data);
-    return request;
+static int post_batched(struct conn_pool* pool, const struct request_body* record,
+                        struct http_timings* timings, const struct retry_policy* retry,
+                        struct retry_budget* budget, unsigned long long* rng) {
+  const char* headers = BATCH_NDJSON ? "Content-Type: application/x-ndjson\r\n"
+                                       "Connection: keep-alive\r\n"
+                                     : "Content-Type: application/json\r\n"
+                                       "Connection: keep-alive\r\n";
+  struct http_template request;
+  if (http_template_init(&request, "POST", PATH, HOST, headers, HTTP_TEMPLATE_LENGTH) < 0) {
+    perror("Failed to format request");
+    return -1;
+  }
+
+  struct batch_sender sender = { pool, &request, timings, retry, budget, rng };
+  struct http_batch batch;
+  int* statuses = malloc(REQUEST_COUNT * sizeof(int));
+  if (statuses == NULL
+      || http_batch_init(&batch, BATCH_NDJSON ? HTTP_BATCH_NDJSON : HTTP_BATCH_JSON_ARRAY,
+                         BATCH_MAX_BYTES, BATCH_ITEMS, BATCH_LINGER_MS, send_batch, &sender) < 0) {
+    perror("Failed to set up batching");
+    free(statuses);
+    http_template_free(&request);
+    return -1;
+  }
+
+  // A record not added (no memory) counts as failed, like one that was refused
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    statuses[i] = -1;
+  }
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    if (http_batch_add(&batch, record->data, record->len, record_done, &statuses[i]) < 0) {
+      perror("Failed to add record to batch");
+      break;
+    }
+  }
+  http_batch_flush(&batch); // whatever is still waiting
+
+  int failed = 0;
+  for (int i = 0; i < REQUEST_COUNT; i++) {
+    if (statuses[i] < 200 || statuses[i] > 299) failed++;
+  }
+  printf("Batched: %llu records in %llu POSTs, %d failed\n", batch.records, batch.batches, failed);
+
+  http_batch_free(&batch);
+  free(statuses);
+  http_template_free(&request);
+  return failed == 0 ? 0 : -1;
 }
 
 int main(void) {
@@ -64,14 +288,18 @@ int main(void) {
    *  "stream": false
    * }
    * ```
+   * With STREAM set, "stream" is true and the server sends one JSON object
+   * per line while it generates the answer.
    **/
-  const char* req_body = "{"
-    "\"model\": \"llama3.2\","
+#define EXAMPLE_BODY "{" \
+    "\"model\": \"llama3.2\"," \
     "\"prompt\": \"Write a program to compute Fibonacci numbers in Python.\","
-    "\"stream\": false"
-  "}";
+  const char* req_body = STREAM ? EXAMPLE_BODY "\"stream\": true}"
+                                : EXAMPLE_BODY "\"stream\": false}";
   
-  const char* content_type = "application/json"; // want to send the above as JSON
+  // Headers of every request: send the above as JSON, keep the connection
+  const char* headers = "Content-Type: application/json\r\n"
+                        "Connection: keep-alive\r\n";
 
   // Required for Windows (Winsock needs to be initialized)
 #ifdef WINDOWS_PLATFORM
@@ -82,130 +310,185 @@ int main(void) {
     }
 #endif
 
-  // Initialize socket with AF_INET which specifies a type (i.e. family)
-  // of the address (i.e. IPv4.)
-  int sock = socket(AF_INET, SOCK_STREAM, 0);
-  if (sock < 0) {
-    perror("Failed to create socket");
-    return 1;
+  // The body is either the example above or, if configured, a file that is
+  // streamed to the socket by the kernel (never copied, never truncated).
+  // Pipes and stdin ("-") have no known size: they are read in blocks and
+  // sent chunked as data arrives, as are files when CHUNKED_UPLOAD is set.
+  struct request_body body = { req_body, strlen(req_body), -1, 0, 0 };
+  FILE* body_file = NULL;
+  if (BODY_FILE != NULL && strcmp(BODY_FILE, "-") == 0) {
+    body.fd = 0; // stdin
+    body.chunked = 1;
+  } else if (BODY_FILE != NULL) {
+    body_file = fopen(BODY_FILE, "rb");
+    if (body_file == NULL) {
+      perror("Failed to open body file");
+      return 1;
+    }
+#ifdef WINDOWS_PLATFORM
+    body.fd = _fileno(body_file);
+#else
+    body.fd = fileno(body_file);
+#endif
+    // Seeking fails on pipes and FIFOs: their size is only known at EOF
+    long size = fseek(body_file, 0, SEEK_END) == 0 ? ftell(body_file) : -1;
+    if (size < 0 || CHUNKED_UPLOAD) {
+      body.chunked = 1;
+    } else {
+      body.len = size;
+    }
   }
 
-  // Initialize server, get by host, check for erors.
-  struct hostent *server = gethostbyname(HOST);
-  if (server == NULL) {
-    fprintf(stderr, "Failed to resolve host: %s\n", HOST);
-    return 2;
+  // Every response body is appended to this file, if one is configured
+  FILE* response_file = NULL;
+  if (RESPONSE_FILE != NULL) {
+    response_file = fopen(RESPONSE_FILE, "wb");
+    if (response_file == NULL) {
+      perror("Failed to open response file");
+      if (body_file != NULL) fclose(body_file);
+      return 1;
+    }
   }
-  
-  // Open an (internet) socket address
-  struct sockaddr_in server_addr;
-  memset(&server_addr, 0, sizeof(server_addr)); // populate with zeros
-  server_addr.sin_family = AF_INET;             // retain IP family (type)
-  server_addr.sin_port = htons(PORT);           // same with port
 
-  memcpy(&server_addr.sin_addr.s_addr, server->h_addr, server->h_length);
+  // Keep-alive sockets, reused by every request sent to HOST:PORT
+  struct conn_pool pool;
+  if (conn_pool_init(&pool, POOL_MAX_CONNECTIONS, POOL_IDLE_TIMEOUT, HOSTS_FILE) < 0) {
+    return 1;
+  }
 
-  // Try to open a socket connection, handle the case if the connection is refused.
-  if (connect(sock, (struct sockaddr*)&server_addr, sizeof(server_addr)) < 0) {
-    perror("Connection failed");
-#ifdef WINDOWS_PLATFORM
-    closesocket(sock);
-    WSACleanup();
-#else
-    close(sock);
-#endif
-    return -1;
+  // How long each phase of the requests took (DNS, connect, send, ...)
+  static struct http_timings timings;
+  http_timings_init(&timings);
+  pool.timings = &timings;
+
+  // Format the headers once, they are identical for every repetition except
+  // for the Content-Length digits, which are patched in place per request.
+  // The body is sent right after the headers from wherever it lives (see
+  // send_request.h), so its size is not limited.
+  struct http_template request;
+  if (http_template_init(&request, "POST", PATH, HOST, headers,
+                         body.chunked ? HTTP_TEMPLATE_CHUNKED : HTTP_TEMPLATE_LENGTH) < 0) {
+    perror("Failed to format request");
+    conn_pool_destroy(&pool);
+    return 1;
   }
-  
-  // Format the request and send it via the socket. Handle the case when
-  // sending is refused.
-  char* request = create_post_req(HOST, PATH, req_body, content_type);
-  if (send(sock, request, strlen(request), 0) < 0) {
-    perror("Failed to send request");
-    free(request);
-#ifdef WINDOWS_PLATFORM
-    closesocket(sock);
-    WSACleanup();
-#else
-    close(sock);
-#endif
-    return -2;
+  int exit_code = 0;
+
+  // A streamed answer is split into records that are printed (or written to
+  // RESPONSE_FILE) one by one as they arrive
+  struct http_ndjson records;
+  http_ndjson_init(&records, print_record,
+                   response_file != NULL ? response_file : stdout, 0);
+
+  // Failed POSTs are sent again after a growing, random backoff, but never
+  // more than RETRY_BUDGET retries per POST sent: a struggling server is not
+  // buried under retries (see retry.h)
+  struct retry_policy retry = { RETRIES, RETRY_BASE_DELAY, RETRY_MAX_DELAY, RETRY_5XX };
+  struct retry_budget budget;
+  unsigned long long rng = (unsigned long long) latency_now_ns() | 1;
+  retry_budget_init(&budget, RETRY_BUDGET, RETRIES);
+
+  // With BATCH_ITEMS the bodies go out as records of batched POSTs instead:
+  // fewer, larger requests, each record delayed by at most BATCH_LINGER_MS.
+  // Only a body in memory can be a record.
+  int batched = BATCH_ITEMS > 0 && body.fd < 0;
+  if (batched && post_batched(&pool, &body, &timings, &retry, &budget, &rng) < 0) {
+    exit_code = -2;
   }
-  
-  free(request); // The POST request buffer can now be safely freed.
-  
-  char res_buffer[BUFF_MAX]; // Response buffer for reading from socket
-  char* res_body = NULL;     // Cumulative buffer to store response body
-  int total_size = 0;        // incremented per iteration
-  int headers_found = 0;     // the stream is continuous, headers passed once!
-  long bytes_received;       // a long should do for the current BUFF_MAX
-
-  // Continue receiving bytes from the socket (response)
-  while ((bytes_received = recv(sock, res_buffer, BUFF_MAX - 1, 0)) > 0) {
-    res_buffer[bytes_received] = '\0'; // Terminate stream
-
-    // Start of response's body (after headers), remove escapes (i.e.
-    // separator).
-    if (!headers_found) {
-      char* body = strstr(res_buffer, "\r\n\r\n");
-      if (body != NULL) {  // ignore if pattern not found
-        headers_found = 1; // update flag
-        body += 4;         // skip "\r\n\r\n" (first 4 chars)
-
-        int body_len = strlen(body);     // Size of current byte junk
-        res_body = malloc(body_len + 1); // Allocate memory; +1 for \0
-        if (res_body == NULL) {          // Ensure that there's enough space
-          perror("Initial memory allocation failed");
+
+  // A stream can only be read once, so it is sent in a single request
+  int request_count = batched ? 0 : body.chunked ? 1 : REQUEST_COUNT;
+  for (int i = 0; i < request_count; i++) {
+    struct http_sink sink;
+    int failed;
+    retry_budget_deposit(&budget);
+    for (int attempt = 0; ; attempt++) {
+      // Responses are either written straight to RESPONSE_FILE (constant
+      // memory, whatever their size) or collected in a buffer and printed
+      if (STREAM) {
+        http_sink_callback(&sink, http_ndjson_feed, &records);
+      } else if (response_file != NULL) {
 #ifdef WINDOWS_PLATFORM
-          closesocket(sock);
-          WSACleanup();
+        http_sink_fd(&sink, _fileno(response_file));
 #else
-          close(sock);
+        http_sink_fd(&sink, fileno(response_file));
 #endif
-          return 3;
-        }
-      
-        memcpy(res_body, body, body_len); // copy context to buffer
-        total_size = body_len;            // Initial size = length of the first junk
-        res_body[total_size] = '\0';      // Terminate current substring in buffer
+      } else {
+        http_sink_memory(&sink, 0);
       }
 
+      int status_code = 0;
+      http_template_set_length(&request, body.len);
+      failed = pooled_post(&pool, request.head, request.head_len, &body, &sink,
+                           STREAM ? &records : NULL, &timings, &status_code) < 0;
+      int server_error = !failed && retry.retry_5xx && status_code >= 500 && status_code <= 599;
+
+      // A streamed upload cannot be read again, and a body already passed on
+      // (to the file or as records) cannot be taken back
+      if ((!failed && !server_error) || attempt >= retry.max_retries || body.chunked
+          || (sink.total > 0 && (STREAM || response_file != NULL))) {
+        break;
+      }
+      if (!retry_budget_withdraw(&budget)) {
+        fprintf(stderr, "Retry budget exhausted, not retrying\n");
+        break;
+      }
+      int delay = retry_backoff_ms(&retry, attempt, &rng);
+      if (server_error) {
+        fprintf(stderr, "Server answered %d, retrying in %d ms\n", status_code, delay);
+      } else {
+        fprintf(stderr, "Request failed, retrying in %d ms\n", delay);
+      }
+      http_sink_free(&sink);
+      sleep_ms(delay);
+    }
+    if (failed) {
+      http_sink_free(&sink);
+      exit_code = -2;
+      break;
+    }
+    if (STREAM) {
+      if (records.failed) {
+        perror("Failed to store streamed record");
+        exit_code = -2;
+        break;
+      }
+      printf("Response: %llu records streamed (%llu bytes)\n", records.records, sink.total);
+    } else if (response_file != NULL) {
+      printf("Response body: %llu bytes written to %s\n", sink.total, RESPONSE_FILE);
     } else {
-      // Further junk(s) of bytes, with no headers now
-      size_t new_size = total_size + bytes_received; // # of newly received bytes
-      char *temp = realloc(res_body, new_size + 1);  // Attempt to realloc extended buffer
-      if (temp == NULL) {                            // Not enough space, free, close socket
-          free(res_body);
-#ifdef WINDOWS_PLATFORM
-          closesocket(sock);
-          WSACleanup();
-#else
-          close(sock);
-#endif
-          perror("Memory reallocation failed");
-          return 3;
+      char* res_body = http_sink_take(&sink, NULL);
+      if (res_body == NULL) {
+        perror("Failed to store response body");
+        exit_code = -2;
+        break;
       }
-
-      res_body = temp; // ok
-      // Copy new bytes to the buffer, shift the pointer
-      memcpy(res_body + total_size, res_buffer, bytes_received);
-      total_size = new_size;       // Udpate size
-      res_body[total_size] = '\0'; // Terminate
+      printf("Response body:\n%s\n", res_body);
+      free(res_body);
     }
   }
-  
-  // Only print the response if sufficient data was collected
-  if (res_body != NULL) {
-    printf("Response body:\n%s\n", res_body);
-    free(res_body);
+
+  printf("\nLatency:\n");
+  http_timings_print_table(&timings, stdout);
+  if (LATENCY_JSON != NULL) {
+    FILE* json = strcmp(LATENCY_JSON, "-") == 0 ? stdout : fopen(LATENCY_JSON, "w");
+    if (json == NULL) {
+      perror("Failed to open latency file");
+    } else {
+      http_timings_print_json(&timings, json);
+      if (json != stdout) fclose(json);
+    }
   }
 
-  // Close socket connection, return 0 (success)
+  http_template_free(&request); // The request head can now be safely freed.
+  http_ndjson_free(&records);
+  if (body_file != NULL) fclose(body_file);
+  if (response_file != NULL) fclose(response_file);
+
+  // Close every pooled connection, return 0 (success)
+  conn_pool_destroy(&pool);
 #ifdef WINDOWS_PLATFORM
-    closesocket(sock);
     WSACleanup();
-#else
-    close(sock);
 #endif
-  return 0;
+  return exit_code;
 }
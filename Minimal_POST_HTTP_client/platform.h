@@ -0,0 +1,58 @@
+/**
+ * Platform glue shared by the client's translation units. Picks the right
+ * socket headers for Unix-like systems or Windows and hides the few calls that
+ * differ between the two (closing a socket, initializing Winsock).
+ * @author: Michal Spano
+ */
+#ifndef PLATFORM_H
+#define PLATFORM_H
+
+// Detect most common Unix-like system
+#if (defined(__unix__) || defined(__unix) || (defined(__APPLE__) && defined(__MACH__)))
+  #include <sys/socket.h>
+  #include <sys/un.h>     /* sockaddr_un  */
+  #include <sys/select.h> /* select()     */
+  #include <netinet/in.h> /* sockaddr_in  */
+  #include <netdb.h>      /* socket, inet */
+  #include <unistd.h>     /* close()      */
+  #include <strings.h>    /* strncasecmp  */
+  #include <time.h>       /* nanosleep()  */
+  #include <errno.h>      /* EINTR        */
+#elif defined(_WIN32) || defined(WIN32) // Windows
+  #include <winsock2.h>
+  #include <ws2tcpip.h>             /* getaddrinfo() */
+  #pragma comment(lib,"ws2_32.lib") // needed for linking
+  #define WINDOWS_PLATFORM          // my custom macro (preserves logic directives)
+  #define strncasecmp _strnicmp     // same semantics, different name
+#else
+  #error "Unknown platform: This cody only suport Unix-like or Windows systems."
+#endif
+// Further reading:
+// https://stackoverflow.com/a/26225829
+// https://handsonnetworkprogramming.com/articles/differences-windows-winsock-linux-unix-bsd-sockets-compatibility
+
+/**
+ * Closes a socket with the call the platform expects (`closesocket` on
+ * Windows, `close` elsewhere).
+ */
+static inline void close_socket(int sock) {
+#ifdef WINDOWS_PLATFORM
+  closesocket(sock);
+#else
+  close(sock);
+#endif
+}
+
+/**
+ * Waits for `ms` milliseconds (`Sleep` on Windows, `nanosleep` elsewhere).
+ */
+static inline void sleep_ms(int ms) {
+#ifdef WINDOWS_PLATFORM
+  Sleep(ms);
+#else
+  struct timespec pause = { ms / 1000, (ms % 1000) * 1000000L };
+  while (nanosleep(&pause, &pause) < 0 && errno == EINTR) {}
+#endif
+}
+
+#endif // PLATFORM_H
@@ -0,0 +1,210 @@
+/**
+ * Scatter/gather request sending, see send_request.h.
+ * @author: Michal Spano
+ */
+#include <stdio.h>
+#include <errno.h>
+#include "platform.h"
+#include "send_request.h"
+
+#ifdef WINDOWS_PLATFORM
+  #include <io.h>       /* _read(), _lseek() */
+#else
+  #include <sys/uio.h>  /* struct iovec      */
+#endif
+#ifdef __linux__
+  #include <sys/sendfile.h>
+#endif
+
+#define FILE_CHUNK 65536 // buffer for platforms without sendfile
+
+/**
+ * Writes all bytes described by an array of buffers, resuming after partial
+ * writes (a send may accept only part of what it was given).
+ *
+ * @param sock:  the connected socket
+ * @param iov:   the buffers (modified while sending)
+ * @param count: number of buffers
+ * @param more:  1 if more data follows right after (lets the kernel coalesce)
+ *
+ * @returns: 0 on success, -1 on failure
+ */
+#ifdef WINDOWS_PLATFORM
+static int send_buffers(int sock, WSABUF* iov, int count, int more) {
+  (void)more;
+  while (count > 0) {
+    DWORD sent;
+    if (WSASend(sock, iov, count, &sent, 0, NULL, NULL) != 0) {
+      return -1;
+    }
+    // Skip the buffers that went out completely, trim the partial one
+    while (count > 0 && sent >= iov->len) {
+      sent -= iov->len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->buf += sent;
+      iov->len -= sent;
+    }
+  }
+  return 0;
+}
+#else
+static int send_buffers(int sock, struct iovec* iov, int count, int more) {
+  struct msghdr msg = {0};
+  int flags = 0;
+
+#ifdef MSG_NOSIGNAL
+  flags |= MSG_NOSIGNAL; // report a closed peer as EPIPE instead of SIGPIPE
+#endif
+#ifdef MSG_MORE
+  if (more) flags |= MSG_MORE;
+#else
+  (void)more;
+#endif
+
+  while (count > 0) {
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+
+    ssize_t sent = sendmsg(sock, &msg, flags);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    // Skip the buffers that went out completely, trim the partial one
+    while (count > 0 && (size_t)sent >= iov->iov_len) {
+      sent -= iov->iov_len;
+      iov++;
+      count--;
+    }
+    if (count > 0) {
+      iov->iov_base = (char*)iov->iov_base + sent;
+      iov->iov_len -= sent;
+    }
+  }
+  return 0;
+}
+#endif
+
+/**
+ * Sends `len` bytes of a file, starting at `offset`, without reading them
+ * into user space where the kernel allows it (Linux `sendfile`). Other
+ * platforms fall back to reading the file in blocks.
+ *
+ * @returns: 0 on success, -1 on failure (including a file shorter than `len`)
+ */
+static int send_file(int sock, int fd, long offset, size_t len) {
+#ifdef __linux__
+  off_t off = offset;
+  while (len > 0) {
+    ssize_t sent = sendfile(sock, fd, &off, len);
+    if (sent < 0) {
+      if (errno == EINTR) continue;
+      return -1;
+    }
+    if (sent == 0) { // file shrank since its size was taken
+      errno = EIO;
+      return -1;
+    }
+    len -= sent;
+  }
+  return 0;
+#else
+  char buffer[FILE_CHUNK];
+#ifdef WINDOWS_PLATFORM
+  if (_lseek(fd, offset, SEEK_SET) < 0) return -1;
+#else
+  if (lseek(fd, offset, SEEK_SET) < 0) return -1;
+#endif
+  while (len > 0) {
+    size_t want = len < FILE_CHUNK ? len : FILE_CHUNK;
+#ifdef WINDOWS_PLATFORM
+    int got = _read(fd, buffer, (unsigned)want);
+    WSABUF iov = { (ULONG)(got > 0 ? got : 0), buffer };
+#else
+    ssize_t got = read(fd, buffer, want);
+    struct iovec iov = { buffer, got > 0 ? (size_t)got : 0 };
+#endif
+    if (got <= 0) {
+      if (got == 0) errno = EIO; // file shrank since its size was taken
+      return -1;
+    }
+    if (send_buffers(sock, &iov, 1, len > (size_t)got) < 0) return -1;
+    len -= got;
+  }
+  return 0;
+#endif
+}
+
+/**
+ * Reads a stream until EOF and sends every block as one chunk of the chunked
+ * transfer encoding ("<size in hex>\r\n<data>\r\n"), followed by the last,
+ * empty chunk. Reads block until the producer has data, so each chunk leaves
+ * as soon as it is available.
+ *
+ * @returns: 0 on success, -1 on failure
+ */
+static int send_stream(int sock, int fd) {
+  static char buffer[STREAM_BLOCK]; // the only copy of the body ever held
+  char size_line[32];
+
+  for (;;) {
+#ifdef WINDOWS_PLATFORM
+    int got = _read(fd, buffer, STREAM_BLOCK);
+#else
+    ssize_t got = read(fd, buffer, STREAM_BLOCK);
+    if (got < 0 && errno == EINTR) continue;
+#endif
+    if (got < 0) return -1;
+    if (got == 0) break; // EOF
+
+    int size_len = snprintf(size_line, sizeof(size_line), "%lx\r\n", (unsigned long)got);
+#ifdef WINDOWS_PLATFORM
+    WSABUF iov[3] = { { (ULONG)size_len, size_line }, { (ULONG)got, buffer }, { 2, "\r\n" } };
+#else
+    struct iovec iov[3] = { { size_line, size_len }, { buffer, got }, { "\r\n", 2 } };
+#endif
+    if (send_buffers(sock, iov, 3, 1) < 0) return -1;
+  }
+
+#ifdef WINDOWS_PLATFORM
+  WSABUF last = { 5, "0\r\n\r\n" };
+#else
+  struct iovec last = { "0\r\n\r\n", 5 };
+#endif
+  return send_buffers(sock, &last, 1, 0);
+}
+
+int send_request(int sock, const char* head, size_t head_len, const struct request_body* body) {
+  int streamed = body != NULL && body->fd >= 0 && body->chunked;
+  int from_file = body != NULL && body->fd >= 0 && !body->chunked && body->len > 0;
+#ifdef WINDOWS_PLATFORM
+  WSABUF iov[2];
+  iov[0].buf = (char*)head;
+  iov[0].len = (ULONG)head_len;
+  iov[1].buf = body != NULL ? (char*)body->data : NULL;
+  iov[1].len = body != NULL ? (ULONG)body->len : 0;
+#else
+  struct iovec iov[2];
+  iov[0].iov_base = (void*)head;
+  iov[0].iov_len = head_len;
+  iov[1].iov_base = body != NULL ? (void*)body->data : NULL;
+  iov[1].iov_len = body != NULL ? body->len : 0;
+#endif
+
+  // Header and in-memory body leave in one gather write
+  int count = (body != NULL && body->fd < 0 && body->len > 0) ? 2 : 1;
+  if (send_buffers(sock, iov, count, from_file || streamed) < 0) {
+    return -1;
+  }
+
+  if (from_file) {
+    return send_file(sock, body->fd, body->offset, body->len);
+  }
+  if (streamed) {
+    return send_stream(sock, body->fd) < 0 ? -2 : 0;
+  }
+  return 0;
+}
@@ -0,0 +1,45 @@
+/**
+ * Scatter/gather sending of a request: the header block and the body are
+ * written straight from where they live, without first being copied into one
+ * contiguous (and size-limited) buffer. Bodies stored in a file are handed to
+ * the kernel with `sendfile` where the platform supports it. Bodies of unknown
+ * size (a pipe, stdin) are streamed with `Transfer-Encoding: chunked`.
+ * @author: Michal Spano
+ */
+#ifndef SEND_REQUEST_H
+#define SEND_REQUEST_H
+
+#include <stddef.h>
+
+#define STREAM_BLOCK 65536 // bytes read from a streamed body per chunk
+
+/**
+ * The body of a request: either a buffer in memory, (a part of) a file, or a
+ * stream that is read until EOF.
+ */
+struct request_body {
+  const char* data; // body in memory, ignored if `fd` >= 0
+  size_t len;       // number of body bytes (unused for a stream)
+  int fd;           // file holding the body, or -1
+  long offset;      // where the body starts within the file
+  int chunked;      // 1: read `fd` in blocks until EOF, send them as chunks
+};
+
+/**
+ * Sends a request header block followed by its body. Partial writes are
+ * resumed until every byte is out. A chunked body is sent block by block as
+ * it is read, so only one block is ever held in memory and the first bytes
+ * reach the server before the producer of the stream has finished.
+ *
+ * @param sock:     the connected socket
+ * @param head:     the request line and headers, including the empty line
+ * @param head_len: number of bytes in `head`
+ * @param body:     the body (may be NULL for a request without one)
+ *
+ * @returns: 0 on success, -1 on failure (errno / WSAGetLastError() is set),
+ *           -2 on a failure after part of a stream was consumed (the
+ *           request cannot be repeated)
+ */
+int send_request(int sock, const char* head, size_t head_len, const struct request_body* body);
+
+#endif // SEND_REQUEST_H
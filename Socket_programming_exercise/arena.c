@@ -0,0 +1,158 @@
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+
+// Every allocation starts at a multiple of this
+#define ARENA_ALIGNMENT _Alignof(max_align_t)
+
+/**
+ * Rounds a size up to the arena alignment.
+ */
+static size_t align_up(size_t size) {
+    return (size + ARENA_ALIGNMENT - 1) & ~(size_t) (ARENA_ALIGNMENT - 1);
+}
+
+/**
+ * Allocates a block with room for at least `size` bytes.
+ */
+static struct arena_block * new_block(size_t size) {
+    struct arena_block *block;
+
+    if (size < ARENA_BLOCK_SIZE) {
+        size = ARENA_BLOCK_SIZE;
+    }
+
+    block = malloc(sizeof(struct arena_block) + size);
+    if (block == NULL) {
+        printf("Error! Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    block->next = NULL;
+    block->size = size;
+    block->used = 0;
+    return block;
+}
+
+void arena_init(struct arena *arena) {
+    arena->first = NULL;
+    arena->current = NULL;
+    arena->last = NULL;
+    arena->next_free = NULL;
+}
+
+void * arena_alloc(struct arena *arena, size_t size) {
+    // Block the allocation is taken from
+    struct arena_block *block = arena->current;
+
+    size = align_up(size);
+
+    if (block == NULL) {
+        block = new_block(size);
+        arena->first = block;
+    } else {
+        // Move on to the blocks kept from earlier cycles; they are reset as they are reached
+        while (block != NULL && block->used + size > block->size) {
+            block = block->next;
+            if (block != NULL) {
+                block->used = 0;
+            }
+        }
+        // None is large enough: insert a new block after the current one
+        if (block == NULL) {
+            block = new_block(size);
+            block->next = arena->current->next;
+            arena->current->next = block;
+        }
+    }
+
+    arena->current = block;
+    arena->last = block->data + block->used;
+    block->used += size;
+    return arena->last;
+}
+
+void * arena_grow(struct arena *arena, void *ptr, size_t old_size, size_t new_size) {
+    // The new allocation, if the old one cannot be extended
+    void *copy;
+
+    if (ptr != NULL && ptr == arena->last) {
+        struct arena_block *block = arena->current;
+        size_t start = arena->last - block->data;
+
+        if (start + align_up(new_size) <= block->size) {
+            block->used = start + align_up(new_size);
+            return ptr;
+        }
+    }
+
+    copy = arena_alloc(arena, new_size);
+    if (ptr != NULL) {
+        memcpy(copy, ptr, old_size < new_size ? old_size : new_size);
+    }
+    return copy;
+}
+
+char * arena_strdup(struct arena *arena, const char *string) {
+    size_t size = strlen(string) + 1;
+
+    return memcpy(arena_alloc(arena, size), string, size);
+}
+
+void arena_reset(struct arena *arena) {
+    // Later blocks are reset lazily, when arena_alloc() reaches them
+    arena->current = arena->first;
+    if (arena->first != NULL) {
+        arena->first->used = 0;
+    }
+    arena->last = NULL;
+}
+
+void arena_destroy(struct arena *arena) {
+    struct arena_block *block = arena->first;
+
+    while (block != NULL) {
+        struct arena_block *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena_init(arena);
+}
+
+void arena_pool_init(struct arena_pool *pool) {
+    pool->free = NULL;
+}
+
+struct arena * arena_pool_get(struct arena_pool *pool) {
+    struct arena *arena = pool->free;
+
+    if (arena != NULL) {
+        pool->free = arena->next_free;
+        arena->next_free = NULL;
+        return arena;
+    }
+
+    arena = malloc(sizeof(struct arena));
+    if (arena == NULL) {
+        printf("Error! Memory allocation failed");
+        exit(EXIT_FAILURE);
+    }
+    arena_init(arena);
+    return arena;
+}
+
+void arena_pool_put(struct arena_pool *pool, struct arena *arena) {
+    arena_reset(arena);
+    arena->next_free = pool->free;
+    pool->free = arena;
+}
+
+void arena_pool_destroy(struct arena_pool *pool) {
+    while (pool->free != NULL) {
+        struct arena *arena = pool->free;
+        pool->free = arena->next_free;
+        arena_destroy(arena);
+        free(arena);
+    }
+}
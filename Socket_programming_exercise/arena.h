@@ -0,0 +1,103 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// Size of the blocks an arena allocates from (larger allocations get a block of their own)
+#define ARENA_BLOCK_SIZE 4096
+
+/**
+ * A block of memory that an arena hands out front to back.
+ */
+struct arena_block {
+    struct arena_block *next;   // Next block of the arena
+    size_t size;                // Usable bytes in `data`
+    size_t used;                // Bytes handed out in the current cycle
+    char data[];
+};
+
+/**
+ * Bump allocator that owns all memory of one request/response cycle.
+ *
+ * An allocation only moves a pointer forward in the current block; nothing is freed one by one.
+ * arena_reset() releases everything in O(1) and keeps the blocks for the next cycle, so a
+ * program that resets its arenas stops calling malloc() once the blocks are large enough.
+ */
+struct arena {
+    struct arena_block *first;  // First block, where a reset arena starts again
+    struct arena_block *current;// Block allocations are taken from
+    char *last;                 // Most recent allocation, which arena_grow() can extend in place
+    struct arena *next_free;    // Next arena in the free list of an arena_pool
+};
+
+/**
+ * A free list of arenas, so every cycle can take a warm arena instead of a new one. A pool is not
+ * thread safe: every thread uses its own.
+ */
+struct arena_pool {
+    struct arena *free;         // Arenas waiting to be reused
+};
+
+/**
+ * Creates an empty arena. No memory is allocated until the first arena_alloc().
+ */
+void arena_init(struct arena *arena);
+
+/**
+ * Allocates `size` bytes, aligned for any type.
+ *
+ * @note If memory allocation fails, the program will exit with an error message.
+ */
+void * arena_alloc(struct arena *arena, size_t size);
+
+/**
+ * Resizes the most recent allocation, in place if there is room in its block, otherwise by
+ * copying it to a new allocation. Any other allocation is copied.
+ *
+ * @param arena The arena `ptr` was allocated from.
+ * @param ptr The allocation to resize, or NULL.
+ * @param old_size The current size of the allocation.
+ * @param new_size The size wanted.
+ *
+ * @return The (possibly moved) allocation.
+ */
+void * arena_grow(struct arena *arena, void *ptr, size_t old_size, size_t new_size);
+
+/**
+ * Copies a null-terminated string into the arena.
+ */
+char * arena_strdup(struct arena *arena, const char *string);
+
+/**
+ * Releases every allocation of the arena at once. The blocks are kept for reuse.
+ */
+void arena_reset(struct arena *arena);
+
+/**
+ * Frees the blocks of the arena.
+ */
+void arena_destroy(struct arena *arena);
+
+/**
+ * Creates an empty pool.
+ */
+void arena_pool_init(struct arena_pool *pool);
+
+/**
+ * Takes an arena from the pool, or creates one if the pool is empty.
+ *
+ * @note If memory allocation fails, the program will exit with an error message.
+ */
+struct arena * arena_pool_get(struct arena_pool *pool);
+
+/**
+ * Resets an arena and returns it to the pool.
+ */
+void arena_pool_put(struct arena_pool *pool, struct arena *arena);
+
+/**
+ * Frees the pool and every arena in it.
+ */
+void arena_pool_destroy(struct arena_pool *pool);
+
+#endif // ARENA_H
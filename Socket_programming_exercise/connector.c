@@ -0,0 +1,224 @@
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "connector.h"
+
+/**
+ * @return The monotonic clock in milliseconds.
+ */
+static long long now_ms(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
+/**
+ * Copies an address and fills in the port, for IPv4 and IPv6 alike.
+ */
+static socklen_t address_with_port(const struct addrinfo *info, int port, struct sockaddr_storage *address) {
+    memset(address, 0, sizeof(*address));
+    memcpy(address, info->ai_addr, info->ai_addrlen);
+    if (address->ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) address)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in *) address)->sin_port = htons(port);
+    }
+    return info->ai_addrlen;
+}
+
+/**
+ * Orders the addresses for the race: the family of the first address goes first, then the
+ * families alternate (RFC 8305, section 4), each keeping the order of the list.
+ *
+ * @return The number of addresses written to `order`.
+ */
+static int interleave(const struct addrinfo *addresses, const struct addrinfo **order, int count) {
+    // Family tried first, and the next address of each group
+    int first_family = addresses->ai_family;
+    const struct addrinfo *preferred = addresses;
+    const struct addrinfo *other = addresses;
+    int n = 0;
+
+    while (n < count) {
+        while (preferred != NULL && preferred->ai_family != first_family) {
+            preferred = preferred->ai_next;
+        }
+        while (other != NULL && other->ai_family == first_family) {
+            other = other->ai_next;
+        }
+        if (preferred == NULL && other == NULL) {
+            break;
+        }
+        if (preferred != NULL) {
+            order[n++] = preferred;
+            preferred = preferred->ai_next;
+        }
+        if (other != NULL && n < count) {
+            order[n++] = other;
+            other = other->ai_next;
+        }
+    }
+    return n;
+}
+
+/**
+ * Starts a non-blocking connect to one address.
+ *
+ * @return The connecting socket, or -1 if the attempt failed straight away (errno is set).
+ */
+static int start_attempt(const struct addrinfo *info, int port) {
+    struct sockaddr_storage address;
+    socklen_t address_len = address_with_port(info, port, &address);
+    int sockfd = socket(info->ai_family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+    if (sockfd < 0) {
+        return -1;
+    }
+    if (connect(sockfd, (struct sockaddr *) &address, address_len) < 0 && errno != EINPROGRESS) {
+        int error = errno;
+        close(sockfd);
+        errno = error;
+        return -1;
+    }
+    return sockfd;
+}
+
+int happy_eyeballs_connect(const struct addrinfo *addresses, int port, int timeout_ms,
+                           const struct addrinfo **winner) {
+    const struct addrinfo *info;
+    const struct addrinfo **order;
+    struct pollfd *attempts;
+    int count = 0;
+    int started = 0;
+    int pending = 0;
+    int won = -1;
+    int last_error = ETIMEDOUT;
+    long long deadline = now_ms() + timeout_ms;
+    long long next_start = 0;
+    int i;
+
+    for (info = addresses; info != NULL; info = info->ai_next) {
+        count++;
+    }
+    if (count == 0) {
+        errno = EHOSTUNREACH;
+        return -1;
+    }
+
+    order = malloc(count * sizeof(*order));
+    attempts = malloc(count * sizeof(*attempts));
+    if (order == NULL || attempts == NULL) {
+        free(order);
+        free(attempts);
+        errno = ENOMEM;
+        return -1;
+    }
+    count = interleave(addresses, order, count);
+
+    while (won < 0) {
+        long long now = now_ms();
+        long long wait;
+        int ready;
+
+        // Start the next attempt when the delay is over, or right away if nothing is pending
+        if (started < count && (pending == 0 || now >= next_start)) {
+            attempts[started].fd = start_attempt(order[started], port);
+            attempts[started].events = POLLOUT;
+            attempts[started].revents = 0;
+            if (attempts[started].fd >= 0) {
+                pending++;
+                next_start = now + CONNECT_ATTEMPT_DELAY_MS;
+            } else {
+                last_error = errno;
+            }
+            started++;
+            continue;
+        }
+
+        if (pending == 0) {
+            break;  // every address failed
+        }
+        if (now >= deadline) {
+            last_error = ETIMEDOUT;
+            break;
+        }
+
+        // Wait for an attempt to finish, until the next one is due at the latest
+        wait = deadline - now;
+        if (started < count && next_start - now < wait) {
+            wait = next_start - now;
+        }
+        ready = poll(attempts, started, (int) wait);
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            last_error = errno;
+            break;
+        }
+
+        for (i = 0; i < started && ready > 0; i++) {
+            int so_error = 0;
+            socklen_t len = sizeof(so_error);
+
+            if (attempts[i].fd < 0 || attempts[i].revents == 0) {
+                continue;
+            }
+            ready--;
+
+            // Writable means the connect() finished, successfully or not
+            getsockopt(attempts[i].fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+            if (so_error == 0) {
+                won = i;
+                break;
+            }
+            close(attempts[i].fd);
+            attempts[i].fd = -1;
+            pending--;
+            last_error = so_error;
+            next_start = now;  // a failure starts the next attempt without delay
+        }
+    }
+
+    // Keep the winner, close the attempts that lost the race
+    for (i = 0; i < started; i++) {
+        if (i != won && attempts[i].fd >= 0) {
+            close(attempts[i].fd);
+        }
+    }
+    if (won >= 0) {
+        if (winner != NULL) {
+            *winner = order[won];
+        }
+        won = attempts[won].fd;
+    } else {
+        errno = last_error;
+    }
+
+    free(order);
+    free(attempts);
+    return won;
+}
+
+char * format_address(const struct sockaddr *address, char *buffer, size_t size) {
+    char ip[INET6_ADDRSTRLEN];
+
+    if (address->sa_family == AF_INET6) {
+        const struct sockaddr_in6 *ipv6 = (const struct sockaddr_in6 *) address;
+        inet_ntop(AF_INET6, &ipv6->sin6_addr, ip, sizeof(ip));
+        snprintf(buffer, size, "[%s]:%d", ip, ntohs(ipv6->sin6_port));
+    } else {
+        const struct sockaddr_in *ipv4 = (const struct sockaddr_in *) address;
+        inet_ntop(AF_INET, &ipv4->sin_addr, ip, sizeof(ip));
+        snprintf(buffer, size, "%s:%d", ip, ntohs(ipv4->sin_port));
+    }
+    return buffer;
+}
@@ -0,0 +1,43 @@
+#ifndef CONNECTOR_H
+#define CONNECTOR_H
+
+#include <stddef.h>
+#include <sys/socket.h>
+#include <netdb.h>
+
+// Delay before the next address is tried while earlier attempts are still pending (RFC 8305
+// recommends 250 ms)
+#define CONNECT_ATTEMPT_DELAY_MS 250
+
+/**
+ * Connects to a server that has several addresses ("Happy Eyeballs", RFC 8305).
+ *
+ * The addresses are tried in the order of the list, with IPv6 and IPv4 interleaved. Instead of
+ * waiting for one attempt to time out before the next one starts, a new attempt is started every
+ * CONNECT_ATTEMPT_DELAY_MS (or as soon as an attempt fails), and the first connection that is
+ * established wins; the others are closed. An address family that is broken, or a dead address,
+ * therefore only costs the attempt delay instead of the whole timeout.
+ *
+ * @param addresses The resolved addresses of the server (e.g. from getaddrinfo()).
+ * @param port The port to connect to.
+ * @param timeout_ms How long to try in total.
+ * @param winner Set to the address the connection was established to (may be NULL).
+ *
+ * @return The connected, non-blocking socket, or -1 if no address could be reached (errno is
+ *         set, ETIMEDOUT if the timeout expired).
+ */
+int happy_eyeballs_connect(const struct addrinfo *addresses, int port, int timeout_ms,
+                           const struct addrinfo **winner);
+
+/**
+ * Formats an address as "192.0.2.1:80" or "[2001:db8::1]:80".
+ *
+ * @param address The address, with its port.
+ * @param buffer Receives the formatted address.
+ * @param size The size of `buffer`.
+ *
+ * @return `buffer`.
+ */
+char * format_address(const struct sockaddr *address, char *buffer, size_t size);
+
+#endif // CONNECTOR_H
@@ -0,0 +1,1541 @@
+// Include libraries
+#define _GNU_SOURCE  // pthread_setaffinity_np
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <sched.h>
+#include "http_parser.h"
+#include "wsdeque.h"
+#include "timer_wheel.h"
+#include "retry.h"
+#include "uring.h"
+#include "loadgen.h"
+
+// Definition section
+#define RECV_BUFFER_SIZE 65536
+#define MAX_EVENTS 256
+#define WORK_BATCH 32  // Requests handed out per work item
+#define TIMER_EVENT 0xffffffffu  // epoll data of the schedule timer (not a connection index)
+#define HEDGE_MIN_SAMPLES 64  // Responses measured before the hedging threshold is first set
+#define HEDGE_REFRESH 256     // Responses between updates of the hedging threshold
+#define RETRY_BUDGET_RESERVE 10  // Retries the budget allows before any request was sent
+#define URING_MAX_ENTRIES 4096     // Largest submission queue of the io_uring backend
+#define URING_BUFFER_SIZE 16384    // Size of a provided receive buffer
+#define URING_MAX_BUFFERS 4096     // Most provided receive buffers per worker
+
+// Operations of the io_uring backend, stored in the completion's user data
+#define OP_CONNECT 1
+#define OP_SEND 2
+#define OP_RECV 3
+
+// Timers of a connection besides its deadlines (the timer kind, after the loadgen_deadline values)
+#define TIMER_HEDGE DEADLINE_COUNT          // Duplicate the oldest request on another connection
+#define TIMER_RECONNECT (DEADLINE_COUNT + 1)// Connect again after a failed connect
+#define CONN_TIMERS (DEADLINE_COUNT + 2)    // Timers per connection
+#define TIMER_RETRY CONN_TIMERS             // Send a failed request again (owner: the retry slot)
+
+// Lifecycle of one benchmark connection
+enum conn_state {
+    CONN_CONNECTING,  // Non-blocking connect() in progress
+    CONN_OPEN,        // Connected, carrying requests or waiting for the next one
+    CONN_BACKOFF,     // Connect failed, waiting to try again
+    CONN_DEAD         // Could not connect, not used any more
+};
+
+// A request handed to a connection that has not been answered yet
+struct pipelined_request {
+    const struct http_request *request;// The request
+    long long request_start;    // When it was first handed to a connection (latency_now_ns)
+    long long intended_start;   // When the schedule said it was due (open loop)
+    long long attempt_start;    // When this attempt was handed to the connection
+    long long first_byte;       // When its first response byte arrived, 0 until then
+    int retries;                // Attempts made before this one
+    int hedge;                  // Is this the duplicate of a slow request?
+    int orphaned;               // Did its twin win the race? Its response is then thrown away
+    struct pipelined_request *twin;// The other copy of a hedged request while both are unanswered
+};
+
+// A failed request waiting for its backoff to pass
+struct retry_slot {
+    struct pipelined_request entry;// The request, sent again when the timer fires
+    struct timer timer;         // Expires at the end of the backoff
+    int next_free;              // Next unused slot, -1 at the end of the list
+};
+
+// State of one benchmark connection
+struct connection {
+    int fd;                     // Socket file descriptor, -1 if closed
+    enum conn_state state;      // Where the connection is in its lifecycle
+    int ever_connected;         // Did a connect() on this slot ever succeed?
+    int connect_failures;       // Connects that failed in a row
+    long long connect_start;    // When connect() was called
+    struct pipelined_request *queue;// Ring of the unanswered requests, in the order they were sent
+    int head;                   // Oldest unanswered request in `queue`
+    int queued;                 // Number of unanswered requests
+    int sent;                   // ... of which are written completely
+    size_t written;             // Bytes written of the request after those
+    int ready;                  // On the stack of connections that can take another request?
+    struct http_parser parser;  // Frames the response to the oldest request
+    unsigned generation;        // Bumped when the socket is closed, tells stale completions apart
+    int sending;                // io_uring: a send of the unsent requests is in flight
+    int receiving;              // io_uring: a receive is armed
+    struct msghdr message;      // io_uring: the send in flight
+    struct iovec *iov;          // io_uring: head and body of every request the send covers
+    struct timer timers[CONN_TIMERS];// Deadlines of the connection and its oldest request, hedge
+                                // and reconnect timers
+};
+
+// State of one worker thread and its event loop
+struct loadgen {
+    const struct loadgen_options *options;
+    struct loadgen_stats *stats;
+    struct sockaddr_storage address;  // Server address including the port
+    socklen_t address_len;
+    int epoll_fd;
+    int connections;                  // Connections owned by this worker
+    int in_flight;                    // This worker's share of the requests in flight
+    int depth;                        // Requests a connection may carry at once (pipelining)
+    struct connection *conns;
+    struct pipelined_request *queues; // Storage of the connections' queues
+    int *ready;                       // Stack of connections that can take another request
+    int ready_count;
+    int outstanding;                  // Requests sent but not yet answered
+    int dead;                         // Connections that gave up
+    int id;                           // Index of the worker
+    int worker_count;                 // Number of workers
+    struct wsdeque *deques;           // Work items of all workers, indexed by worker id
+    long next_seq;                    // Next request of the current work item
+    long batch_end;                   // End of the current work item
+    long seq;                         // Sequence number of the request claimed last
+    long claimed;                     // Requests claimed by this worker
+    int out_of_work;                  // No work item left anywhere
+    double start;                     // Start of the run (shared by all workers)
+    int timer_fd;                     // Wakes the event loop when the next request is due
+    long long interval;               // Nanoseconds between this worker's requests (open loop)
+    long long next_send;              // When the next request is due, 0 before the schedule starts
+    struct timer_wheel wheel;         // Timers of the connections and retries, one tick per millisecond
+    struct retry_budget *budget;      // Retries and hedges allowed (shared by all workers), or NULL
+    struct retry_slot *retry_slots;   // Failed requests waiting for their backoff
+    int free_slot;                    // First unused retry slot, -1 if none
+    int *due;                         // Stack of retry slots whose backoff has passed
+    int due_count;
+    long long hedge_after;            // Nanoseconds after which a request is hedged, 0: not yet
+    unsigned long long rng;           // State of the random backoff (xorshift64*)
+    struct uring uring;               // io_uring instance
+    struct uring *ring;               // &uring with the io_uring backend, NULL with epoll
+    struct iovec *iovs;               // Storage of the connections' iov arrays (io_uring)
+    int multishot;                    // Does the kernel support multishot receives?
+    int result;                       // 0 on success, -1 if the worker failed
+    pthread_t thread;
+};
+
+/**
+ * Returns the current time of the monotonic clock in seconds.
+ */
+static double now_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Starts a deadline of a connection (again), unless it has no limit.
+ *
+ * @param from When the deadline's clock starts (latency_now_ns()).
+ */
+static void set_deadline(struct loadgen *lg, struct connection *conn, enum loadgen_deadline kind,
+                         long long from) {
+    int timeout = lg->options->timeouts[kind];
+
+    if (timeout > 0) {
+        // Round the start up to a whole tick, a deadline must not fire early
+        timer_wheel_add(&lg->wheel, &conn->timers[kind], (from + 999999) / 1000000 + timeout);
+    }
+}
+
+/**
+ * Cancels a deadline of a connection.
+ */
+static void clear_deadline(struct loadgen *lg, struct connection *conn, enum loadgen_deadline kind) {
+    timer_wheel_cancel(&lg->wheel, &conn->timers[kind]);
+}
+
+/**
+ * Tags an io_uring operation with the connection, the operation and the connection's generation,
+ * so a completion that arrives after its socket was closed is recognised as stale.
+ */
+static unsigned long long op_data(int index, int op, unsigned generation) {
+    return (unsigned long long) index << 32 | (unsigned long long) (generation & 0xffffff) << 8 | op;
+}
+
+/**
+ * Closes the socket of a connection. With io_uring it is shut down first: operations in flight
+ * hold on to the socket, shutting it down makes them complete (as stale) right away.
+ */
+static void close_connection(struct loadgen *lg, struct connection *conn) {
+    if (conn->fd < 0) {
+        return;
+    }
+    if (lg->ring != NULL) {
+        shutdown(conn->fd, SHUT_RDWR);
+    }
+    close(conn->fd);
+    conn->fd = -1;
+    conn->generation++;
+    conn->sending = 0;
+    conn->receiving = 0;
+}
+
+/**
+ * Watches a connection for responses and, while some of its requests are not written yet, for
+ * room in the socket buffer. An open connection is always watched for input: a connection
+ * without requests becoming readable was closed by the server.
+ */
+static void watch(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    struct epoll_event event;
+
+    event.events = EPOLLIN | (conn->sent < conn->queued ? EPOLLOUT : 0);
+    event.data.u32 = index;
+    epoll_ctl(lg->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event);
+    lg->stats->syscalls++;
+}
+
+/**
+ * Puts an open connection on the ready stack if it can take another request.
+ */
+static void make_ready(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+
+    if (!conn->ready && conn->state == CONN_OPEN && conn->queued < lg->depth) {
+        conn->ready = 1;
+        lg->ready[lg->ready_count++] = index;
+    }
+}
+
+/**
+ * Takes a connection off the ready stack. The search starts at the top, where dispatch() takes
+ * its connections from.
+ */
+static void remove_ready(struct loadgen *lg, int index) {
+    if (!lg->conns[index].ready) {
+        return;
+    }
+    lg->conns[index].ready = 0;
+    for (int i = lg->ready_count - 1; i >= 0; i--) {
+        if (lg->ready[i] == index) {
+            lg->ready[i] = lg->ready[--lg->ready_count];
+            break;
+        }
+    }
+}
+
+/**
+ * Prepares the parser and the deadlines for the response to the oldest unanswered request.
+ */
+static void expect_response(struct loadgen *lg, struct connection *conn) {
+    if (conn->queued > 0) {
+        struct pipelined_request *entry = &conn->queue[conn->head % lg->depth];
+
+        http_parser_init(&conn->parser, entry->request->head_request);
+        set_deadline(lg, conn, DEADLINE_TOTAL, entry->attempt_start);
+        // Written already (pipelined): its response is next in line from now on
+        if (conn->sent > 0) {
+            set_deadline(lg, conn, DEADLINE_FIRST_BYTE, latency_now_ns());
+        } else {
+            clear_deadline(lg, conn, DEADLINE_FIRST_BYTE);
+        }
+        if (conn->fd >= 0 && conn->state == CONN_OPEN && !timer_pending(&conn->timers[DEADLINE_IDLE])) {
+            set_deadline(lg, conn, DEADLINE_IDLE, latency_now_ns());
+        }
+        // A slow request is duplicated once, and never while its twin is still running
+        if (lg->hedge_after > 0 && !entry->hedge && entry->twin == NULL && !entry->orphaned) {
+            timer_wheel_add(&lg->wheel, &conn->timers[TIMER_HEDGE],
+                            (entry->attempt_start + lg->hedge_after + 999999) / 1000000);
+        } else {
+            timer_wheel_cancel(&lg->wheel, &conn->timers[TIMER_HEDGE]);
+        }
+    } else {
+        clear_deadline(lg, conn, DEADLINE_FIRST_BYTE);
+        clear_deadline(lg, conn, DEADLINE_IDLE);
+        clear_deadline(lg, conn, DEADLINE_TOTAL);
+        timer_wheel_cancel(&lg->wheel, &conn->timers[TIMER_HEDGE]);
+    }
+}
+
+/**
+ * Schedules a failed request to be sent again after a random backoff, if the retry policy, a
+ * free retry slot and the retry budget allow it.
+ *
+ * @return 1 if the request will be sent again, 0 if it has failed for good.
+ */
+static int try_retry(struct loadgen *lg, const struct pipelined_request *entry) {
+    const struct retry_policy *policy = &lg->options->retry;
+    struct retry_slot *slot;
+    int delay;
+
+    if (entry->retries >= policy->max_retries || lg->free_slot < 0) {
+        return 0;
+    }
+    if (!retry_budget_withdraw(lg->budget)) {
+        lg->stats->budget_denied++;
+        return 0;
+    }
+
+    slot = &lg->retry_slots[lg->free_slot];
+    lg->free_slot = slot->next_free;
+    slot->entry = *entry;
+    slot->entry.retries++;
+    slot->entry.hedge = 0;
+    slot->entry.orphaned = 0;
+    slot->entry.twin = NULL;
+    delay = retry_backoff_ms(policy, entry->retries, &lg->rng);
+    timer_wheel_add(&lg->wheel, &slot->timer, latency_now_ns() / 1000000 + delay);
+    lg->stats->retries++;
+    return 1;
+}
+
+/**
+ * Settles a request that got no usable answer. A hedged request whose twin is still running
+ * leaves the race to the twin; otherwise the request is retried or counted as an error. The
+ * caller takes the entry off its connection.
+ */
+static void fail_request(struct loadgen *lg, struct pipelined_request *entry) {
+    if (entry->orphaned) {
+        return;
+    }
+    if (entry->twin != NULL) {
+        entry->twin->twin = NULL;
+        entry->twin = NULL;
+        return;
+    }
+    if (!try_retry(lg, entry)) {
+        lg->outstanding--;
+        lg->stats->errors++;
+    }
+}
+
+/**
+ * Takes the oldest request off a connection.
+ */
+static void pop_request(struct loadgen *lg, struct connection *conn) {
+    conn->head = (conn->head + 1) % lg->depth;
+    conn->queued--;
+}
+
+/**
+ * Starts a non-blocking connect() for a connection slot.
+ *
+ * @return 0 if the connection is established or in progress, -1 on failure.
+ */
+static int open_connection(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    struct epoll_event event;
+
+    conn->connect_start = latency_now_ns();
+    // io_uring waits for blocking sockets itself, without a system call per attempt
+    conn->fd = socket(lg->address.ss_family, SOCK_STREAM | (lg->ring != NULL ? 0 : SOCK_NONBLOCK), 0);
+    if (conn->fd < 0) {
+        printf("Error! Socket creation failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    if (lg->ring != NULL) {
+        struct io_uring_sqe *sqe = uring_get_sqe(lg->ring);
+
+        if (sqe == NULL) {
+            close(conn->fd);
+            conn->fd = -1;
+            return -1;
+        }
+        sqe->opcode = IORING_OP_CONNECT;
+        sqe->fd = conn->fd;
+        sqe->addr = (unsigned long) &lg->address;
+        sqe->off = lg->address_len;
+        sqe->user_data = op_data(index, OP_CONNECT, conn->generation);
+        conn->state = CONN_CONNECTING;
+        set_deadline(lg, conn, DEADLINE_CONNECT, conn->connect_start);
+        return 0;
+    }
+
+    if (connect(conn->fd, (struct sockaddr *) &lg->address, lg->address_len) < 0 && errno != EINPROGRESS) {
+        close(conn->fd);
+        conn->fd = -1;
+        return -1;
+    }
+
+    // Writable means the connect() finished, successfully or not
+    conn->state = CONN_CONNECTING;
+    set_deadline(lg, conn, DEADLINE_CONNECT, conn->connect_start);
+    event.events = EPOLLOUT;
+    event.data.u32 = index;
+    if (epoll_ctl(lg->epoll_fd, EPOLL_CTL_ADD, conn->fd, &event) < 0) {
+        printf("Error! epoll_ctl() failed: %s\n", strerror(errno));
+        close(conn->fd);
+        conn->fd = -1;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * Handles a connect() that failed: it is tried again after a random backoff if the retry policy
+ * and budget allow it, otherwise the connection is given up and its requests fail.
+ */
+static void connect_failed(struct loadgen *lg, int index) {
+    const struct retry_policy *policy = &lg->options->retry;
+    struct connection *conn = &lg->conns[index];
+
+    if (conn->connect_failures < policy->max_retries) {
+        if (retry_budget_withdraw(lg->budget)) {
+            int delay = retry_backoff_ms(policy, conn->connect_failures++, &lg->rng);
+
+            conn->state = CONN_BACKOFF;
+            timer_wheel_add(&lg->wheel, &conn->timers[TIMER_RECONNECT], latency_now_ns() / 1000000 + delay);
+            lg->stats->retries++;
+            return;
+        }
+        lg->stats->budget_denied++;
+    }
+
+    conn->state = CONN_DEAD;
+    lg->dead++;
+    while (conn->queued > 0) {
+        fail_request(lg, &conn->queue[conn->head]);
+        pop_request(lg, conn);
+    }
+    expect_response(lg, conn);
+}
+
+/**
+ * Closes a connection and, unless it never managed to connect, opens it again. Requests that are
+ * still unanswered stay queued and are written again once the new connection is up; if the
+ * connection cannot be opened again, they fail (and may be retried on other connections).
+ */
+static void reopen_connection(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+
+    remove_ready(lg, index);
+    close_connection(lg, conn);
+    for (int kind = 0; kind < CONN_TIMERS; kind++) {
+        timer_wheel_cancel(&lg->wheel, &conn->timers[kind]);
+    }
+    conn->sent = 0;
+    conn->written = 0;
+    expect_response(lg, conn);
+
+    if (conn->ever_connected && open_connection(lg, index) == 0) {
+        lg->stats->reconnects++;
+    } else {
+        connect_failed(lg, index);
+    }
+}
+
+/**
+ * Drops a connection after an error and opens a new one. The requests that were outstanding on
+ * the connection fail (and may be retried).
+ */
+static void reset_connection(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+
+    while (conn->queued > 0) {
+        fail_request(lg, &conn->queue[conn->head]);
+        pop_request(lg, conn);
+    }
+    reopen_connection(lg, index);
+}
+
+/**
+ * Accounts for `bytes` request bytes that left: requests written completely start waiting for
+ * their first response byte.
+ */
+static void requests_sent(struct loadgen *lg, struct connection *conn, size_t bytes) {
+    lg->stats->bytes_sent += bytes;
+    while (bytes > 0) {
+        struct pipelined_request *entry = &conn->queue[(conn->head + conn->sent) % lg->depth];
+        size_t left = entry->request->head_len + entry->request->body_len - conn->written;
+
+        if (bytes < left) {
+            conn->written += bytes;
+            break;
+        }
+        bytes -= left;
+        http_timings_record(&lg->stats->timings, HTTP_PHASE_SEND, entry->attempt_start, latency_now_ns());
+        if (conn->sent == 0) {
+            set_deadline(lg, conn, DEADLINE_FIRST_BYTE, latency_now_ns());
+        }
+        conn->sent++;
+        conn->written = 0;
+    }
+    set_deadline(lg, conn, DEADLINE_IDLE, latency_now_ns());
+}
+
+/**
+ * io_uring: submits one gather send of every queued request that is not written yet, unless a
+ * send is in flight already. A pipeline of requests leaves in a single operation; the rest of a
+ * partial send is submitted when it completes.
+ */
+static void submit_send(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    struct io_uring_sqe *sqe;
+    size_t offset = conn->written;
+    int count = 0;
+
+    if (conn->sending || conn->state != CONN_OPEN || conn->sent == conn->queued) {
+        return;
+    }
+    for (int i = conn->sent; i < conn->queued; i++) {
+        const struct http_request *request = conn->queue[(conn->head + i) % lg->depth].request;
+
+        if (offset < request->head_len) {
+            conn->iov[count].iov_base = request->head + offset;
+            conn->iov[count++].iov_len = request->head_len - offset;
+            offset = 0;
+        } else {
+            offset -= request->head_len;
+        }
+        if (request->body_len > offset) {
+            conn->iov[count].iov_base = request->body + offset;
+            conn->iov[count++].iov_len = request->body_len - offset;
+        }
+        offset = 0;
+    }
+
+    sqe = uring_get_sqe(lg->ring);
+    if (sqe == NULL) {
+        reset_connection(lg, index);
+        return;
+    }
+    memset(&conn->message, 0, sizeof(conn->message));
+    conn->message.msg_iov = conn->iov;
+    conn->message.msg_iovlen = count;
+    sqe->opcode = IORING_OP_SENDMSG;
+    sqe->fd = conn->fd;
+    sqe->addr = (unsigned long) &conn->message;
+    sqe->len = 1;
+    sqe->msg_flags = MSG_NOSIGNAL;
+    sqe->user_data = op_data(index, OP_SEND, conn->generation);
+    conn->sending = 1;
+}
+
+/**
+ * Writes the queued requests back to back, as far as the socket accepts them.
+ *
+ * @return 0 on success, -1 if the connection failed and was reset.
+ */
+static int write_requests(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    unsigned long long bytes_before = lg->stats->bytes_sent;
+
+    if (lg->ring != NULL) {
+        submit_send(lg, index);
+        return 0;
+    }
+    while (conn->sent < conn->queued) {
+        struct pipelined_request *entry = &conn->queue[(conn->head + conn->sent) % lg->depth];
+        size_t before = conn->written;
+        int ret = send_http_request_part(conn->fd, entry->request, &conn->written);
+
+        lg->stats->syscalls++;
+        lg->stats->bytes_sent += conn->written - before;
+        if (ret < 0) {
+            reset_connection(lg, index);
+            return -1;
+        }
+        if (ret == 0) {
+            // Socket buffer full, continue once it is writable again
+            break;
+        }
+
+        // This request is out, the next one follows without waiting for the response
+        http_timings_record(&lg->stats->timings, HTTP_PHASE_SEND, entry->attempt_start, latency_now_ns());
+        if (conn->sent == 0) {
+            set_deadline(lg, conn, DEADLINE_FIRST_BYTE, latency_now_ns());
+        }
+        conn->sent++;
+        conn->written = 0;
+    }
+    if (lg->stats->bytes_sent > bytes_before) {
+        set_deadline(lg, conn, DEADLINE_IDLE, latency_now_ns());
+    }
+    watch(lg, index);
+    return 0;
+}
+
+/**
+ * Queues a request on a connection that can take it and starts writing it.
+ *
+ * @param request The request, copied into the connection's queue.
+ * @param twin The request this one duplicates (hedging), or NULL.
+ */
+static void hand_out(struct loadgen *lg, int index, const struct pipelined_request *request,
+                     struct pipelined_request *twin) {
+    struct connection *conn = &lg->conns[index];
+    struct pipelined_request *entry = &conn->queue[(conn->head + conn->queued) % lg->depth];
+
+    *entry = *request;
+    entry->attempt_start = latency_now_ns();
+    entry->first_byte = 0;
+    entry->hedge = twin != NULL;
+    entry->orphaned = 0;
+    entry->twin = twin;
+    if (twin != NULL) {
+        twin->twin = entry;
+    }
+    conn->queued++;
+    if (conn->queued == 1) {
+        expect_response(lg, conn);
+    }
+
+    // A connection that can take more goes to the bottom of the stack
+    remove_ready(lg, index);
+    if (conn->queued < lg->depth) {
+        conn->ready = 1;
+        lg->ready[lg->ready_count++] = lg->ready[0];
+        lg->ready[0] = index;
+    }
+    write_requests(lg, index);
+}
+
+/**
+ * Hedging: sets the time after which a request is duplicated to the configured percentile of
+ * the latencies measured so far, and refreshes it as the run goes on.
+ */
+static void update_hedge_threshold(struct loadgen *lg) {
+    long completed = lg->stats->completed;
+
+    if (lg->options->hedge_percentile > 0
+            && (completed == HEDGE_MIN_SAMPLES || (completed > HEDGE_MIN_SAMPLES && completed % HEDGE_REFRESH == 0))) {
+        lg->hedge_after = histogram_percentile(&lg->stats->timings.phases[HTTP_PHASE_TOTAL],
+                                               lg->options->hedge_percentile);
+    }
+}
+
+/**
+ * Completes the oldest request of a connection once the parser has seen its whole response. A
+ * 5xx response is retried if the policy says so; of the two copies of a hedged request, the
+ * first answer counts.
+ */
+static void complete_response(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    struct pipelined_request *entry = &conn->queue[conn->head % lg->depth];
+    int status = conn->parser.status_code;
+    long long now = latency_now_ns();
+
+    if (entry->orphaned) {
+        // Its twin has already been answered
+    } else if (lg->options->retry.retry_5xx && status >= 500 && status <= 599
+               && (entry->twin != NULL || try_retry(lg, entry))) {
+        // The server failed, the twin or the retry may do better
+        if (entry->twin != NULL) {
+            entry->twin->twin = NULL;
+        }
+    } else {
+        // Latency is measured from the first attempt, retries and hedging included
+        http_timings_record(&lg->stats->timings, HTTP_PHASE_TOTAL, entry->request_start, now);
+        if (lg->interval > 0) {
+            http_timings_record(&lg->stats->timings, HTTP_PHASE_CORRECTED, entry->intended_start, now);
+        }
+        lg->outstanding--;
+        lg->stats->completed++;
+        if (status < 200 || status > 299) {
+            lg->stats->non_2xx++;
+        }
+        // First response wins, the answer to the other copy is thrown away
+        if (entry->twin != NULL) {
+            struct pipelined_request *loser = entry->twin;
+            struct connection *other = &lg->conns[(loser - lg->queues) / lg->depth];
+
+            loser->orphaned = 1;
+            loser->twin = NULL;
+            lg->stats->hedge_wins += entry->hedge;
+            // A loser alone on its connection is cancelled right away (see hedge_request())
+            if (other->queued == 1) {
+                timer_wheel_add(&lg->wheel, &other->timers[TIMER_HEDGE], 0);
+            }
+        }
+        update_hedge_threshold(lg);
+    }
+
+    // The responses arrive in the order of the requests (FIFO)
+    pop_request(lg, conn);
+    conn->sent--;
+    expect_response(lg, conn);
+    make_ready(lg, index);
+}
+
+/**
+ * Handles the server closing a connection: fine only if the body of the response ran until the
+ * close. The connection is replaced either way.
+ */
+static void connection_closed(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+
+    if (conn->sent > 0 && http_parser_finish(&conn->parser) == 0) {
+        complete_response(lg, index);
+        reopen_connection(lg, index);
+        return;
+    }
+    reset_connection(lg, index);
+}
+
+/**
+ * Handles response bytes that were received. One read may end a response and start the next
+ * ones of the pipeline: every response is framed by the parser and matched to the oldest
+ * unanswered request.
+ *
+ * @return 0 if the connection is still in use, -1 if it was replaced.
+ */
+static int consume_responses(struct loadgen *lg, int index, char *data, long received) {
+    struct connection *conn = &lg->conns[index];
+
+    lg->stats->bytes_received += received;
+    set_deadline(lg, conn, DEADLINE_IDLE, latency_now_ns());
+
+    while (received > 0) {
+        struct pipelined_request *entry = &conn->queue[conn->head % lg->depth];
+
+        // Bytes on a connection without a request written out are a protocol error
+        if (conn->sent == 0) {
+            reset_connection(lg, index);
+            return -1;
+        }
+        if (entry->first_byte == 0) {
+            entry->first_byte = latency_now_ns();
+            clear_deadline(lg, conn, DEADLINE_FIRST_BYTE);
+            http_timings_record(&lg->stats->timings, HTTP_PHASE_FIRST_BYTE, entry->attempt_start,
+                                entry->first_byte);
+        }
+
+        long consumed = http_parser_feed(&conn->parser, data, received);
+        if (consumed < 0) {
+            reset_connection(lg, index);
+            return -1;
+        }
+        if (!http_parser_done(&conn->parser)) {
+            break;
+        }
+        data += consumed;
+        received -= consumed;
+
+        int keep_alive = conn->parser.keep_alive;
+        complete_response(lg, index);
+        if (!keep_alive) {
+            // The server closes the connection after this response, replace it; requests
+            // already sent behind it were dropped by the server and go out again
+            reopen_connection(lg, index);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reads whatever response bytes are available (epoll).
+ */
+static void read_responses(struct loadgen *lg, int index, char *buffer) {
+    struct connection *conn = &lg->conns[index];
+
+    for (;;) {
+        ssize_t received = recv(conn->fd, buffer, RECV_BUFFER_SIZE, 0);
+
+        lg->stats->syscalls++;
+        if (received < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return;
+            }
+            if (errno == EINTR) {
+                continue;
+            }
+            reset_connection(lg, index);
+            return;
+        }
+        if (received == 0) {
+            connection_closed(lg, index);
+            return;
+        }
+        if (consume_responses(lg, index, buffer, received) < 0) {
+            return;
+        }
+    }
+}
+
+/**
+ * io_uring: arms a receive into a provided buffer. A multishot receive stays armed and delivers
+ * every further piece of data without being submitted again.
+ */
+static void submit_recv(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    struct io_uring_sqe *sqe;
+
+    if (conn->receiving || conn->state != CONN_OPEN) {
+        return;
+    }
+    sqe = uring_get_sqe(lg->ring);
+    if (sqe == NULL) {
+        reset_connection(lg, index);
+        return;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = conn->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 0;
+    sqe->ioprio = lg->multishot ? IORING_RECV_MULTISHOT : 0;
+    sqe->user_data = op_data(index, OP_RECV, conn->generation);
+    conn->receiving = 1;
+}
+
+/**
+ * Handles the end of a connect() that was in progress.
+ *
+ * @param so_error 0 if the connection is established, the error code otherwise.
+ */
+static void finish_connect(struct loadgen *lg, int index, int so_error) {
+    struct connection *conn = &lg->conns[index];
+
+    if (so_error != 0) {
+        if (!conn->ever_connected && conn->connect_failures == 0) {
+            printf("Error! Connection failed: %s\n", strerror(so_error));
+        }
+        // Give a dropped connection one chance to come back, not an endless retry loop
+        conn->ever_connected = 0;
+        reopen_connection(lg, index);
+        return;
+    }
+
+    conn->ever_connected = 1;
+    conn->connect_failures = 0;
+    conn->state = CONN_OPEN;
+    clear_deadline(lg, conn, DEADLINE_CONNECT);
+    http_timings_record(&lg->stats->timings, HTTP_PHASE_CONNECT, conn->connect_start, latency_now_ns());
+    if (lg->ring != NULL) {
+        submit_recv(lg, index);
+    }
+    make_ready(lg, index);
+    // Requests left over from a previous connection go out right away
+    write_requests(lg, index);
+}
+
+/**
+ * io_uring: handles one completion. Completions of a socket that has been closed since are
+ * stale and only give their receive buffer back.
+ */
+static void handle_completion(struct loadgen *lg, const struct io_uring_cqe *cqe) {
+    int index = cqe->user_data >> 32;
+    int op = cqe->user_data & 0xff;
+    unsigned generation = (cqe->user_data >> 8) & 0xffffff;
+    struct connection *conn = &lg->conns[index];
+    int res = cqe->res;
+
+#define STALE ((conn->generation & 0xffffff) != generation)
+    switch (op) {
+        case OP_CONNECT:
+            if (!STALE) {
+                finish_connect(lg, index, -res);
+            }
+            break;
+        case OP_SEND:
+            if (STALE) {
+                break;
+            }
+            conn->sending = 0;
+            if (res < 0) {
+                reset_connection(lg, index);
+                break;
+            }
+            requests_sent(lg, conn, res);
+            submit_send(lg, index);
+            break;
+        case OP_RECV:
+            if (cqe->flags & IORING_CQE_F_BUFFER) {
+                unsigned id = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+
+                if (!STALE && res > 0) {
+                    consume_responses(lg, index, uring_buffer(lg->ring, id), res);
+                }
+                uring_recycle(lg->ring, id);
+            }
+            if (STALE) {
+                break;
+            }
+            if (!(cqe->flags & IORING_CQE_F_MORE)) {
+                conn->receiving = 0;
+            }
+            if (res == 0) {
+                connection_closed(lg, index);
+                break;
+            }
+            if (res == -EINVAL && lg->multishot) {
+                // Multishot receives need Linux 6.0, submit one receive per piece instead
+                lg->multishot = 0;
+            } else if (res < 0 && res != -ENOBUFS) {
+                reset_connection(lg, index);
+                break;
+            }
+            // Single shot, or ended because every buffer was in use: arm it again
+            submit_recv(lg, index);
+            break;
+    }
+#undef STALE
+}
+
+/**
+ * Hedging: the oldest request of a connection is slower than most, a copy of it goes out on
+ * another connection. Whichever copy is answered first completes the request. The copy is
+ * paid for from the retry budget, so hedging cannot add more load than the budget allows.
+ *
+ * A copy that lost the race and is the only request of its connection is cancelled instead:
+ * HTTP/1.1 cannot abort a request, so the connection is replaced and free for new requests at
+ * once, rather than held up until the slow response arrives.
+ */
+static void hedge_request(struct loadgen *lg, int index) {
+    struct connection *conn = &lg->conns[index];
+    struct pipelined_request *entry = &conn->queue[conn->head];
+    int target = -1;
+
+    if (conn->queued == 0) {
+        return;
+    }
+    if (entry->orphaned) {
+        if (conn->queued == 1 && conn->state == CONN_OPEN) {
+            pop_request(lg, conn);
+            reopen_connection(lg, index);
+        }
+        return;
+    }
+    if (entry->hedge || entry->twin != NULL) {
+        return;
+    }
+    // The top of the ready stack is the connection with the fewest requests
+    for (int i = lg->ready_count - 1; i >= 0 && target < 0; i--) {
+        if (lg->ready[i] != index) {
+            target = lg->ready[i];
+        }
+    }
+    if (target < 0) {
+        return;
+    }
+    if (!retry_budget_withdraw(lg->budget)) {
+        lg->stats->budget_denied++;
+        return;
+    }
+    lg->stats->hedges++;
+    hand_out(lg, target, entry, entry);
+}
+
+/**
+ * Timer wheel callback: a retry is due, a request is due to be hedged, a failed connect is due
+ * to be tried again or a connection missed a deadline.
+ *
+ * A connect that takes too long is treated like a failed one. Otherwise the oldest request of the
+ * connection fails (and may be retried). Its response may still arrive and would be taken for
+ * the answer to the next request, so the connection is replaced; the requests pipelined behind
+ * it are sent again on the new connection.
+ */
+static void timer_expired(void *ctx, struct timer *timer) {
+    struct loadgen *lg = ctx;
+    int index = timer->owner;
+    struct connection *conn;
+
+    switch (timer->kind) {
+        case TIMER_RETRY:
+            // Sent by dispatch() as soon as a connection is free
+            lg->due[lg->due_count++] = timer->owner;
+            return;
+        case TIMER_HEDGE:
+            hedge_request(lg, index);
+            return;
+        case TIMER_RECONNECT:
+            if (open_connection(lg, index) < 0) {
+                connect_failed(lg, index);
+            }
+            return;
+    }
+
+    conn = &lg->conns[index];
+    lg->stats->timeouts[timer->kind]++;
+    if (timer->kind == DEADLINE_CONNECT) {
+        if (!conn->ever_connected && conn->connect_failures == 0) {
+            printf("Error! Connection timed out\n");
+        }
+        conn->ever_connected = 0;
+        reopen_connection(lg, index);
+        return;
+    }
+
+    if (conn->queued == 0) {
+        return;
+    }
+    fail_request(lg, &conn->queue[conn->head]);
+    pop_request(lg, conn);
+    if (conn->state == CONN_OPEN) {
+        reopen_connection(lg, index);
+    } else {
+        // Still connecting: the next request waits for the same connection
+        expect_response(lg, conn);
+    }
+}
+
+/**
+ * Claims the next request to send and stores its sequence number in `seq`.
+ *
+ * In a run with a fixed number of requests the requests are split into work items of
+ * WORK_BATCH requests. A worker first takes items from its own deque; once that is drained it
+ * steals from the other workers, so a worker stuck on a slow connection does not hold back
+ * requests the others could be sending.
+ *
+ * @return 1 if a request may be sent, 0 if there is no work left.
+ */
+static int next_request(struct loadgen *lg) {
+    long item;
+
+    if (lg->options->requests == 0) {
+        // Interleave the workers' sequence numbers
+        lg->seq = lg->claimed++ * lg->worker_count + lg->id;
+        return 1;
+    }
+    if (lg->next_seq < lg->batch_end) {
+        lg->seq = lg->next_seq++;
+        return 1;
+    }
+
+    item = wsdeque_take(&lg->deques[lg->id]);
+    // Own deque drained, steal from the others (starting with the next worker)
+    for (int i = 1; item < 0 && i < lg->worker_count; i++) {
+        struct wsdeque *victim = &lg->deques[(lg->id + i) % lg->worker_count];
+        do {
+            item = wsdeque_steal(victim);
+        } while (item == WSDEQUE_ABORT);
+    }
+    if (item < 0) {
+        lg->out_of_work = 1;
+        return 0;
+    }
+
+    lg->seq = item;
+    lg->next_seq = item + 1;
+    lg->batch_end = item + WORK_BATCH < lg->options->requests ? item + WORK_BATCH : lg->options->requests;
+    return 1;
+}
+
+/**
+ * Hands retries whose backoff has passed and then new requests to connections that can take
+ * them, until the target number of requests is outstanding or, in an open-loop run, until every
+ * request that is due has been sent. With pipelining, a connection takes up to `depth` requests;
+ * they are spread over the connections in turn.
+ */
+static void dispatch(struct loadgen *lg, int stopping) {
+    while (!stopping && lg->ready_count > 0
+            && (lg->due_count > 0 || (!lg->out_of_work && (lg->interval > 0 || lg->outstanding < lg->in_flight)))) {
+        long long now = latency_now_ns();
+        struct pipelined_request request;
+
+        if (lg->due_count > 0) {
+            // A retry is already counted as outstanding
+            int slot = lg->due[--lg->due_count];
+
+            hand_out(lg, lg->ready[lg->ready_count - 1], &lg->retry_slots[slot].entry, NULL);
+            lg->retry_slots[slot].next_free = lg->free_slot;
+            lg->free_slot = slot;
+            continue;
+        }
+
+        if (lg->interval > 0) {
+            // The schedule starts once a connection is up; workers are offset against each other
+            if (lg->next_send == 0) {
+                lg->next_send = now + lg->interval * lg->id / lg->worker_count;
+            }
+            if (now < lg->next_send) {
+                return;
+            }
+        }
+        if (!next_request(lg)) {
+            return;
+        }
+
+        memset(&request, 0, sizeof(request));
+        request.request_start = now;
+        request.intended_start = now;
+        if (lg->interval > 0) {
+            // A late request keeps its slot in the schedule, the next one is not pushed back
+            request.intended_start = lg->next_send;
+            lg->next_send += lg->interval;
+        }
+        request.request = lg->options->request;
+        if (lg->options->replay != NULL) {
+            request.request = &lg->options->replay[lg->seq % lg->options->replay_count];
+        }
+        if (lg->budget != NULL) {
+            retry_budget_deposit(lg->budget);
+        }
+        lg->outstanding++;
+        hand_out(lg, lg->ready[lg->ready_count - 1], &request, NULL);
+    }
+}
+
+/**
+ * Arms the schedule timer for the next request, if one is due later and a connection is free
+ * to send it. With every connection busy, a completing response wakes the loop instead.
+ */
+static void arm_timer(struct loadgen *lg) {
+    struct itimerspec due;
+
+    if (lg->interval == 0 || lg->ready_count == 0 || lg->out_of_work || lg->next_send == 0) {
+        return;
+    }
+    memset(&due, 0, sizeof(due));
+    due.it_value.tv_sec = lg->next_send / 1000000000LL;
+    due.it_value.tv_nsec = lg->next_send % 1000000000LL;
+    timerfd_settime(lg->timer_fd, TFD_TIMER_ABSTIME, &due, NULL);
+}
+
+/**
+ * Runs the event loop of one worker until its work is done (or time is up).
+ *
+ * @param arg The worker (struct loadgen).
+ * @return NULL; the outcome is stored in the worker's `result`.
+ */
+static void * run_worker(void *arg) {
+    struct loadgen *lg = arg;
+    const struct loadgen_options *options = lg->options;
+    struct epoll_event events[MAX_EVENTS];
+    double deadline = lg->start + options->duration;
+    char *buffer;
+
+    lg->result = 0;
+    lg->timer_fd = -1;
+    lg->uring.fd = -1;
+    lg->epoll_fd = epoll_create1(0);
+    lg->conns = calloc(lg->connections, sizeof(struct connection));
+    lg->queues = calloc((size_t) lg->connections * lg->depth, sizeof(struct pipelined_request));
+    lg->ready = malloc(lg->connections * sizeof(int));
+    // A request fails at most once at a time: one retry slot per place in the queues
+    lg->retry_slots = calloc((size_t) lg->connections * lg->depth, sizeof(struct retry_slot));
+    lg->due = malloc((size_t) lg->connections * lg->depth * sizeof(int));
+    buffer = malloc(RECV_BUFFER_SIZE);
+    if (lg->epoll_fd < 0 || lg->conns == NULL || lg->queues == NULL || lg->ready == NULL
+            || lg->retry_slots == NULL || lg->due == NULL || buffer == NULL) {
+        printf("Error! Could not set up the load generator: %s\n", strerror(errno));
+        lg->result = -1;
+        goto cleanup;
+    }
+    timer_wheel_init(&lg->wheel, latency_now_ns() / 1000000);
+    for (int i = 0; i < lg->connections; i++) {
+        lg->conns[i].fd = -1;
+        lg->conns[i].queue = &lg->queues[(size_t) i * lg->depth];
+        for (int kind = 0; kind < CONN_TIMERS; kind++) {
+            timer_init(&lg->conns[i].timers[kind], i, kind);
+        }
+    }
+    lg->free_slot = -1;
+    for (int i = lg->connections * lg->depth - 1; i >= 0; i--) {
+        timer_init(&lg->retry_slots[i].timer, i, TIMER_RETRY);
+        lg->retry_slots[i].next_free = lg->free_slot;
+        lg->free_slot = i;
+    }
+    lg->rng = (unsigned long long) latency_now_ns() * 2654435761ULL + lg->id + 1;
+
+    if (options->io_uring) {
+        // Room for a connect or a send and a receive per connection in one batch
+        unsigned entries = 64;
+        unsigned buffers = 64;
+
+        while (entries < URING_MAX_ENTRIES && entries < 2u * lg->connections) {
+            entries *= 2;
+        }
+        while (buffers < URING_MAX_BUFFERS && buffers < (unsigned) lg->connections) {
+            buffers *= 2;
+        }
+        lg->iovs = malloc((size_t) lg->connections * 2 * lg->depth * sizeof(struct iovec));
+        if (lg->iovs == NULL || uring_init(&lg->uring, entries) < 0
+                || uring_init_buffers(&lg->uring, buffers, URING_BUFFER_SIZE) < 0) {
+            if (lg->id == 0) {
+                printf("Error! io_uring is not available (%s), using epoll\n", strerror(errno));
+            }
+            uring_destroy(&lg->uring);
+        } else {
+            lg->ring = &lg->uring;
+            lg->multishot = 1;
+            for (int i = 0; i < lg->connections; i++) {
+                lg->conns[i].iov = &lg->iovs[(size_t) i * 2 * lg->depth];
+            }
+        }
+    }
+
+    if (lg->interval > 0 && lg->ring == NULL) {
+        // The schedule timer has nanosecond resolution; epoll_wait() only has milliseconds
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.u32 = TIMER_EVENT;
+        lg->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK);
+        if (lg->timer_fd < 0 || epoll_ctl(lg->epoll_fd, EPOLL_CTL_ADD, lg->timer_fd, &event) < 0) {
+            printf("Error! Could not set up the request schedule: %s\n", strerror(errno));
+            lg->result = -1;
+            goto cleanup;
+        }
+    }
+
+    for (int i = 0; i < lg->connections; i++) {
+        if (open_connection(lg, i) < 0) {
+            printf("Error! Connection failed: %s\n", strerror(errno));
+            connect_failed(lg, i);
+        }
+    }
+
+    for (;;) {
+        double now = now_seconds();
+        int stopping = options->requests == 0 && now >= deadline;
+
+        timer_wheel_advance(&lg->wheel, latency_now_ns() / 1000000, timer_expired, lg);
+        dispatch(lg, stopping);
+
+        // Done: every request answered, or time is up
+        if (stopping || (lg->out_of_work && lg->outstanding == 0)) {
+            // Requests the schedule wanted sent before the deadline but no connection was free for
+            long long late = (long long) (deadline * 1e9) - lg->next_send;
+            if (stopping && lg->interval > 0 && lg->next_send > 0 && late > 0) {
+                lg->stats->unsent += (late - 1) / lg->interval + 1;
+            }
+            break;
+        }
+        if (lg->dead == lg->connections) {
+            printf("Error! No connection to the server could be kept open\n");
+            lg->result = -1;
+            break;
+        }
+
+        // Wake up at least once a second, and in time for the deadline
+        int timeout = 1000;
+        if (options->requests == 0 && (deadline - now) * 1000 < timeout) {
+            timeout = (int) ((deadline - now) * 1000) + 1;
+        }
+        // ... and for the nearest deadline of a connection
+        long long next_tick = timer_wheel_next(&lg->wheel);
+        if (next_tick >= 0) {
+            long long wait = next_tick - latency_now_ns() / 1000000;
+            if (wait < timeout) {
+                timeout = wait > 0 ? (int) wait : 0;
+            }
+        }
+
+        if (lg->ring != NULL) {
+            // Submits everything queued since the last call and waits, in one system call. The
+            // schedule needs no timer: the wait ends in time for the next request
+            long long wait = timeout * 1000000LL;
+            struct io_uring_cqe *cqe;
+
+            if (lg->interval > 0 && lg->ready_count > 0 && !lg->out_of_work && lg->next_send > 0
+                    && lg->next_send - latency_now_ns() < wait) {
+                wait = lg->next_send - latency_now_ns();
+                wait = wait > 0 ? wait : 0;
+            }
+            if (uring_wait(lg->ring, wait) < 0 && errno != EINTR) {
+                printf("Error! io_uring_enter() failed: %s\n", strerror(errno));
+                lg->result = -1;
+                break;
+            }
+            while ((cqe = uring_peek(lg->ring)) != NULL) {
+                struct io_uring_cqe completion = *cqe;
+
+                // Seen before it is handled: the handler may queue new operations
+                uring_advance(lg->ring);
+                handle_completion(lg, &completion);
+            }
+            continue;
+        }
+
+        arm_timer(lg);
+        int ready = epoll_wait(lg->epoll_fd, events, MAX_EVENTS, timeout);
+        lg->stats->syscalls++;
+        if (ready < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            printf("Error! epoll_wait() failed: %s\n", strerror(errno));
+            lg->result = -1;
+            break;
+        }
+
+        for (int i = 0; i < ready; i++) {
+            if (events[i].data.u32 == TIMER_EVENT) {
+                // A request is due, it is sent by dispatch() at the top of the loop
+                uint64_t expirations;
+                while (read(lg->timer_fd, &expirations, sizeof(expirations)) < 0 && errno == EINTR) {
+                }
+                continue;
+            }
+
+            int index = events[i].data.u32;
+            struct connection *conn = &lg->conns[index];
+
+            switch (conn->state) {
+                case CONN_CONNECTING: {
+                    int so_error = 0;
+                    socklen_t len = sizeof(so_error);
+
+                    getsockopt(conn->fd, SOL_SOCKET, SO_ERROR, &so_error, &len);
+                    finish_connect(lg, index, so_error);
+                    break;
+                }
+                case CONN_OPEN:
+                    // A failed write has already replaced the connection
+                    if ((events[i].events & EPOLLOUT) && write_requests(lg, index) < 0) {
+                        break;
+                    }
+                    if (events[i].events & (EPOLLIN | EPOLLERR | EPOLLHUP)) {
+                        read_responses(lg, index, buffer);
+                    }
+                    break;
+                case CONN_BACKOFF:
+                case CONN_DEAD:
+                    break;
+            }
+        }
+    }
+
+cleanup:
+    if (lg->conns != NULL) {
+        for (int i = 0; i < lg->connections; i++) {
+            close_connection(lg, &lg->conns[i]);
+        }
+    }
+    if (lg->ring != NULL) {
+        lg->stats->syscalls += lg->ring->enters;
+    }
+    uring_destroy(&lg->uring);
+    if (lg->epoll_fd >= 0) {
+        close(lg->epoll_fd);
+    }
+    if (lg->timer_fd >= 0) {
+        close(lg->timer_fd);
+    }
+    free(lg->conns);
+    free(lg->queues);
+    free(lg->ready);
+    free(lg->retry_slots);
+    free(lg->due);
+    free(lg->iovs);
+    free(buffer);
+    return NULL;
+}
+
+/**
+ * Pins the calling thread to one CPU, so each worker keeps its own core (and caches).
+ */
+static void pin_to_cpu(int cpu) {
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+/**
+ * Thread entry point of a worker: pins the thread, then runs its event loop.
+ */
+static void * start_worker(void *arg) {
+    struct loadgen *lg = arg;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (cpus > 0) {
+        pin_to_cpu(lg->id % cpus);
+    }
+    return run_worker(lg);
+}
+
+int run_load_generator(const struct loadgen_options *options, struct loadgen_stats *stats) {
+    struct sockaddr_storage address;
+    struct loadgen *workers;
+    struct loadgen_stats *worker_stats;
+    struct wsdeque *deques;
+    struct retry_budget budget;
+    struct rusage usage_before, usage_after;
+    int worker_count = options->workers > 0 ? options->workers : 1;
+    int failed = 0;
+    double start;
+
+    memset(stats, 0, sizeof(*stats));
+
+    // Every worker needs at least one connection and one request in flight
+    if (worker_count > options->connections) {
+        worker_count = options->connections;
+    }
+    if (worker_count > options->in_flight) {
+        worker_count = options->in_flight;
+    }
+
+    // One budget for all workers: retries are limited to a share of all requests sent
+    retry_budget_init(&budget, options->retry_budget, RETRY_BUDGET_RESERVE);
+
+    // Copy the resolved address and fill in the port, for IPv4 and IPv6 alike
+    memcpy(&address, options->server_address->ai_addr, options->server_address->ai_addrlen);
+    if (address.ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) &address)->sin6_port = htons(options->port);
+    } else {
+        ((struct sockaddr_in *) &address)->sin_port = htons(options->port);
+    }
+
+    workers = calloc(worker_count, sizeof(struct loadgen));
+    worker_stats = calloc(worker_count, sizeof(struct loadgen_stats));
+    deques = calloc(worker_count, sizeof(struct wsdeque));
+    if (workers == NULL || worker_stats == NULL || deques == NULL) {
+        printf("Error! Memory allocation failed\n");
+        free(workers);
+        free(worker_stats);
+        free(deques);
+        return -1;
+    }
+
+    // Deal the work items out round-robin, each worker starts with an equal share
+    long items = (options->requests + WORK_BATCH - 1) / WORK_BATCH;
+    for (int i = 0; i < worker_count; i++) {
+        if (wsdeque_init(&deques[i], items / worker_count + 1) < 0) {
+            printf("Error! Memory allocation failed\n");
+            for (int j = 0; j < i; j++) {
+                wsdeque_destroy(&deques[j]);
+            }
+            free(workers);
+            free(worker_stats);
+            free(deques);
+            return -1;
+        }
+    }
+    for (long item = 0; item < items; item++) {
+        wsdeque_push(&deques[item % worker_count], item * WORK_BATCH);
+    }
+
+    if (options->rate > 0) {
+        printf("Opening %d connection(s), sending %.1f request(s)/sec, %d worker(s)...\n",
+               options->connections, options->rate, worker_count);
+    } else {
+        printf("Opening %d connection(s), %d request(s) in flight, %d worker(s)...\n",
+               options->connections, options->in_flight, worker_count);
+    }
+
+    start = now_seconds();
+    getrusage(RUSAGE_SELF, &usage_before);
+
+    for (int i = 0; i < worker_count; i++) {
+        struct loadgen *lg = &workers[i];
+
+        lg->options = options;
+        lg->stats = &worker_stats[i];
+        lg->address = address;
+        lg->address_len = options->server_address->ai_addrlen;
+        // Split connections and requests in flight as evenly as possible
+        lg->connections = options->connections / worker_count + (i < options->connections % worker_count);
+        lg->in_flight = options->in_flight / worker_count + (i < options->in_flight % worker_count);
+        lg->depth = options->pipeline > 1 ? options->pipeline : 1;
+        lg->id = i;
+        lg->worker_count = worker_count;
+        lg->deques = deques;
+        lg->start = start;
+        if (options->retry.max_retries > 0 || options->hedge_percentile > 0) {
+            lg->budget = &budget;
+        }
+        // Each worker sends its share of the rate
+        if (options->rate > 0) {
+            lg->interval = (long long) (1e9 * worker_count / options->rate);
+            if (lg->interval < 1) {
+                lg->interval = 1;
+            }
+        }
+    }
+
+    if (worker_count == 1) {
+        // A single worker runs in the calling thread
+        run_worker(&workers[0]);
+    } else {
+        for (int i = 0; i < worker_count; i++) {
+            if (pthread_create(&workers[i].thread, NULL, start_worker, &workers[i]) != 0) {
+                printf("Error! Could not start worker thread %d\n", i);
+                workers[i].result = -1;
+                workers[i].thread = 0;
+            }
+        }
+        for (int i = 0; i < worker_count; i++) {
+            if (workers[i].thread != 0) {
+                pthread_join(workers[i].thread, NULL);
+            }
+        }
+    }
+
+    stats->elapsed = now_seconds() - start;
+    getrusage(RUSAGE_SELF, &usage_after);
+    stats->cpu_user = (usage_after.ru_utime.tv_sec - usage_before.ru_utime.tv_sec)
+                      + (usage_after.ru_utime.tv_usec - usage_before.ru_utime.tv_usec) / 1e6;
+    stats->cpu_system = (usage_after.ru_stime.tv_sec - usage_before.ru_stime.tv_sec)
+                        + (usage_after.ru_stime.tv_usec - usage_before.ru_stime.tv_usec) / 1e6;
+
+    // Aggregate the results of all workers
+    for (int i = 0; i < worker_count; i++) {
+        stats->completed += worker_stats[i].completed;
+        stats->non_2xx += worker_stats[i].non_2xx;
+        stats->errors += worker_stats[i].errors;
+        stats->reconnects += worker_stats[i].reconnects;
+        stats->unsent += worker_stats[i].unsent;
+        stats->retries += worker_stats[i].retries;
+        stats->hedges += worker_stats[i].hedges;
+        stats->hedge_wins += worker_stats[i].hedge_wins;
+        stats->budget_denied += worker_stats[i].budget_denied;
+        for (int kind = 0; kind < DEADLINE_COUNT; kind++) {
+            stats->timeouts[kind] += worker_stats[i].timeouts[kind];
+        }
+        stats->syscalls += worker_stats[i].syscalls;
+        stats->bytes_sent += worker_stats[i].bytes_sent;
+        stats->bytes_received += worker_stats[i].bytes_received;
+        http_timings_merge(&stats->timings, &worker_stats[i].timings);
+        failed += workers[i].result != 0;
+        wsdeque_destroy(&deques[i]);
+    }
+
+    free(workers);
+    free(worker_stats);
+    free(deques);
+
+    // The run failed only if no worker could do its job
+    return failed == worker_count ? -1 : 0;
+}
+
+void print_load_report(const struct loadgen_stats *stats) {
+    double elapsed = stats->elapsed > 0 ? stats->elapsed : 1e-9;
+    long completed = stats->completed;
+
+    printf("\n");
+    printf("Duration:        %.3f s\n", stats->elapsed);
+    printf("Requests:        %ld completed, %ld non-2xx, %ld errors, %ld reconnects\n",
+           stats->completed, stats->non_2xx, stats->errors, stats->reconnects);
+    printf("Timeouts:        %ld connect, %ld first byte, %ld idle, %ld total\n",
+           stats->timeouts[DEADLINE_CONNECT], stats->timeouts[DEADLINE_FIRST_BYTE],
+           stats->timeouts[DEADLINE_IDLE], stats->timeouts[DEADLINE_TOTAL]);
+    if (stats->retries > 0 || stats->hedges > 0 || stats->budget_denied > 0) {
+        printf("Retries:         %ld retries, %ld hedged (%ld won by the copy), %ld denied by the budget\n",
+               stats->retries, stats->hedges, stats->hedge_wins, stats->budget_denied);
+    }
+    printf("Requests/sec:    %.1f\n", stats->completed / elapsed);
+    printf("Sent:            %llu bytes (%.1f KiB/s)\n", stats->bytes_sent, stats->bytes_sent / elapsed / 1024);
+    printf("Received:        %llu bytes (%.1f KiB/s)\n", stats->bytes_received, stats->bytes_received / elapsed / 1024);
+    printf("CPU:             %.3f s user, %.3f s system (%.1f us per request)\n", stats->cpu_user,
+           stats->cpu_system, (stats->cpu_user + stats->cpu_system) * 1e6 / (completed > 0 ? completed : 1));
+    printf("System calls:    %llu (%.2f per request)\n", stats->syscalls,
+           (double) stats->syscalls / (completed > 0 ? completed : 1));
+    if (stats->timings.phases[HTTP_PHASE_CORRECTED].total > 0) {
+        printf("Not sent:        %ld requests were due before the end but could not be sent in time\n", stats->unsent);
+        printf("\n");
+        printf("total: from the actual send (uncorrected), corrected: from the time the request was due\n");
+    } else {
+        printf("\n");
+    }
+    http_timings_print_table(&stats->timings, stdout);
+}
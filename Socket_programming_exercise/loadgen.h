@@ -0,0 +1,137 @@
+#ifndef LOADGEN_H
+#define LOADGEN_H
+
+#include <netdb.h>
+#include "request.h"
+#include "latency.h"
+#include "retry.h"
+
+/**
+ * Deadlines every connection and request is held to.
+ */
+enum loadgen_deadline {
+    DEADLINE_CONNECT,                 // Establishing a connection
+    DEADLINE_FIRST_BYTE,              // From writing a request to the first byte of its response
+    DEADLINE_IDLE,                    // Silence of a connection that has requests outstanding
+    DEADLINE_TOTAL,                   // From handing out a request to the end of its response
+    DEADLINE_COUNT
+};
+
+/**
+ * Settings of a benchmark run.
+ */
+struct loadgen_options {
+    const struct addrinfo *server_address;// Resolved address of the server
+    int port;                         // Port of the server
+    const struct http_request *request;// HTTP request, sent over and over again
+    const struct http_request *replay;// Requests sent in turn instead of `request`, or NULL
+    size_t replay_count;              // Number of requests in `replay`
+    int connections;                  // Number of connections opened to the server
+    int in_flight;                    // Number of requests kept outstanding at any time
+    int pipeline;                     // Requests a connection carries at once (1: no pipelining)
+    long requests;                    // Stop after this many requests (0 to run for `duration`)
+    int duration;                     // Seconds to run if `requests` is 0
+    int workers;                      // Worker threads, each with its own connections and event loop
+    double rate;                      // Requests per second sent on a fixed schedule (open loop),
+                                      // 0 to keep `in_flight` requests outstanding instead
+    int timeouts[DEADLINE_COUNT];     // Milliseconds allowed per deadline, 0 for no limit
+    struct retry_policy retry;        // When and how often failed requests and connects are retried
+    double retry_budget;              // Retries (and hedges) allowed per request sent, e.g. 0.1
+    double hedge_percentile;          // Duplicate requests slower than this percentile of the
+                                      // latency so far (e.g. 95), 0 for no hedging
+    int io_uring;                     // Drive the connections with io_uring instead of epoll
+};
+
+/**
+ * Results of a benchmark run.
+ */
+struct loadgen_stats {
+    long completed;                   // Responses received in full
+    long non_2xx;                     // ... of which did not have a 2xx status
+    long errors;                      // Requests lost to connection or protocol errors
+    long reconnects;                  // Connections re-opened during the run
+    long unsent;                      // Requests that were due (open loop) but never sent
+    long timeouts[DEADLINE_COUNT];    // Connects and requests given up per missed deadline
+    long retries;                     // Requests and connects tried again
+    long hedges;                      // Slow requests duplicated on another connection
+    long hedge_wins;                  // ... whose duplicate was answered first
+    long budget_denied;               // Retries and hedges refused by the retry budget
+    unsigned long long syscalls;      // System calls made by the event loops to wait, send and receive
+    double cpu_user;                  // CPU time spent in the program, in seconds
+    double cpu_system;                // ... and in the kernel on its behalf
+    unsigned long long bytes_sent;    // Request bytes written to the sockets
+    unsigned long long bytes_received;// Response bytes read from the sockets
+    double elapsed;                   // Wall clock duration of the run in seconds
+    struct http_timings timings;      // Latency of every phase of the requests
+};
+
+/**
+ * Runs the load generator.
+ *
+ * Opens `connections` non-blocking connections to the server and multiplexes them in epoll loops.
+ * Whenever fewer than `in_flight` requests are outstanding, the request is sent on an idle
+ * connection, so the server sees a steady number of concurrent requests. Responses are framed
+ * with the HTTP parser, which lets a connection carry the next request as soon as the previous
+ * response is complete.
+ *
+ * With a `pipeline` depth above 1, a connection does not wait for a response before it writes
+ * the next request: up to `pipeline` requests are written back to back (HTTP/1.1 pipelining),
+ * and the responses, which arrive in the same order, are matched to the requests first in,
+ * first out. A connection then carries several requests per round trip. Requests that were
+ * written behind a response that closes the connection are sent again on a new connection.
+ *
+ * With several `workers`, every worker thread is pinned to its own core and owns a share of the
+ * connections and of the requests in flight, so workers never touch each other's sockets. A run
+ * with a fixed number of requests hands the requests out through per-worker work-stealing
+ * deques: a worker that runs out of work steals from the others.
+ *
+ * With a `rate`, the run is an open loop instead: requests are due on a fixed schedule, whatever
+ * the server does, and are sent on the next idle connection (`in_flight` is ignored). A request
+ * that finds every connection busy waits for one, and its corrected latency, measured from the
+ * time it was due, includes that wait. The schedule does not slow down when the server stalls,
+ * so the percentiles show what users arriving at that rate would see.
+ *
+ * Every connection runs against its `timeouts`: the connect deadline while it connects, and for
+ * its oldest unanswered request the first-byte, idle and total deadlines, so a server that
+ * trickles a response byte by byte cannot hold a request forever. The deadlines of all
+ * connections live in one hierarchical timer wheel per worker, where setting, moving and
+ * cancelling a deadline is O(1), and the event loop sleeps until the nearest one. A request that
+ * misses a deadline fails and its connection is replaced; requests pipelined behind it are sent
+ * again on the new connection.
+ *
+ * A request that fails (its connection breaks, it misses a deadline or, with `retry_5xx`, it is
+ * answered with a 5xx status) is sent again after a jittered exponential backoff, up to
+ * `max_retries` times, and so is a connect that fails; otherwise it is counted as an error. With
+ * a `hedge_percentile`, a request still unanswered after that percentile of the latencies seen
+ * so far is duplicated on another connection, and the first response wins. Retries and hedges
+ * both draw on one retry budget for the whole run, which grows by `retry_budget` per request
+ * sent, so a struggling server never receives more than that share of extra load.
+ *
+ * With `io_uring`, the connections are driven by an io_uring instance per worker instead of epoll:
+ * connects, sends and receives are queued as operations and a single io_uring_enter() call per
+ * loop submits all of them and collects their completions. Responses are received by multishot
+ * receives into a ring of buffers registered with the kernel, so a connection's receive is
+ * submitted once, not once per response, and a whole pipeline of requests is written by one
+ * gather send. If the kernel does not support io_uring, the run falls back to epoll. The bodies
+ * of the requests must be in memory: a file body is sent with sendfile(), which needs epoll.
+ *
+ * With a `replay` table, the requests of the table are sent in turn, wrapping around at its
+ * end. A run with a fixed number of requests keeps the order of the table even across workers,
+ * up to the requests that are in flight at the same time.
+ *
+ * @param options The settings of the run.
+ * @param stats Filled with the results of the run.
+ *
+ * @return 0 on success, -1 if the run could not be carried out (the reason is printed).
+ */
+int run_load_generator(const struct loadgen_options *options, struct loadgen_stats *stats);
+
+/**
+ * Prints a summary of a benchmark run (requests/sec, bytes/sec, errors, timeouts) and a table of
+ * the latency percentiles of every phase (with the corrected latency of an open-loop run).
+ *
+ * @param stats The results of the run.
+ */
+void print_load_report(const struct loadgen_stats *stats);
+
+#endif // LOADGEN_H
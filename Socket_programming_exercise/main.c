@@ -11,43 +11,51 @@
 #include <unistd.h>
 #include <fcntl.h>
 #include <errno.h>
-#include <math.h>
 #include <poll.h>
+#include <time.h>
+#include "http_parser.h"
+#include "http_sink.h"
+#include "arena.h"
+#include "resolver.h"
+#include "connector.h"
+#include "latency.h"
+#include "request.h"
+#include "replay.h"
+#include "loadgen.h"
+#include "retry.h"
 
 // Definition section
 #define BUFFER_SIZE 32
 #define BUFFER_MULTIPLIER 1.5
-#define CONTENT_TYPE "Content-Type: text/plain"
-#define ACCEPT "Accept: */*"
-#define CONTENT_LENGTH "Content-Length: "
-#define HTTP_END_OF_LINE "\r\n"
-#define POST "POST "
-#define GET "GET "
-#define HTTP_1_1 " HTTP/1.1"
-#define PATCH "PATCH "
-#define DELETE "DELETE "
-#define PUT "PUT "
-#define HOST "Host: "
+#define RECV_BUFFER_SIZE 16384
 #define TRUE 1
 #define FALSE 0
-#define TIMEOUT 60
+#define TIMEOUT 60             // Seconds a request may take until its response is complete
+#define CONNECT_TIMEOUT 10     // Seconds to establish a connection
+#define FIRST_BYTE_TIMEOUT 30  // Seconds from sending a request to the first byte of its response
+#define IDLE_TIMEOUT 30        // Seconds the peer may stay silent in the middle of a transfer
+#define NS_PER_SECOND 1000000000LL
+#define CONNECT_RETRIES 3      // Connects tried again before the interactive mode gives up
+#define RETRY_BASE_DELAY 10    // Milliseconds of backoff before the first retry (doubling after)
+#define RETRY_MAX_DELAY 1000   // Most milliseconds of backoff before a retry
+#define RETRY_BUDGET 0.1       // Retries allowed per request sent (benchmark mode)
 
 // Function prototypes
 // ----------------------------
 
-int setup_socket(struct addrinfo *);
+int handle_connection(const struct addrinfo *, int, const struct addrinfo **);
 
-void handle_connection(int, struct addrinfo *, int);
+void build_http_request(struct arena *, const char *, struct http_request *);
 
-char * build_http_request(const char *);
+void send_http_request(int, const struct http_request *);
 
-void send_http_request(int, const char *);
+void recieve_http_response(int, long long, int *, long long *);
 
-char * recieve_http_response(int);
+struct resolver_entry * start_lookup(struct resolver *, const char *);
 
-struct addrinfo * get_domain_ip(const char *);
+struct addrinfo * get_domain_ip(struct resolver *, struct resolver_entry *);
 
-char * read_string(char *);
+char * read_string(struct arena *, char *);
 
 int read_int(void);
 
@@ -55,77 +63,143 @@ void clear_buffer(void);
 
 int ask_to_continue(void);
 
+int run_benchmark(int, char *[]);
+
+int write_latency_json(const struct http_timings *, const char *);
+
+int parse_timeouts(const char *, int *);
+
+void print_usage(const char *);
+
 // ----------------------------
 
 // Main function, where the program starts
-int main() {
+int main(int argc, char *argv[]) {
     // Holds the domain name
     char *domain_name;
+    // Memory that lives as long as the program (the domain name)
+    struct arena session;
+    // Reusable arenas, one owns the memory of each request/response cycle
+    struct arena_pool arenas;
+    // Arena of the current cycle
+    struct arena *cycle;
     // Holds the port number
     int port;
     // Pointer to the address info
     struct addrinfo *server_address;
+    // Resolves the domain name in the background
+    struct resolver resolver;
+    // Lookup of the domain name, owns the address info
+    struct resolver_entry *lookup;
     // Holds the socket file descriptor
     int sockfd;
-    // Pointer to the HTTP request
-    char *request;
-    // Pointer to the HTTP response
-    char *response;
+    // The HTTP request (head and body)
+    struct http_request request;
     // Boolean to check if the user wants to send another request
     int continue_program;
+    // Boolean to check if the server keeps the connection open
+    int keep_alive;
+    // Latency of every phase of the requests, printed at exit
+    static struct http_timings timings;
+    // Start of the current phase, start of the current request and arrival of its first byte
+    long long phase_start, request_start, first_byte;
+
+    // Command line options select the non-interactive benchmark mode
+    if (argc > 1) {
+        return run_benchmark(argc, argv);
+    }
+
+    arena_init(&session);
+    arena_pool_init(&arenas);
 
     // Read the domain name
     printf("Enter domain name: ");
-    domain_name = read_string(" \t\r\n");
+    domain_name = read_string(&session, " \t\r\n");
+
+    // Start resolving the domain name, the lookup runs while the port is typed in
+    if (resolver_init(&resolver, 1, 0, NULL) < 0) {
+        printf("Error! Failed to start the resolver\n");
+        exit(EXIT_FAILURE);
+    }
+    lookup = start_lookup(&resolver, domain_name);
 
     // Read the port number
     printf("Enter port number: ");
     port = read_int();
 
-    // Get the IP address of the domain name
-    server_address = get_domain_ip(domain_name);
+    http_timings_init(&timings);
 
-    // Setup the socket and handle the connection
-    sockfd = setup_socket(server_address);
+    // Get the IP address of the domain name
+    phase_start = latency_now_ns();
+    server_address = get_domain_ip(&resolver, lookup);
+    http_timings_record(&timings, HTTP_PHASE_DNS, phase_start, latency_now_ns());
 
-    // Handle the connection
-    handle_connection(sockfd, server_address, port);
+    // Connect to the server, trying all of its addresses
+    phase_start = latency_now_ns();
+    sockfd = handle_connection(server_address, port, NULL);
+    http_timings_record(&timings, HTTP_PHASE_CONNECT, phase_start, latency_now_ns());
 
     // Set the continue_program variable to true
     continue_program = TRUE;
 
     while (continue_program) {
-        // Build the HTTP request
-        request = build_http_request(domain_name);
+        // Build the HTTP request, all of its memory comes from the cycle's arena
+        cycle = arena_pool_get(&arenas);
+        build_http_request(cycle, domain_name, &request);
 
         // Send the HTTP request
-        send_http_request(sockfd, request);
+        request_start = latency_now_ns();
+        send_http_request(sockfd, &request);
+        http_timings_record(&timings, HTTP_PHASE_SEND, request_start, latency_now_ns());
 
         // Print the HTTP request
-        printf("Request: %s\n", request);
-
-        // Recieve the HTTP response
-        response = recieve_http_response(sockfd);
+        if (request.chunked) {
+            printf("Request: %s<body streamed in chunks>\n", request.head);
+        } else if (request.body_fd >= 0) {
+            printf("Request: %s<%zu bytes sent from file>\n", request.head, request.body_len);
+        } else {
+            printf("Request: %s%s\n", request.head, request.body != NULL ? request.body : "");
+        }
 
-        // Print the HTTP response
-        printf("Response: %s", response);
+        // Recieve the HTTP response, it is printed as it arrives
+        printf("Response:\n");
+        recieve_http_response(sockfd, request_start, &keep_alive, &first_byte);
+        if (first_byte != 0) {
+            http_timings_record(&timings, HTTP_PHASE_FIRST_BYTE, request_start, first_byte);
+            http_timings_record(&timings, HTTP_PHASE_TOTAL, request_start, latency_now_ns());
+        }
 
-        // Free the HTTP response and the request
-        free(request);
-        free(response);
+        // Free the HTTP request, the arena releases its memory at once
+        free_http_request(&request);
+        arena_pool_put(&arenas, cycle);
 
         // Ask the user if they want to send another request
         continue_program = ask_to_continue();
+
+        // If the server closed the connection, open a new one for the next request
+        if (continue_program && !keep_alive) {
+            close(sockfd);
+            phase_start = latency_now_ns();
+            sockfd = handle_connection(server_address, port, NULL);
+            http_timings_record(&timings, HTTP_PHASE_CONNECT, phase_start, latency_now_ns());
+        }
     }
 
+    // Show where the time went, as a table and as JSON
+    printf("\nLatency:\n");
+    http_timings_print_table(&timings, stdout);
+    http_timings_print_json(&timings, stdout);
+
     // Close the socket
     close(sockfd);
 
     // Free the address info
-    freeaddrinfo(server_address);
+    resolver_release(&resolver, lookup);
+    resolver_destroy(&resolver);
 
-    // Free the domain name
-    free(domain_name);
+    // Free the arenas (and with them the domain name)
+    arena_pool_destroy(&arenas);
+    arena_destroy(&session);
 
     // Return 0 to the operating system indicating success execution of the program
     return 0;
@@ -134,19 +208,20 @@ int main() {
 /**
  * Reads a string from standard input until a newline or EOF is encountered.
  *
- * This function dynamically allocates memory for the string and expands it 
- * as needed. It checks each character against a list of disallowed characters 
+ * This function allocates the string from an arena and expands it as needed
+ * (in place, as long as nothing else was allocated from the arena meanwhile). It checks each character against a list of disallowed characters 
  * and skips any that are found, printing an error message for each disallowed 
  * character encountered. The resulting string is null-terminated.
  *
+ * @param arena The arena the string is allocated from.
  * @param chars_not_allowed A string containing characters that are not allowed 
  *                          in the input. If any of these characters are 
  *                          encountered, they are skipped and an error message 
  *                          is printed.
- * @return A pointer to the dynamically allocated string containing the user's 
+ * @return A pointer to the string (owned by the arena) containing the user's 
  *         input, excluding any disallowed characters.
  */
-char * read_string(char *chars_not_allowed) {
+char * read_string(struct arena *arena, char *chars_not_allowed) {
     // Pointer to the string that will be returned
     char *string;
     // Current character read from standard input
@@ -157,13 +232,7 @@ char * read_string(char *chars_not_allowed) {
     int length = 0;
 
     // Allocate memory for the string
-    string = malloc(size * sizeof(char));
-
-    // Check if memory allocation failed
-    if (string == NULL) {
-        printf("Error! Memory allocation failed");
-        exit(EXIT_FAILURE);
-    }
+    string = arena_alloc(arena, size * sizeof(char));
 
     // Read characters from standard input until a newline or EOF is encountered
     while ((input = getchar()) != '\n' && input != EOF) {
@@ -182,12 +251,8 @@ char * read_string(char *chars_not_allowed) {
 
         // If buffer is full, reallocate memory
         if (length >= size - 1) {
+            string = arena_grow(arena, string, size * sizeof(char), size * BUFFER_MULTIPLIER * sizeof(char));
             size *= BUFFER_MULTIPLIER;
-            string = realloc(string, size * sizeof(char));
-            if (string == NULL) {
-                printf("Error! Memory allocation failed");
-                exit(EXIT_FAILURE);
-            }
         }
 
         // Add the current character to the string
@@ -240,178 +305,150 @@ void clear_buffer() {
 }
 
 /**
- * Resolves a domain name to an IP address.
+ * Starts resolving a domain name in the background.
  *
+ * @param resolver The resolver that runs the lookup.
  * @param domain_name The domain name to resolve.
- * @return A pointer to the addrinfo structure containing the resolved IP address.
- *         the program exits with an error if the DNS resolution fails.
+ * @return The lookup, to be passed to get_domain_ip().
+ *         the program exits with an error if the lookup cannot be started.
  */
-struct addrinfo * get_domain_ip(const char *domain_name) {
-    // Variables used to turn server domian name into IP
-    struct addrinfo hints, *res;
-
-    // Zero out the hints structure so there are no garbage values
-    memset(&hints, 0, sizeof hints);
-    hints.ai_family = AF_UNSPEC;  // We do not know if we are using IPv4 or IPv6
-    hints.ai_socktype = SOCK_STREAM; // TCP connection
-
-    printf("Resolving domain: %s\n", domain_name);
+struct resolver_entry * start_lookup(struct resolver *resolver, const char *domain_name) {
+    // Lookup shared with any other caller resolving the same name
+    struct resolver_entry *lookup = resolver_start(resolver, domain_name);
 
-    // Resolve domain to IP. If 0 is not returned, something has gone wrong
-    // This function resolves the domain name to an IP and saves the result in res
-    if (getaddrinfo(domain_name, NULL, &hints, &res) != 0) {
-        printf("Error! DNS resolution failed\n");
-        freeaddrinfo(res);
+    if (lookup == NULL) {
+        printf("Error! Cannot resolve %s\n", domain_name);
         exit(EXIT_FAILURE);
     }
 
-    printf("Domain resolved to: %s\n", res->ai_addr->sa_family == AF_INET ? "IPv4" : "IPv6");
+    printf("Resolving domain: %s\n", domain_name);
 
-    return res;
+    return lookup;
 }
 
 /**
- * Creates a socket and sets it to non-blocking mode.
- *
- * This function creates a socket and sets it to non-blocking mode. A non-blocking
- * socket is one that does not block the calling process if data is not available
- * on the socket. This is useful for performing I/O operations that do not block,
- * such as reading from a file descriptor.
+ * Waits for a domain name to be resolved to its IP addresses.
  *
- * @param domain_info A pointer to the addrinfo structure containing the domain
- *                    information to use for creating the socket.
- * @return The socket file descriptor.
+ * @param resolver The resolver that runs the lookup.
+ * @param lookup The lookup returned by start_lookup().
+ * @return A pointer to the addrinfo list containing the resolved IP addresses, owned by the
+ *         lookup. The program exits with an error if the DNS resolution fails.
  */
-int setup_socket(struct addrinfo *domain_info) {
-    // Scocket file descriptor value from socket creation is saved in this variable
-    int sockfd;
-
-    printf("Creating socket...\n");  // Debugging line
-
-    // Create socket. If a negative number is returned, something has gone wrong
-    // This function creates a socket and returns a file descriptor that can be used to send and receive data
-    if ((sockfd = socket(domain_info->ai_family, domain_info->ai_socktype, domain_info->ai_protocol)) < 0) {
-        printf("Error! Socket creation failed\n");
+struct addrinfo * get_domain_ip(struct resolver *resolver, struct resolver_entry *lookup) {
+    // Wait for the resolver thread (often the answer is already there)
+    if (resolver_wait(resolver, lookup, TIMEOUT * 1000) < 0) {
+        printf("Error! DNS resolution timed out\n");
         exit(EXIT_FAILURE);
     }
 
-    printf("Socket created: %d\n", sockfd);
-    printf("Setting socket to non-blocking mode...\n");
-
-    // Set socket to non-blocking mode
-    if (fcntl(sockfd, F_SETFL, O_NONBLOCK) < 0) {
-        printf("Error! Failed to set non-blocking mode: %s\n", strerror(errno));
+    // If the lookup failed, something has gone wrong
+    if (lookup->error != 0) {
+        printf("Error! DNS resolution failed: %s\n", gai_strerror(lookup->error));
         exit(EXIT_FAILURE);
     }
- 
-    // printf("Socket set to non-blocking mode\n");
 
-    // Return the socket file descriptor
-    return sockfd;
+    printf("Domain resolved to: %s\n", lookup->addresses->ai_addr->sa_family == AF_INET ? "IPv4" : "IPv6");
+
+    return lookup->addresses;
 }
 
 /**
- * Connect to a server using the provided socket file descriptor, domain information and port.
+ * Connects to a server, racing its addresses against each other.
  *
- * This function connects to a server using the provided socket file descriptor, domain information and port.
- * It will print a message to the user indicating the server it is trying to connect to and whether or not the
- * connection was successful. If the connection times out, it will print an error message and exit.
+ * This function connects a non-blocking socket to the server using all of its resolved addresses
+ * (IPv4 and IPv6). Following "Happy Eyeballs" (RFC 8305), a new address is tried every
+ * CONNECT_ATTEMPT_DELAY_MS while earlier attempts are still pending, and the first connection that
+ * is established is used. A dead address or a broken address family thus only costs a short delay
+ * instead of the whole timeout. It will print a message to the user indicating the server it is
+ * trying to connect to and whether or not the connection was successful. If no address can be
+ * reached within the timeout, it will print an error message and exit.
  *
- * @param sockfd The file descriptor of the socket to use for the connection.
- * @param domain_info A pointer to the addrinfo structure containing the domain information to use for the connection.
+ * @param domain_info A pointer to the addrinfo list containing the addresses of the server.
  * @param port The port number to use for the connection.
+ * @param winner Set to the address the connection was established to (may be NULL).
+ * @return The file descriptor of the connected, non-blocking socket.
  */
-void handle_connection(int sockfd, struct addrinfo *domain_info, int port) {
-    struct sockaddr_in server_address;
-    memcpy(&server_address, domain_info->ai_addr, sizeof(struct sockaddr_in));
-    server_address.sin_port = htons(port);
-
-    // Convert the IP address to a string
-    char ip_str[INET_ADDRSTRLEN];
-    inet_ntop(server_address.sin_family, &server_address.sin_addr, ip_str, sizeof(ip_str));
-
-    printf("Connecting to %s:%d...\n", ip_str, port);
-
-    // Try to connect (non-blocking), since we are using a non-blocking socket, the connect function
-    // will return immediately, even if the connection is not yet established
-    if (connect(sockfd, (struct sockaddr *)&server_address, sizeof(server_address)) < 0) {
-        // We need to check if the connection is in progress
-        if (errno == EINPROGRESS) {
-            printf("Connection in progress...\n");
-
-            // Set up `select()` for timeout handling
-            fd_set write_fds;
-            struct timeval tv;
-            tv.tv_sec = TIMEOUT;
-            tv.tv_usec = 0;
-
-            // Zero the created set
-            FD_ZERO(&write_fds);
-            FD_SET(sockfd, &write_fds);
-
-            // Set up `select()` for timeout connection
-            int sel_res = select(sockfd + 1, NULL, &write_fds, NULL, &tv);
-            if (sel_res > 0) {  // Socket is writable, meaning connection is established, however, we do not know if connection succeeded do to asynchronous nature
-                // Check if the connection succeeded
-                int so_error;
-                socklen_t len = sizeof(so_error);
-                // This function stores the result of the connection in `so_error`
-                getsockopt(sockfd, SOL_SOCKET, SO_ERROR, &so_error, &len);
-
-                // If so_error is 0, the connection succeeded, otherwise it failed
-                if (so_error == 0) {
-                    printf("Connected to server\n");
-                    return;
-                } else {
-                    printf("Connection failed: %s\n", strerror(so_error));
-                    exit(EXIT_FAILURE);
-                }
-            // If the socket is not writable (sselect returns 0), it means the connection timed out,
-            } else if (sel_res == 0) {
-                printf("Error! Connection timeout\n");
-                exit(EXIT_FAILURE);
-            // If select returns -1, something has gone wrong
-            } else {
-                printf("Error! select() failed: %s\n", strerror(errno));
-                exit(EXIT_FAILURE);
-            }
-        // If we are not in EINPROGRESS, something has gone wrong
+int handle_connection(const struct addrinfo *domain_info, int port, const struct addrinfo **winner) {
+    // Socket file descriptor of the winning connection attempt
+    int sockfd;
+    // Address the connection was established to
+    const struct addrinfo *connected;
+    // Number of addresses that take part in the race
+    int count = 0;
+    // Address in text form, for the messages
+    char address_str[INET6_ADDRSTRLEN + 16];
+    // Copy of the winning address including the port
+    struct sockaddr_storage address;
+    // Connects that fail are tried again after a growing, random backoff
+    struct retry_policy policy = {CONNECT_RETRIES, RETRY_BASE_DELAY, RETRY_MAX_DELAY, FALSE};
+    unsigned long long rng = (unsigned long long) latency_now_ns() | 1;
+
+    for (connected = domain_info; connected != NULL; connected = connected->ai_next) {
+        count++;
+    }
+    printf("Connecting to port %d (%d address%s)...\n", port, count, count == 1 ? "" : "es");
+
+    for (int retry = 0; ; retry++) {
+        // Backoff before the next attempt
+        int delay;
+        struct timespec pause;
+
+        sockfd = happy_eyeballs_connect(domain_info, port, CONNECT_TIMEOUT * 1000, &connected);
+        if (sockfd >= 0) {
+            break;
+        }
+        if (errno == ETIMEDOUT) {
+            printf("Error! Connection timeout\n");
         } else {
             printf("Error! Connection failed: %s\n", strerror(errno));
+        }
+        if (retry >= policy.max_retries) {
             exit(EXIT_FAILURE);
         }
+
+        delay = retry_backoff_ms(&policy, retry, &rng);
+        printf("Retrying in %d ms...\n", delay);
+        pause.tv_sec = delay / 1000;
+        pause.tv_nsec = (delay % 1000) * 1000000L;
+        while (nanosleep(&pause, &pause) < 0 && errno == EINTR) {
+        }
+    }
+
+    // Show which address won the race
+    memcpy(&address, connected->ai_addr, connected->ai_addrlen);
+    if (address.ss_family == AF_INET6) {
+        ((struct sockaddr_in6 *) &address)->sin6_port = htons(port);
+    } else {
+        ((struct sockaddr_in *) &address)->sin_port = htons(port);
     }
+    printf("Connected to server at %s\n", format_address((struct sockaddr *) &address, address_str, sizeof(address_str)));
+
+    if (winner != NULL) {
+        *winner = connected;
+    }
+    return sockfd;
 }
 
 /**
  * Builds an HTTP request given the host (server) to which the request is to be sent.
  *
  * This function asks the user for the HTTP method they want to use, the endpoint to which the request is to be sent
- * and whether or not they want to include a body in the request. It then builds the request accordingly and returns it.
+ * and whether or not they want to include a body in the request. It then builds the request accordingly.
+ * A body entered as "@path" is sent from the file at `path`.
  *
+ * @param arena The arena the request is built in.
  * @param host The host (server) to which the request is to be sent.
- *
- * @return The HTTP request as a string.
+ * @param request The HTTP request to fill in.
  */
-char * build_http_request(const char * host) {
+void build_http_request(struct arena *arena, const char * host, struct http_request *request) {
     // Variabl to save the user's choice of the HTTP method
     int method_choice;
     // Varibale to hold the endpoint to which the request will be sent
     char *endpoint;
     // Variable to save request's body
     char *body;
-    // Variable to save the request
-    char *request;
-    // request size is saved in this variable
-    int request_size;
-    // Content length is saved in this variable
-    int content_length;
     // Variable to save the HTTP method
     char *method;
-    // Number of carriage returns and new lines in the request
-    int crlf_count;
-    // Content length string
-    char *content_length_string;
     
     // Loop until the user enters a valid choice for the HTTP method
     do {
@@ -446,160 +483,230 @@ char * build_http_request(const char * host) {
 
     // Ask for the endpoint
     printf("Please Enter the endpoint to which you want to send the request: ");
-    endpoint = read_string(" \t\r");
+    endpoint = read_string(arena, " \t\r");
 
-    // If the request is not a GET or DELETE req, ask for body
-    if (method_choice != 1 && method_choice != 5) {
-        printf("Please Enter the request body. Make sure the body of the request is in JSON format: ");
-        body = read_string("\r");
-        crlf_count = 12;
-    } else {
-        body = NULL;
-        crlf_count = 8;
-    }
+    // If the request is not a GET or DELETE req, ask for body (until a body file can be opened)
+    do {
+        if (method_choice != 1 && method_choice != 5) {
+            printf("Please Enter the request body (or @file to send a file). Make sure the body of the request is in JSON format: ");
+            body = read_string(arena, "\r");
+        } else {
+            body = NULL;
+        }
+    // Build the request, the body stays in the arena
+    } while (prepare_http_request(request, arena, method, endpoint, host, body) < 0);
+}
 
-    // Calculate content length
-    if (body != NULL) {
-        content_length = strlen(body);
-        // allocate memory to content length string
-        content_length_string = malloc(sizeof(char) * ((int) ceil(log10(content_length)) + strlen(CONTENT_LENGTH) + 1));
+/**
+ * Sends the given HTTP request to the server specified by the sockfd.
+ *
+ * The head and the body are written with a single gather write (a file body with sendfile(), a
+ * streamed body chunk by chunk), waiting for the non-blocking socket to become writable whenever
+ * its buffer is full.
+ *
+ * @param sockfd The socket file descriptor of the connection to the server.
+ * @param request The HTTP request to be sent.
+ *
+ * @return void
+ *
+ * @note If the request sending fails, the program will exit with an error message.
+ */
+void send_http_request(int sockfd, const struct http_request * request) {
+    // Number of request bytes sent so far
+    size_t sent = 0;
+    // Result of the last send attempt
+    int ret;
 
-        // Check if memory allocation failed
-        if (content_length_string == NULL) {
-            printf("Error! Memory allocation failed");
-            exit(EXIT_FAILURE);
-        } 
+    struct pollfd fd;
+    fd.fd = sockfd;
+    fd.events = POLLOUT;  // Wait for room in the socket buffer
 
-        // Convert content length to string
-        sprintf(content_length_string, "%s%d", CONTENT_LENGTH, content_length);
+    // Send the request using socket file descriptor. If -1 is returned, something has gone wrong
+    while ((ret = send_http_request_part(sockfd, request, &sent)) == 0) {
+        if (poll(&fd, 1, IDLE_TIMEOUT * 1000) <= 0) {
+            printf("Error! Request sending timed out\n");
+            exit(EXIT_FAILURE);
+        }
     }
-
-    // Calculate the size of the request
-    if (body == NULL) {
-        request_size = strlen(method) + strlen(endpoint) + strlen(HTTP_1_1) + strlen(HOST) + strlen(host)
-            + strlen(ACCEPT) + crlf_count + 1;
-    } else {
-        request_size = strlen(method) + strlen(endpoint) + strlen(HTTP_1_1) + strlen(HOST) + strlen(host)
-            + strlen(CONTENT_TYPE) + strlen(content_length_string) + strlen(body) + crlf_count + 1;
+    if (ret < 0) {
+        printf("Error! Request sending failed: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
     }
 
-    // Allocate memory for the request
-    request = malloc(sizeof(char) * request_size);
-
-    // Check if memory allocation failed
-    if (request == NULL) {
-        printf("Error! Memory allocation failed");
+    // A streamed body follows the head chunk by chunk
+    if (request->chunked && send_chunked_body(sockfd, request, IDLE_TIMEOUT * 1000) < 0) {
+        printf("Error! Request sending failed: %s\n", strerror(errno));
         exit(EXIT_FAILURE);
     }
+}
 
-    // Build the request
-    if (body == NULL) {
-        snprintf(request, request_size, "%s%s%s\r\n%s%s\r\n%s\r\n\r\n", method, endpoint, HTTP_1_1, HOST, host, ACCEPT);
-    } else {
-        snprintf(request, request_size, "%s%s%s\r\n%s%s\r\n%s\r\n%s\r\n\r\n%s\r\n", method, endpoint, HTTP_1_1, HOST, host, CONTENT_TYPE, content_length_string, body);
-    }
+/**
+ * State of printing a response while it is parsed.
+ */
+struct response_printer {
+    // Parser whose status code is printed
+    const struct http_parser *parser;
+    // Set once the status line was printed
+    int status_printed;
+    // Set once the empty line between the headers and the body was printed
+    int body_started;
+};
 
-    // Free memory alloated to all strings except the request
-    if (body != NULL) {
-        free(body);
-        free(content_length_string);
-    }
-    free(endpoint);
+/**
+ * Parser header callback: prints one header (or trailer) line of the response.
+ */
+static void print_header(void *ctx, const char *name, size_t name_len, const char *value, size_t value_len) {
+    struct response_printer *printer = ctx;
 
-    // Return the request
-    return request;
+    if (!printer->status_printed) {
+        printf("HTTP/1.%d %d\n", printer->parser->http_minor, printer->parser->status_code);
+        printer->status_printed = TRUE;
+    }
+    printf("%.*s: %.*s\n", (int) name_len, name, (int) value_len, value);
 }
 
 /**
- * Sends the given HTTP request to the server specified by the sockfd.
- *
- * @param sockfd The socket file descriptor of the connection to the server.
- * @param request The HTTP request to be sent.
- *
- * @return void
- *
- * @note If the request sending fails, the program will exit with an error message.
+ * Sink callback: copies a piece of the body to stdout.
  */
-void send_http_request(int sockfd, const char * request) {
-    // Send the request using socket file descriptor. If the number of bytes sent is less than 0, something has gone wrong
-    // Send returns the number of bytes sent
-    if (send(sockfd, request, strlen(request), 0) < 0) {
-        printf("Error! Request sending failed\n");
-        exit(EXIT_FAILURE);
+static void print_body(void *ctx, const char *data, size_t len) {
+    struct response_printer *printer = ctx;
+
+    if (!printer->body_started) {
+        printf("\n");
+        printer->body_started = TRUE;
     }
+    fwrite(data, 1, len, stdout);
 }
 
 /**
- * Recieves an HTTP response from the server specified by the sockfd.
+ * Recieves an HTTP response from the server specified by the sockfd and prints it.
  *
- * @param sockfd The socket file descriptor of the connection to the server.
+ * The bytes are fed to an incremental HTTP parser as they arrive. The parser uses the
+ * Content-Length header or the chunked transfer encoding to tell when the response is
+ * complete, so the function returns as soon as the last byte arrived instead of waiting
+ * for the server to close the connection (or for the timeout to expire).
  *
- * @return The response from the server. The returned string is null-terminated.
+ * Nothing is accumulated: the headers are printed as they are parsed and the body is
+ * streamed to stdout through a response sink, so a response of any size is received with
+ * a fixed size buffer.
+ *
+ * The wait is bounded by deadlines that do not move when a few bytes arrive: the first byte
+ * is due FIRST_BYTE_TIMEOUT seconds after the request was started, the whole response
+ * TIMEOUT seconds after it, and the server may not stay silent for more than IDLE_TIMEOUT
+ * seconds in between. A server that trickles its response cannot hold the client forever.
+ *
+ * @param sockfd The socket file descriptor of the connection to the server.
+ * @param request_start When the request was started (latency_now_ns()).
+ * @param keep_alive Set to TRUE if the connection can be used for another request,
+ *                   FALSE if the server closed it (or will close it).
+ * @param first_byte Set to the time (latency_now_ns()) the first byte of the response arrived,
+ *                   0 if none did.
  *
  * @note If the response recieving fails, the program will exit with an error message.
  */
-char * recieve_http_response(int sockfd) {
-    // Initial buffer allocation
-    int response_size = BUFFER_SIZE;
+void recieve_http_response(int sockfd, long long request_start, int *keep_alive, long long *first_byte) {
+    // Buffer for the bytes of one recv() call
+    char buffer[RECV_BUFFER_SIZE];
     // Holds the number of bytes read
-    int bytes_read;
+    ssize_t bytes_read;
     // Variable to save the return value of poll
     int ret;
-    // Position for writing data
-    int total_bytes_read = 0;
-
-    // Allocate memory for the response
-    char *response = malloc(response_size);
-    
-    // Check if memory allocation failed
-    if (response == NULL) {
-        printf("Error! Memory allocation failed\n");
-        exit(EXIT_FAILURE);
-    }
+    // Arrival of the latest bytes, the idle deadline runs from there
+    long long last_byte = request_start;
+    // The deadline that is nearest, and its name
+    long long deadline;
+    const char *deadline_name;
+    // Parser that tracks the status line, headers and body framing
+    struct http_parser parser;
+    // Prints the headers and the body as they are parsed
+    struct response_printer printer = { &parser, FALSE, FALSE };
+    // Receives the body of the response
+    struct http_sink sink;
+
+    *first_byte = 0;
+    http_parser_init(&parser, FALSE);
+    parser.on_header = print_header;
+    parser.header_ctx = &printer;
+    http_sink_callback(&sink, print_body, &printer);
+    http_sink_attach(&sink, &parser);
     
     struct pollfd fd;
     fd.fd = sockfd;
     fd.events = POLLIN;  // Wait for data to be available to read
 
-    do {
-        ret = poll(&fd, 1, TIMEOUT * 1000); // 1-second timeout
+    while (!http_parser_done(&parser)) {
+        long long now = latency_now_ns();
+
+        if (*first_byte == 0) {
+            deadline = request_start + FIRST_BYTE_TIMEOUT * NS_PER_SECOND;
+            deadline_name = "first byte";
+        } else {
+            deadline = last_byte + IDLE_TIMEOUT * NS_PER_SECOND;
+            deadline_name = "idle";
+        }
+        if (request_start + TIMEOUT * NS_PER_SECOND < deadline) {
+            deadline = request_start + TIMEOUT * NS_PER_SECOND;
+            deadline_name = "total";
+        }
+        if (now >= deadline) {
+            printf("\nError! Response timed out (%s deadline)\n", deadline_name);
+            break;
+        }
+
+        // Sleep until data arrives or the nearest deadline passes (rounded up to a millisecond)
+        ret = poll(&fd, 1, (int) ((deadline - now + 999999) / 1000000));
 
         if (ret == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
             printf("Error! poll() failed: %s\n", strerror(errno));
-            free(response);
             exit(EXIT_FAILURE);
         }
         if (ret == 0) {
-            printf("No more response received within %d second\n", TIMEOUT);
-            break;
+            continue;
         }
 
         // Data is available, read from socket
-        bytes_read = recv(sockfd, response + total_bytes_read, response_size - total_bytes_read - 1, 0);
+        bytes_read = recv(sockfd, buffer, sizeof(buffer), 0);
 
         // If the number of bytes read is less than 0, something has gone wrong
         if (bytes_read < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                continue;
+            }
             printf("Error! recv() failed: %s\n", strerror(errno));
-            free(response);
             exit(EXIT_FAILURE);
         }
 
-        // Update the total bytes read
-        total_bytes_read += bytes_read;
-        response[total_bytes_read] = '\0';  // Null-terminate the response
-
-        // If buffer is full, reallocate
-        if (total_bytes_read >= response_size - 1) {
-            response_size *= BUFFER_MULTIPLIER;
-            response = realloc(response, response_size);
-            if (response == NULL) {
-                printf("Error! Memory allocation failed\n");
-                exit(EXIT_FAILURE);
+        // If the number of bytes read is 0, the connection has been closed
+        if (bytes_read == 0) {
+            if (http_parser_finish(&parser) < 0) {
+                printf("\nError! Connection closed before the response was complete\n");
             }
+            break;
+        }
+
+        last_byte = latency_now_ns();
+        if (*first_byte == 0) {
+            *first_byte = last_byte;
+        }
+
+        // Let the parser look at the new bytes, it prints the headers and the body
+        if (http_parser_feed(&parser, buffer, (size_t) bytes_read) < 0) {
+            printf("\nError! Malformed HTTP response\n");
+            break;
         }
-    } while (bytes_read > 0); // If the number of bytes read is 0, the connection has been closed
+    }
+
+    // A response without any header still gets its status line
+    if (!printer.status_printed && parser.status_code != 0 && sink.total == 0) {
+        printf("HTTP/1.%d %d\n", parser.http_minor, parser.status_code);
+    }
+    printf("\n%llu body bytes\n", sink.total);
 
-    return response;
+    // Only a completely parsed response leaves the connection in a usable state
+    *keep_alive = http_parser_done(&parser) && parser.keep_alive;
 }
 
 /**
@@ -633,4 +740,364 @@ int ask_to_continue(void) {
     } else {
         return FALSE;
     }
-}
\ No newline at end of file
+}
+
+/**
+ * Prints the command line usage of the program.
+ *
+ * @param program The name the program was started with (argv[0]).
+ */
+void print_usage(const char *program) {
+    printf("Usage: %s                  (interactive mode)\n", program);
+    printf("       %s -H host -p port [options]  (benchmark mode)\n\n", program);
+    printf("Benchmark options:\n");
+    printf("  -H host         Server to benchmark\n");
+    printf("  -p port         Port of the server\n");
+    printf("  -m method       GET, POST, PUT, PATCH or DELETE (default GET)\n");
+    printf("  -e endpoint     Endpoint the requests are sent to (default /)\n");
+    printf("  -d body         Request body (for POST, PUT and PATCH), @file to send a file\n");
+    printf("  -c connections  Number of connections to open (default 1)\n");
+    printf("  -i in_flight    Requests kept in flight (default: one per connection, or -P)\n");
+    printf("  -P depth        Pipeline up to depth requests per connection (default 1: no pipelining)\n");
+    printf("  -n requests     Total number of requests to send\n");
+    printf("  -t seconds      Run for this many seconds instead (default 10)\n");
+    printf("  -w workers      Worker threads, one event loop per core (default 1, 0: one per CPU)\n");
+    printf("  -r rate         Send this many requests per second on a fixed schedule (open loop),\n");
+    printf("                  and report latency corrected for coordinated omission; -i is ignored\n");
+    printf("  -R hosts_file   Resolve the host from this hosts-style file before asking DNS\n");
+    printf("  -f file         Replay the requests of a file (JSONL or raw HTTP), once unless -n or -t\n");
+    printf("  -s seed         Replay the file in a random order (seed 0: a new order every run)\n");
+    printf("  -j file         Write the latency percentiles of every phase to a JSON file (- for stdout)\n");
+    printf("  -T c,f,i,t      Deadlines in seconds (0: none) for connecting, the first byte of a\n");
+    printf("                  response, silence during a transfer and the whole request\n");
+    printf("                  (default %d,%d,%d,%d); leading values alone may be given\n", CONNECT_TIMEOUT,
+           FIRST_BYTE_TIMEOUT, IDLE_TIMEOUT, TIMEOUT);
+    printf("  -x retries      Send failed requests and connects again up to this many times, after a\n");
+    printf("                  jittered exponential backoff (default 0)\n");
+    printf("  -X              Also retry requests answered with a 5xx status\n");
+    printf("  -b ratio        Retry budget: retries and hedges allowed per request sent (default %.1f)\n",
+           RETRY_BUDGET);
+    printf("  -E percentile   Hedge: duplicate a request on another connection once it is slower than\n");
+    printf("                  this percentile of the latency so far (e.g. 95); the first response wins\n");
+    printf("  -B backend      I/O backend: epoll (default) or io_uring (batched submissions,\n");
+    printf("                  multishot receives into registered buffers)\n");
+}
+
+/**
+ * Parses the deadlines of the -T option: up to DEADLINE_COUNT comma-separated numbers of seconds,
+ * in the order of enum loadgen_deadline. Deadlines that are not given keep their value.
+ *
+ * @param spec The option argument, e.g. "5,10,10,60" or "2.5".
+ * @param timeouts The deadlines in milliseconds, updated in place.
+ *
+ * @return 0 on success, -1 if `spec` is malformed.
+ */
+int parse_timeouts(const char *spec, int *timeouts) {
+    // End of the number that was parsed
+    char *end;
+
+    for (int kind = 0; kind < DEADLINE_COUNT; kind++) {
+        double seconds = strtod(spec, &end);
+
+        if (end == spec || seconds < 0 || seconds > 86400) {
+            return -1;
+        }
+        timeouts[kind] = (int) (seconds * 1000 + 0.5);
+        if (*end == '\0') {
+            return 0;
+        }
+        if (*end != ',') {
+            return -1;
+        }
+        spec = end + 1;
+    }
+    return -1;
+}
+
+/**
+ * Writes the latency percentiles of every phase as JSON.
+ *
+ * @param timings The latencies to write.
+ * @param path The file to write to, or "-" for the standard output.
+ *
+ * @return 0 on success, -1 if the file cannot be written (the reason is printed).
+ */
+int write_latency_json(const struct http_timings *timings, const char *path) {
+    // Stream the JSON is written to
+    FILE *file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+
+    if (file == NULL) {
+        printf("Error! Cannot write %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+    http_timings_print_json(timings, file);
+    if (file != stdout) {
+        fclose(file);
+    }
+    return 0;
+}
+
+/**
+ * Runs the non-interactive benchmark mode.
+ *
+ * Parses the command line options, builds the request once and hands it to the epoll based load
+ * generator, which sends it over and over again on several connections. Prints requests/sec and
+ * bytes/sec at the end.
+ *
+ * @param argc The number of command line arguments.
+ * @param argv The command line arguments.
+ *
+ * @return EXIT_SUCCESS if the benchmark ran, EXIT_FAILURE otherwise.
+ */
+int run_benchmark(int argc, char *argv[]) {
+    // Options of the run, with their defaults
+    struct loadgen_options options;
+    // Results of the run
+    static struct loadgen_stats stats;
+    // Host (server) to benchmark
+    const char *host = NULL;
+    // HTTP method, endpoint and body of the request
+    const char *method = GET;
+    const char *endpoint = "/";
+    const char *body = NULL;
+    // HTTP request, built once
+    struct http_request request;
+    // Memory of the request, it lives for the whole run
+    struct arena arena;
+    // Hosts-style file consulted before DNS (-R)
+    const char *hosts_file = NULL;
+    // File the latency percentiles are written to as JSON (-j)
+    const char *json_file = NULL;
+    // Request file that is replayed instead of a single request (-f)
+    const char *replay_file = NULL;
+    // Requests of the request file
+    struct replay_table replay;
+    // Replay the file in a random order (-s), seeded with `seed` (0: pick one)
+    int shuffle = 0;
+    unsigned long long seed = 0;
+    // Was a duration given (-t)?
+    int timed = 0;
+    // Latency of resolving the host and of the probing connection
+    static struct http_timings setup;
+    // Start of the phase that is being timed
+    long long phase_start;
+    // Addresses of the host
+    struct addrinfo *server_address;
+    // Resolves the host in the background
+    struct resolver resolver;
+    // Lookup of the host, owns the address info
+    struct resolver_entry *lookup;
+    // Option character returned by getopt
+    int option;
+    // Result of the run
+    int result;
+
+    memset(&options, 0, sizeof(options));
+    options.port = -1;
+    options.connections = 1;
+    options.duration = 10;
+    options.workers = 1;
+    options.pipeline = 1;
+    options.timeouts[DEADLINE_CONNECT] = CONNECT_TIMEOUT * 1000;
+    options.timeouts[DEADLINE_FIRST_BYTE] = FIRST_BYTE_TIMEOUT * 1000;
+    options.timeouts[DEADLINE_IDLE] = IDLE_TIMEOUT * 1000;
+    options.timeouts[DEADLINE_TOTAL] = TIMEOUT * 1000;
+    options.retry.base_delay_ms = RETRY_BASE_DELAY;
+    options.retry.max_delay_ms = RETRY_MAX_DELAY;
+    options.retry_budget = RETRY_BUDGET;
+
+    while ((option = getopt(argc, argv, "H:p:m:e:d:c:i:P:n:t:w:r:R:j:f:s:T:x:Xb:E:B:h")) != -1) {
+        switch (option) {
+            case 'H':
+                host = optarg;
+                break;
+            case 'p':
+                options.port = atoi(optarg);
+                break;
+            case 'm':
+                method = http_method_from_name(optarg);
+                if (method == NULL) {
+                    printf("Error! Unsupported method: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'e':
+                endpoint = optarg;
+                break;
+            case 'd':
+                body = optarg;
+                break;
+            case 'c':
+                options.connections = atoi(optarg);
+                break;
+            case 'i':
+                options.in_flight = atoi(optarg);
+                break;
+            case 'P':
+                options.pipeline = atoi(optarg);
+                break;
+            case 'n':
+                options.requests = atol(optarg);
+                break;
+            case 't':
+                options.duration = atoi(optarg);
+                timed = 1;
+                break;
+            case 'w':
+                options.workers = atoi(optarg);
+                break;
+            case 'r':
+                options.rate = atof(optarg);
+                break;
+            case 'R':
+                hosts_file = optarg;
+                break;
+            case 'j':
+                json_file = optarg;
+                break;
+            case 'f':
+                replay_file = optarg;
+                break;
+            case 's':
+                shuffle = 1;
+                seed = strtoull(optarg, NULL, 10);
+                break;
+            case 'T':
+                if (parse_timeouts(optarg, options.timeouts) < 0) {
+                    printf("Error! Malformed deadlines: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'x':
+                options.retry.max_retries = atoi(optarg);
+                break;
+            case 'X':
+                options.retry.retry_5xx = TRUE;
+                break;
+            case 'b':
+                options.retry_budget = atof(optarg);
+                break;
+            case 'E':
+                options.hedge_percentile = atof(optarg);
+                break;
+            case 'B':
+                if (strcmp(optarg, "io_uring") == 0) {
+                    options.io_uring = TRUE;
+                } else if (strcmp(optarg, "epoll") != 0) {
+                    printf("Error! Unknown I/O backend: %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            default:
+                print_usage(argv[0]);
+                return option == 'h' ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
+    }
+
+    if (host == NULL || options.port <= 0 || options.port > 65535 || options.connections < 1
+            || options.requests < 0 || options.duration < 1 || options.in_flight < 0 || options.workers < 0
+            || options.rate < 0 || options.pipeline < 1 || options.retry.max_retries < 0
+            || options.retry_budget < 0 || options.hedge_percentile < 0 || options.hedge_percentile >= 100) {
+        print_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // One worker per CPU
+    if (options.workers == 0) {
+        options.workers = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+
+    // A connection carries one request at a time, or `pipeline` requests with pipelining. An open
+    // loop sends whenever a request is due, on any connection that can take it
+    if (options.in_flight == 0 || options.in_flight > options.connections * options.pipeline
+            || options.rate > 0) {
+        options.in_flight = options.connections * options.pipeline;
+    }
+
+    // Start resolving the host, the request is built in the meantime
+    if (resolver_init(&resolver, 1, 0, hosts_file) < 0) {
+        printf("Error! Failed to start the resolver\n");
+        return EXIT_FAILURE;
+    }
+    lookup = start_lookup(&resolver, host);
+
+    // Build the request once, it is the same for every iteration
+    arena_init(&arena);
+    if (prepare_http_request(&request, &arena, method, endpoint, host,
+                             body != NULL ? arena_strdup(&arena, body) : NULL) < 0) {
+        arena_destroy(&arena);
+        resolver_release(&resolver, lookup);
+        resolver_destroy(&resolver);
+        return EXIT_FAILURE;
+    }
+    if (request.chunked) {
+        printf("Error! A streamed body can only be sent once, use a regular file for -d @file\n");
+        free_http_request(&request);
+        arena_destroy(&arena);
+        resolver_release(&resolver, lookup);
+        resolver_destroy(&resolver);
+        return EXIT_FAILURE;
+    }
+    options.request = &request;
+    if (options.io_uring && request.body_fd >= 0) {
+        printf("Error! A file body is sent with sendfile(), using epoll instead of io_uring\n");
+        options.io_uring = FALSE;
+    }
+
+    // Requests replayed from a file replace the one built from -m, -e and -d
+    if (replay_file != NULL) {
+        if (replay_load(&replay, replay_file, host) < 0) {
+            free_http_request(&request);
+            arena_destroy(&arena);
+            resolver_release(&resolver, lookup);
+            resolver_destroy(&resolver);
+            return EXIT_FAILURE;
+        }
+        if (shuffle) {
+            if (seed == 0) {
+                seed = (unsigned long long) time(NULL) ^ ((unsigned long long) getpid() << 32);
+            }
+            replay_shuffle(&replay, seed);
+        }
+        options.replay = replay.requests;
+        options.replay_count = replay.count;
+        // Without -n or -t, the file is replayed once
+        if (options.requests == 0 && !timed) {
+            options.requests = replay.count;
+        }
+        printf("Replaying %zu request(s) from %s", replay.count, replay_file);
+        if (shuffle) {
+            printf(", shuffled with seed %llu", seed);
+        }
+        printf("\n");
+    }
+
+    // Get the IP address of the domain name. Every connection of the run goes to the address
+    // that wins the race of a first, probing connection.
+    http_timings_init(&setup);
+    phase_start = latency_now_ns();
+    server_address = get_domain_ip(&resolver, lookup);
+    http_timings_record(&setup, HTTP_PHASE_DNS, phase_start, latency_now_ns());
+    phase_start = latency_now_ns();
+    close(handle_connection(server_address, options.port, &options.server_address));
+    http_timings_record(&setup, HTTP_PHASE_CONNECT, phase_start, latency_now_ns());
+
+    result = run_load_generator(&options, &stats);
+    if (result == 0) {
+        http_timings_merge(&stats.timings, &setup);
+        print_load_report(&stats);
+        if (json_file != NULL && write_latency_json(&stats.timings, json_file) < 0) {
+            result = -1;
+        }
+    }
+
+    if (options.replay != NULL) {
+        replay_free(&replay);
+    }
+    free_http_request(&request);
+    arena_destroy(&arena);
+    resolver_release(&resolver, lookup);
+    resolver_destroy(&resolver);
+
+    return result == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
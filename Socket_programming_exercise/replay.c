@@ -0,0 +1,619 @@
+// Include libraries
+#define _GNU_SOURCE  // memmem
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "replay.h"
+
+// Position in the request file while a line is parsed
+struct cursor {
+    const char *pos;
+    const char *end;
+};
+
+// A header of a JSONL request
+struct header {
+    const char *name;
+    size_t name_len;
+    const char *value;
+    size_t value_len;
+};
+
+/**
+ * Appends an empty request to the table, growing its array as needed.
+ *
+ * @return The new request, or NULL if memory allocation failed.
+ */
+static struct http_request * add_request(struct replay_table *table, size_t *capacity) {
+    struct http_request *request;
+
+    if (table->count == *capacity) {
+        size_t grown = *capacity > 0 ? *capacity * 2 : 256;
+        struct http_request *requests = realloc(table->requests, grown * sizeof(*requests));
+        if (requests == NULL) {
+            return NULL;
+        }
+        table->requests = requests;
+        *capacity = grown;
+    }
+
+    request = &table->requests[table->count++];
+    memset(request, 0, sizeof(*request));
+    request->body_fd = -1;
+    return request;
+}
+
+/**
+ * @return 1 if the `len` bytes at `text` are `word` (ignoring case if `ignore_case`), else 0.
+ */
+static int token_is(const char *text, size_t len, const char *word, int ignore_case) {
+    if (len != strlen(word)) {
+        return 0;
+    }
+    return ignore_case ? strncasecmp(text, word, len) == 0 : memcmp(text, word, len) == 0;
+}
+
+static void skip_space(struct cursor *cursor) {
+    while (cursor->pos < cursor->end
+            && (*cursor->pos == ' ' || *cursor->pos == '\t' || *cursor->pos == '\r' || *cursor->pos == '\n')) {
+        cursor->pos++;
+    }
+}
+
+/**
+ * Skips white space and the character `expected`.
+ *
+ * @return 0 if the character was there, -1 otherwise.
+ */
+static int expect(struct cursor *cursor, char expected) {
+    skip_space(cursor);
+    if (cursor->pos >= cursor->end || *cursor->pos != expected) {
+        return -1;
+    }
+    cursor->pos++;
+    return 0;
+}
+
+/**
+ * Finds the closing quote of a JSON string.
+ *
+ * @param pos The first character after the opening quote.
+ * @param end The end of the line.
+ * @param escaped Set to 1 if the string contains escape sequences.
+ *
+ * @return The closing quote, or NULL if the string is not terminated.
+ */
+static const char * string_end(const char *pos, const char *end, int *escaped) {
+    *escaped = 0;
+    for (; pos < end; pos++) {
+        if (*pos == '"') {
+            return pos;
+        }
+        if (*pos == '\\') {
+            *escaped = 1;
+            pos++;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Reads four hexadecimal digits.
+ *
+ * @return 0 on success, -1 if a character is not a hexadecimal digit.
+ */
+static int hex4(const char *digits, unsigned long *value) {
+    *value = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = digits[i];
+        *value <<= 4;
+        if (c >= '0' && c <= '9') {
+            *value |= c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            *value |= c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            *value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Writes the UTF-8 encoding of a code point.
+ *
+ * @return The number of bytes written.
+ */
+static size_t put_utf8(char *out, unsigned long code_point) {
+    if (code_point < 0x80) {
+        out[0] = (char) code_point;
+        return 1;
+    }
+    if (code_point < 0x800) {
+        out[0] = (char) (0xC0 | (code_point >> 6));
+        out[1] = (char) (0x80 | (code_point & 0x3F));
+        return 2;
+    }
+    if (code_point < 0x10000) {
+        out[0] = (char) (0xE0 | (code_point >> 12));
+        out[1] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (code_point & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (code_point >> 18));
+    out[1] = (char) (0x80 | ((code_point >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((code_point >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (code_point & 0x3F));
+    return 4;
+}
+
+/**
+ * Reads a JSON string. A string without escape sequences is returned where it lies in the
+ * mapping; any other string is unescaped into the arena.
+ *
+ * @return 0 on success, -1 if the string is malformed.
+ */
+static int parse_string(struct cursor *cursor, struct arena *arena, const char **text, size_t *len) {
+    const char *start;
+    const char *close;
+    char *unescaped;
+    size_t n = 0;
+    int escaped;
+
+    if (expect(cursor, '"') < 0) {
+        return -1;
+    }
+    start = cursor->pos;
+    close = string_end(start, cursor->end, &escaped);
+    if (close == NULL) {
+        return -1;
+    }
+    cursor->pos = close + 1;
+    if (!escaped) {
+        *text = start;
+        *len = close - start;
+        return 0;
+    }
+
+    // Unescaping never makes a string longer
+    unescaped = arena_alloc(arena, close - start);
+    for (const char *p = start; p < close; p++) {
+        unsigned long code_point;
+        unsigned long low;
+
+        if (*p != '\\') {
+            unescaped[n++] = *p;
+            continue;
+        }
+        switch (*++p) {
+            case '"': unescaped[n++] = '"'; break;
+            case '\\': unescaped[n++] = '\\'; break;
+            case '/': unescaped[n++] = '/'; break;
+            case 'b': unescaped[n++] = '\b'; break;
+            case 'f': unescaped[n++] = '\f'; break;
+            case 'n': unescaped[n++] = '\n'; break;
+            case 'r': unescaped[n++] = '\r'; break;
+            case 't': unescaped[n++] = '\t'; break;
+            case 'u':
+                if (close - p < 5 || hex4(p + 1, &code_point) < 0) {
+                    return -1;
+                }
+                p += 4;
+                // A surrogate pair encodes one code point beyond the first 64K
+                if (code_point >= 0xD800 && code_point < 0xDC00 && close - p >= 7 && p[1] == '\\'
+                        && p[2] == 'u' && hex4(p + 3, &low) == 0 && low >= 0xDC00 && low < 0xE000) {
+                    code_point = 0x10000 + ((code_point - 0xD800) << 10) + (low - 0xDC00);
+                    p += 6;
+                }
+                n += put_utf8(unescaped + n, code_point);
+                break;
+            default:
+                return -1;
+        }
+    }
+    *text = unescaped;
+    *len = n;
+    return 0;
+}
+
+/**
+ * Skips any JSON value: a string, a number, a literal or a whole object or array.
+ *
+ * @return 0 on success, -1 if the value is malformed.
+ */
+static int skip_value(struct cursor *cursor) {
+    const char *start;
+    int depth = 0;
+    int escaped;
+
+    skip_space(cursor);
+    if (cursor->pos >= cursor->end) {
+        return -1;
+    }
+
+    // A number, true, false or null
+    if (*cursor->pos != '"' && *cursor->pos != '{' && *cursor->pos != '[') {
+        start = cursor->pos;
+        while (cursor->pos < cursor->end && strchr(",}] \t\r\n", *cursor->pos) == NULL) {
+            cursor->pos++;
+        }
+        return cursor->pos > start ? 0 : -1;
+    }
+
+    do {
+        if (cursor->pos >= cursor->end) {
+            return -1;
+        }
+        switch (*cursor->pos) {
+            case '"':
+                cursor->pos = string_end(cursor->pos + 1, cursor->end, &escaped);
+                if (cursor->pos == NULL) {
+                    return -1;
+                }
+                break;
+            case '{':
+            case '[':
+                depth++;
+                break;
+            case '}':
+            case ']':
+                depth--;
+                break;
+        }
+        cursor->pos++;
+    } while (depth > 0);
+    return 0;
+}
+
+/**
+ * Copies `len` bytes to `out`.
+ *
+ * @return The end of the copy.
+ */
+static char * put(char *out, const char *data, size_t len) {
+    memcpy(out, data, len);
+    return out + len;
+}
+
+/**
+ * Parses one JSONL request and formats its head.
+ *
+ * @return 0 on success, -1 if the line is malformed.
+ */
+static int parse_json_request(struct http_request *request, struct cursor *cursor, struct arena *arena,
+                              const char *host) {
+    // Fields of the request, with their defaults
+    const char *method = "GET";
+    size_t method_len = 3;
+    const char *path = "/";
+    size_t path_len = 1;
+    const char *body = NULL;
+    size_t body_len = 0;
+    struct header headers[REPLAY_MAX_HEADERS];
+    int header_count = 0;
+    int has_host = 0;
+    // Content-Length of the body, as a header line
+    char length[sizeof(CONTENT_LENGTH) + 24];
+    int length_len = 0;
+    size_t head_len;
+    char *out;
+
+    if (expect(cursor, '{') < 0) {
+        return -1;
+    }
+    skip_space(cursor);
+    if (cursor->pos < cursor->end && *cursor->pos == '}') {
+        cursor->pos++;
+    } else {
+        for (;;) {
+            const char *key;
+            size_t key_len;
+
+            if (parse_string(cursor, arena, &key, &key_len) < 0 || expect(cursor, ':') < 0) {
+                return -1;
+            }
+
+            if (token_is(key, key_len, "method", 0)) {
+                if (parse_string(cursor, arena, &method, &method_len) < 0 || method_len == 0) {
+                    return -1;
+                }
+            } else if (token_is(key, key_len, "path", 0)) {
+                if (parse_string(cursor, arena, &path, &path_len) < 0 || path_len == 0) {
+                    return -1;
+                }
+            } else if (token_is(key, key_len, "headers", 0)) {
+                if (expect(cursor, '{') < 0) {
+                    return -1;
+                }
+                skip_space(cursor);
+                while (cursor->pos < cursor->end && *cursor->pos != '}') {
+                    struct header *header = &headers[header_count];
+
+                    if (header_count == REPLAY_MAX_HEADERS
+                            || parse_string(cursor, arena, &header->name, &header->name_len) < 0
+                            || expect(cursor, ':') < 0
+                            || parse_string(cursor, arena, &header->value, &header->value_len) < 0) {
+                        return -1;
+                    }
+                    // The framing of the body is worked out from the body itself
+                    if (!token_is(header->name, header->name_len, "Content-Length", 1)
+                            && !token_is(header->name, header->name_len, "Transfer-Encoding", 1)) {
+                        has_host |= token_is(header->name, header->name_len, "Host", 1);
+                        header_count++;
+                    }
+                    skip_space(cursor);
+                    if (cursor->pos < cursor->end && *cursor->pos == ',') {
+                        cursor->pos++;
+                        skip_space(cursor);
+                    }
+                }
+                if (expect(cursor, '}') < 0) {
+                    return -1;
+                }
+            } else if (token_is(key, key_len, "body", 0)) {
+                skip_space(cursor);
+                if (cursor->pos < cursor->end && *cursor->pos == '"') {
+                    if (parse_string(cursor, arena, &body, &body_len) < 0) {
+                        return -1;
+                    }
+                } else {
+                    // Any other value is sent as JSON text, straight from the mapping
+                    body = cursor->pos;
+                    if (skip_value(cursor) < 0) {
+                        return -1;
+                    }
+                    body_len = cursor->pos - body;
+                }
+            } else if (skip_value(cursor) < 0) {
+                return -1;
+            }
+
+            skip_space(cursor);
+            if (cursor->pos < cursor->end && *cursor->pos == ',') {
+                cursor->pos++;
+                continue;
+            }
+            if (expect(cursor, '}') < 0) {
+                return -1;
+            }
+            break;
+        }
+    }
+    skip_space(cursor);
+    if (cursor->pos != cursor->end) {
+        return -1;
+    }
+
+    // Measure the head, then build it straight into the arena
+    if (body != NULL) {
+        length_len = snprintf(length, sizeof(length), "%s%zu\r\n", CONTENT_LENGTH, body_len);
+    }
+    head_len = method_len + 1 + path_len + strlen(HTTP_1_1) + 2 + length_len + 2;
+    if (!has_host) {
+        head_len += strlen(HOST) + strlen(host) + 2;
+    }
+    for (int i = 0; i < header_count; i++) {
+        head_len += headers[i].name_len + 2 + headers[i].value_len + 2;
+    }
+
+    request->head = arena_alloc(arena, head_len + 1);
+    out = put(request->head, method, method_len);
+    out = put(out, " ", 1);
+    out = put(out, path, path_len);
+    out = put(out, HTTP_1_1 HTTP_END_OF_LINE, strlen(HTTP_1_1 HTTP_END_OF_LINE));
+    if (!has_host) {
+        out = put(out, HOST, strlen(HOST));
+        out = put(out, host, strlen(host));
+        out = put(out, HTTP_END_OF_LINE, 2);
+    }
+    for (int i = 0; i < header_count; i++) {
+        out = put(out, headers[i].name, headers[i].name_len);
+        out = put(out, ": ", 2);
+        out = put(out, headers[i].value, headers[i].value_len);
+        out = put(out, HTTP_END_OF_LINE, 2);
+    }
+    out = put(out, length, length_len);
+    out = put(out, HTTP_END_OF_LINE, 2);
+    *out = '\0';
+
+    request->head_len = head_len;
+    // The body is never written to, whether it lies in the read-only mapping or in the arena
+    request->body = (char *) body;
+    request->body_len = body_len;
+    request->head_request = token_is(method, method_len, "HEAD", 0);
+    return 0;
+}
+
+/**
+ * Reads a JSONL request file, one request per line.
+ *
+ * @return 0 on success, -1 on error (the reason is printed).
+ */
+static int load_jsonl(struct replay_table *table, const char *path, const char *host) {
+    const char *pos = table->map;
+    const char *end = table->map + table->map_len;
+    size_t capacity = 0;
+    long line = 0;
+
+    while (pos < end) {
+        struct cursor cursor;
+        const char *newline = memchr(pos, '\n', end - pos);
+        struct http_request *request;
+
+        cursor.pos = pos;
+        cursor.end = newline != NULL ? newline : end;
+        pos = cursor.end + 1;
+        line++;
+
+        // Empty lines are allowed
+        skip_space(&cursor);
+        if (cursor.pos == cursor.end) {
+            continue;
+        }
+
+        request = add_request(table, &capacity);
+        if (request == NULL) {
+            printf("Error! Memory allocation failed\n");
+            return -1;
+        }
+        if (parse_json_request(request, &cursor, &table->arena, host) < 0) {
+            printf("Error! %s:%ld: malformed request\n", path, line);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Reads a file of raw HTTP requests. The requests are not copied: their heads and bodies point
+ * into the mapping.
+ *
+ * @return 0 on success, -1 on error (the reason is printed).
+ */
+static int load_raw(struct replay_table *table, const char *path) {
+    const char *pos = table->map;
+    const char *end = table->map + table->map_len;
+    size_t capacity = 0;
+
+    for (;;) {
+        const char *head_end;
+        const char *line;
+        long content_length = 0;
+        struct http_request *request;
+
+        // Requests may be separated by empty lines
+        while (pos < end && (*pos == '\r' || *pos == '\n')) {
+            pos++;
+        }
+        if (pos == end) {
+            break;
+        }
+
+        head_end = memmem(pos, end - pos, "\r\n\r\n", 4);
+        if (head_end == NULL) {
+            printf("Error! %s: request %zu has no end of headers (lines must end with CRLF)\n", path,
+                   table->count + 1);
+            return -1;
+        }
+        head_end += 4;
+
+        // Find the framing of the body among the header lines
+        for (line = (const char *) memchr(pos, '\n', head_end - pos) + 1; line < head_end - 2;
+                line = (const char *) memchr(line, '\n', head_end - line) + 1) {
+            if (strncasecmp(line, "Content-Length:", 15) == 0) {
+                content_length = strtol(line + 15, NULL, 10);
+            } else if (strncasecmp(line, "Transfer-Encoding:", 18) == 0) {
+                printf("Error! %s: request %zu is chunked, only Content-Length is supported\n", path,
+                       table->count + 1);
+                return -1;
+            }
+        }
+        if (content_length < 0 || content_length > end - head_end) {
+            printf("Error! %s: the body of request %zu is cut off\n", path, table->count + 1);
+            return -1;
+        }
+
+        request = add_request(table, &capacity);
+        if (request == NULL) {
+            printf("Error! Memory allocation failed\n");
+            return -1;
+        }
+        // The mapping is never written to
+        request->head = (char *) pos;
+        request->head_len = head_end - pos;
+        request->body = content_length > 0 ? (char *) head_end : NULL;
+        request->body_len = content_length;
+        request->head_request = strncmp(pos, "HEAD ", 5) == 0;
+        pos = head_end + content_length;
+    }
+    return 0;
+}
+
+int replay_load(struct replay_table *table, const char *path, const char *host) {
+    struct stat file_status;
+    const char *first;
+    int fd;
+    int result;
+
+    memset(table, 0, sizeof(*table));
+    arena_init(&table->arena);
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &file_status) < 0) {
+        printf("Error! Cannot open %s: %s\n", path, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -1;
+    }
+    if (file_status.st_size == 0) {
+        printf("Error! %s contains no requests\n", path);
+        close(fd);
+        return -1;
+    }
+
+    // The file is read through the page cache, without copying it into a buffer
+    table->map_len = file_status.st_size;
+    table->map = mmap(NULL, table->map_len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (table->map == MAP_FAILED) {
+        printf("Error! Cannot map %s: %s\n", path, strerror(errno));
+        table->map = NULL;
+        return -1;
+    }
+    madvise(table->map, table->map_len, MADV_SEQUENTIAL);
+
+    // A JSON object starts a JSONL file, anything else is taken for raw HTTP
+    for (first = table->map; first < table->map + table->map_len && strchr(" \t\r\n", *first) != NULL; first++) {
+    }
+    if (first < table->map + table->map_len && *first == '{') {
+        result = load_jsonl(table, path, host);
+    } else {
+        result = load_raw(table, path);
+    }
+    if (result == 0 && table->count == 0) {
+        printf("Error! %s contains no requests\n", path);
+        result = -1;
+    }
+    if (result < 0) {
+        replay_free(table);
+    }
+    return result;
+}
+
+void replay_shuffle(struct replay_table *table, unsigned long long seed) {
+    // xorshift64*: small, fast and good enough to pick an order
+    unsigned long long state = seed != 0 ? seed : 0x9E3779B97F4A7C15ULL;
+
+    for (size_t i = table->count; i > 1; i--) {
+        struct http_request swap;
+        size_t j;
+
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        j = (state * 0x2545F4914F6CDD1DULL) % i;
+
+        swap = table->requests[i - 1];
+        table->requests[i - 1] = table->requests[j];
+        table->requests[j] = swap;
+    }
+}
+
+void replay_free(struct replay_table *table) {
+    if (table->map != NULL) {
+        munmap(table->map, table->map_len);
+    }
+    free(table->requests);
+    arena_destroy(&table->arena);
+    table->map = NULL;
+    table->requests = NULL;
+    table->count = 0;
+}
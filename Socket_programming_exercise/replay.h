@@ -0,0 +1,62 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stddef.h>
+#include "arena.h"
+#include "request.h"
+
+// Most headers a JSONL request may carry
+#define REPLAY_MAX_HEADERS 64
+
+/**
+ * Requests read from a request file, ready to be sent.
+ *
+ * The file is memory-mapped and parsed once, before the run: every request is kept as a head and
+ * a body that point into the mapping (raw HTTP) or into the table's arena (JSONL), so sending a
+ * request from the table costs no parsing, formatting or copying.
+ */
+struct replay_table {
+    struct http_request *requests;    // Requests in replay order
+    size_t count;                     // Number of requests
+    char *map;                        // The mapped request file
+    size_t map_len;                   // Length of the mapping
+    struct arena arena;               // Heads and unescaped bodies of JSONL requests
+};
+
+/**
+ * Loads a request file into a table.
+ *
+ * Two formats are understood, told apart by the first character of the file:
+ *
+ * - JSONL: one JSON object per line, e.g.
+ *   {"method": "POST", "path": "/api", "headers": {"Content-Type": "application/json"}, "body": {"a": 1}}
+ *   "method" defaults to GET and "path" to /. A string body is sent unescaped, any other JSON value
+ *   as its JSON text. A Host header is added unless the headers set one; Content-Length is always
+ *   worked out from the body.
+ * - Raw HTTP: complete requests one after the other (CRLF line ends), e.g. a traffic capture.
+ *   They are sent byte for byte; a body must be framed by Content-Length.
+ *
+ * @param table The table to fill in.
+ * @param path The request file.
+ * @param host The host put in the Host header of JSONL requests.
+ *
+ * @return 0 on success, -1 if the file cannot be read or is malformed (the reason is printed).
+ */
+int replay_load(struct replay_table *table, const char *path, const char *host);
+
+/**
+ * Puts the requests of a table in a random order (Fisher-Yates).
+ *
+ * @param table The table.
+ * @param seed Seed of the random order: the same seed gives the same order.
+ */
+void replay_shuffle(struct replay_table *table, unsigned long long seed);
+
+/**
+ * Unmaps the request file and frees the table.
+ *
+ * @param table The table.
+ */
+void replay_free(struct replay_table *table);
+
+#endif // REPLAY_H
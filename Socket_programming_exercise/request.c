@@ -0,0 +1,259 @@
+// Include libraries
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/sendfile.h>
+#include <poll.h>
+#include "arena.h"
+#include "request.h"
+
+char * format_http_head(struct arena *arena, const char *method, const char *endpoint, const char *host,
+                        long content_length) {
+    // Variable to save the request
+    char *request;
+    // request size is saved in this variable
+    int request_size;
+    // Header that frames the body ("Content-Length: 42" or "Transfer-Encoding: chunked")
+    char framing[sizeof(CONTENT_LENGTH) + 24];
+
+    // The body is announced by its length, chunk by chunk, or not at all
+    if (content_length == CHUNKED_BODY) {
+        snprintf(framing, sizeof(framing), "%s", TRANSFER_ENCODING_CHUNKED);
+    } else if (content_length >= 0) {
+        snprintf(framing, sizeof(framing), "%s%ld", CONTENT_LENGTH, content_length);
+    }
+
+    // Measure the head, then build it straight into the arena
+    if (content_length == NO_BODY) {
+        request_size = snprintf(NULL, 0, "%s%s%s\r\n%s%s\r\n%s\r\n\r\n", method, endpoint, HTTP_1_1, HOST, host,
+            ACCEPT) + 1;
+        request = arena_alloc(arena, request_size);
+        snprintf(request, request_size, "%s%s%s\r\n%s%s\r\n%s\r\n\r\n", method, endpoint, HTTP_1_1, HOST, host, ACCEPT);
+    } else {
+        request_size = snprintf(NULL, 0, "%s%s%s\r\n%s%s\r\n%s\r\n%s\r\n\r\n", method, endpoint, HTTP_1_1, HOST,
+            host, CONTENT_TYPE, framing) + 1;
+        request = arena_alloc(arena, request_size);
+        // The body is sent right after the head, not copied in
+        snprintf(request, request_size, "%s%s%s\r\n%s%s\r\n%s\r\n%s\r\n\r\n", method, endpoint, HTTP_1_1, HOST, host,
+            CONTENT_TYPE, framing);
+    }
+
+    // Return the head
+    return request;
+}
+
+int prepare_http_request(struct http_request *request, struct arena *arena, const char *method,
+                         const char *endpoint, const char *host, char *body) {
+    // File status, used for the size of a file body
+    struct stat file_status;
+
+    request->body = NULL;
+    request->body_len = 0;
+    request->body_fd = -1;
+    request->chunked = 0;
+    request->head_request = 0;
+
+    if (body != NULL && body[0] == '@') {
+        // The body is the content of a file
+        request->body_fd = open(body + 1, O_RDONLY);
+        if (request->body_fd < 0 || fstat(request->body_fd, &file_status) < 0) {
+            printf("Error! Cannot open body file %s: %s\n", body + 1, strerror(errno));
+            if (request->body_fd >= 0) {
+                close(request->body_fd);
+            }
+            request->body_fd = -1;
+            return -1;
+        }
+        // Only regular files have a size known up front, anything else is streamed
+        if (S_ISREG(file_status.st_mode)) {
+            request->body_len = file_status.st_size;
+        } else {
+            request->chunked = 1;
+        }
+    } else if (body != NULL) {
+        request->body = body;
+        request->body_len = strlen(body);
+    }
+
+    if (body == NULL) {
+        request->head = format_http_head(arena, method, endpoint, host, NO_BODY);
+    } else if (request->chunked) {
+        request->head = format_http_head(arena, method, endpoint, host, CHUNKED_BODY);
+    } else {
+        request->head = format_http_head(arena, method, endpoint, host, (long) request->body_len);
+    }
+    request->head_len = strlen(request->head);
+    return 0;
+}
+
+int send_http_request_part(int sockfd, const struct http_request *request, size_t *sent) {
+    // Total number of bytes of the request
+    size_t total = request->head_len + request->body_len;
+    // Number of bytes written by one call
+    ssize_t written;
+
+    while (*sent < total) {
+        if (request->body_fd >= 0 && *sent >= request->head_len) {
+            // File body: the kernel copies straight from the page cache to the socket
+            off_t offset = *sent - request->head_len;
+            written = sendfile(sockfd, request->body_fd, &offset, total - *sent);
+            if (written == 0) {
+                errno = EIO;  // The file shrank since its size was taken
+                return -1;
+            }
+        } else {
+            // Head and in-memory body: one gather write, resumed where the last one stopped
+            struct iovec iov[2];
+            struct msghdr message;
+            int flags = MSG_NOSIGNAL;
+
+            memset(&message, 0, sizeof(message));
+            message.msg_iov = iov;
+            if (*sent < request->head_len) {
+                iov[0].iov_base = request->head + *sent;
+                iov[0].iov_len = request->head_len - *sent;
+                iov[1].iov_base = request->body;
+                iov[1].iov_len = request->body != NULL ? request->body_len : 0;
+                message.msg_iovlen = request->body != NULL ? 2 : 1;
+                if (request->body_fd >= 0) {
+                    flags |= MSG_MORE;  // The file follows, do not send the head on its own
+                }
+            } else {
+                iov[0].iov_base = request->body + (*sent - request->head_len);
+                iov[0].iov_len = total - *sent;
+                message.msg_iovlen = 1;
+            }
+            written = sendmsg(sockfd, &message, flags);
+        }
+
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return 0;
+            }
+            return -1;
+        }
+        *sent += written;
+    }
+    return 1;
+}
+
+/**
+ * Sends a series of buffers completely, waiting for the non-blocking socket whenever its buffer is
+ * full.
+ *
+ * @return 0 on success, -1 on error or timeout.
+ */
+static int send_buffers(int sockfd, struct iovec *iov, int count, int more, int timeout_ms) {
+    struct msghdr message;
+    struct pollfd fd;
+    ssize_t written;
+
+    fd.fd = sockfd;
+    fd.events = POLLOUT;
+
+    while (count > 0) {
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        message.msg_iovlen = count;
+
+        written = sendmsg(sockfd, &message, MSG_NOSIGNAL | (more ? MSG_MORE : 0));
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return -1;
+            }
+            if (poll(&fd, 1, timeout_ms) <= 0) {
+                errno = ETIMEDOUT;
+                return -1;
+            }
+            continue;
+        }
+
+        // Skip the buffers that went out completely, trim the partial one
+        while (count > 0 && (size_t) written >= iov->iov_len) {
+            written -= iov->iov_len;
+            iov++;
+            count--;
+        }
+        if (count > 0) {
+            iov->iov_base = (char *) iov->iov_base + written;
+            iov->iov_len -= written;
+        }
+    }
+    return 0;
+}
+
+int send_chunked_body(int sockfd, const struct http_request *request, int timeout_ms) {
+    // The only copy of the body that is ever held in memory
+    static char block[STREAM_BLOCK];
+    // Chunk size line ("1f4\r\n")
+    char size_line[32];
+    // Chunk framing around the block: size line, data, CRLF
+    struct iovec iov[3];
+    // Number of bytes read from the stream
+    ssize_t bytes_read;
+
+    for (;;) {
+        bytes_read = read(request->body_fd, block, STREAM_BLOCK);
+        if (bytes_read < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        if (bytes_read == 0) {
+            break;  // EOF
+        }
+
+        iov[0].iov_base = size_line;
+        iov[0].iov_len = snprintf(size_line, sizeof(size_line), "%zx\r\n", (size_t) bytes_read);
+        iov[1].iov_base = block;
+        iov[1].iov_len = bytes_read;
+        iov[2].iov_base = HTTP_END_OF_LINE;
+        iov[2].iov_len = 2;
+        if (send_buffers(sockfd, iov, 3, 1, timeout_ms) < 0) {
+            return -1;
+        }
+    }
+
+    // The last chunk is empty and has no trailers
+    iov[0].iov_base = "0\r\n\r\n";
+    iov[0].iov_len = 5;
+    return send_buffers(sockfd, iov, 1, 0, timeout_ms);
+}
+
+void free_http_request(struct http_request *request) {
+    if (request->body_fd >= 0) {
+        close(request->body_fd);
+    }
+    request->head = NULL;
+    request->body = NULL;
+    request->body_fd = -1;
+}
+
+const char * http_method_from_name(const char *name) {
+    // Supported methods, in the same order as the interactive menu
+    static const char *methods[] = {GET, POST, PUT, PATCH, DELETE};
+    size_t i;
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        // Definitions carry a trailing space ("GET "), compare without it
+        size_t len = strlen(methods[i]) - 1;
+        if (strlen(name) == len && strncasecmp(name, methods[i], len) == 0) {
+            return methods[i];
+        }
+    }
+    return NULL;
+}
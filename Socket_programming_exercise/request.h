@@ -0,0 +1,124 @@
+#ifndef REQUEST_H
+#define REQUEST_H
+
+// Definition section
+#define CONTENT_TYPE "Content-Type: text/plain"
+#define ACCEPT "Accept: */*"
+#define CONTENT_LENGTH "Content-Length: "
+#define HTTP_END_OF_LINE "\r\n"
+#define POST "POST "
+#define GET "GET "
+#define HTTP_1_1 " HTTP/1.1"
+#define PATCH "PATCH "
+#define DELETE "DELETE "
+#define PUT "PUT "
+#define HOST "Host: "
+#define TRANSFER_ENCODING_CHUNKED "Transfer-Encoding: chunked"
+#define STREAM_BLOCK 65536
+
+// Special content lengths understood by format_http_head()
+#define NO_BODY -1
+#define CHUNKED_BODY -2
+
+#include <stddef.h>
+#include "arena.h"
+
+/**
+ * An HTTP request, kept as separate pieces so it can be sent with a single gather write (or
+ * writev + sendfile for a file body) instead of being copied into one buffer first.
+ */
+struct http_request {
+    char *head;          // Request line and headers, including the empty line
+    size_t head_len;     // Length of the head
+    char *body;          // Body kept in memory, or NULL
+    size_t body_len;     // Length of the body, in memory or in the file
+    int body_fd;         // File the body is sent from, or -1
+    int chunked;         // body_fd is a stream (pipe, FIFO, ...) sent chunked until EOF
+    int head_request;    // HEAD request: the response has no body, whatever its headers say
+};
+
+/**
+ * Formats the head (request line and headers) of an HTTP/1.1 request.
+ *
+ * @param arena The arena the head is allocated from.
+ * @param method One of the method definitions above (e.g. GET, POST).
+ * @param endpoint The path the request is sent to (e.g. "/users").
+ * @param host The host (server) to which the request is to be sent.
+ * @param content_length The length of the body, NO_BODY for a request without a body or
+ *                       CHUNKED_BODY for a body sent with the chunked transfer encoding.
+ *
+ * @return The head as a null-terminated string, allocated from `arena`.
+ *
+ * @note If memory allocation fails, the program will exit with an error message.
+ */
+char * format_http_head(struct arena *arena, const char *method, const char *endpoint, const char *host,
+                        long content_length);
+
+/**
+ * Prepares an HTTP/1.1 request.
+ *
+ * @param request The request to fill in.
+ * @param arena The arena the head is allocated from. The request is valid until the arena is
+ *              reset.
+ * @param method One of the method definitions above (e.g. GET, POST).
+ * @param endpoint The path the request is sent to (e.g. "/users").
+ * @param host The host (server) to which the request is to be sent.
+ * @param body The request body, or NULL for a request without a body. A body of the form
+ *             "@path" is sent from the file at `path` with sendfile(), without ever being read
+ *             into memory. If `path` is not a regular file (a pipe, a FIFO, /dev/stdin, ...)
+ *             its size is unknown: the body is then streamed with the chunked transfer
+ *             encoding by send_chunked_body(). The body must live as long as the
+ *             request, e.g. by being allocated from the same arena.
+ *
+ * @return 0 on success, -1 if the body file cannot be opened (the reason is printed).
+ */
+int prepare_http_request(struct http_request *request, struct arena *arena, const char *method,
+                         const char *endpoint, const char *host, char *body);
+
+/**
+ * Sends as much of a request as the socket accepts.
+ *
+ * The head and an in-memory body go out in one gather write, a file body follows with
+ * sendfile(). Partial writes are resumed from `sent` on the next call.
+ *
+ * @param sockfd The socket file descriptor of the connection to the server.
+ * @param request The request to send.
+ * @param sent Number of request bytes already sent, updated by the call.
+ *
+ * @return 1 once the whole request is sent, 0 if the (non-blocking) socket cannot take more
+ *         data right now, -1 on error (errno is set).
+ */
+int send_http_request_part(int sockfd, const struct http_request *request, size_t *sent);
+
+/**
+ * Streams the body of a chunked request.
+ *
+ * Reads the stream in blocks of STREAM_BLOCK bytes and sends every block as a chunk as soon as it
+ * was read, so memory use stays flat however long the stream is, and the server gets the first
+ * bytes before the producer of the stream has finished. Call it after the head was sent.
+ *
+ * @param sockfd The socket file descriptor of the connection to the server.
+ * @param request The request, its `body_fd` is read until EOF.
+ * @param timeout_ms How long to wait for room in the socket buffer.
+ *
+ * @return 0 on success, -1 on error or timeout (errno is set).
+ */
+int send_chunked_body(int sockfd, const struct http_request *request, int timeout_ms);
+
+/**
+ * Closes the file held by a request. Its memory belongs to the arena it was prepared with.
+ *
+ * @param request The request.
+ */
+void free_http_request(struct http_request *request);
+
+/**
+ * Looks up the method definition for a method name given on the command line.
+ *
+ * @param name The method name, e.g. "GET" or "post".
+ *
+ * @return The matching method definition, or NULL if the method is not supported.
+ */
+const char * http_method_from_name(const char *name);
+
+#endif // REQUEST_H
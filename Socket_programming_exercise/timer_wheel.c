@@ -0,0 +1,205 @@
+// Include libraries
+#include <stddef.h>
+#include "timer_wheel.h"
+
+// Definition section
+#define SLOT_MASK (TIMER_WHEEL_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * TIMER_WHEEL_BITS)
+// Farthest a timer can be placed ahead; a later one waits on the last level and is placed again
+#define MAX_AHEAD ((1ULL << LEVEL_SHIFT(TIMER_WHEEL_LEVELS)) - 1)
+
+/**
+ * Makes an empty circular list out of a slot head.
+ */
+static void list_init(struct timer *head) {
+    head->next = head;
+    head->prev = head;
+}
+
+/**
+ * Links a timer into the slot that covers its expiry time, seen from the wheel's current tick.
+ */
+static void link_timer(struct timer_wheel *wheel, struct timer *timer) {
+    unsigned long long expires = timer->expires;
+    unsigned long long delta;
+    struct timer *head;
+    int level = 0;
+    int slot;
+
+    // Overdue timers fire on the next tick, far ones wait on the last level
+    if (expires < wheel->now) {
+        expires = wheel->now;
+    }
+    delta = expires - wheel->now;
+    if (delta > MAX_AHEAD) {
+        expires = wheel->now + MAX_AHEAD;
+        delta = MAX_AHEAD;
+    }
+    while (level < TIMER_WHEEL_LEVELS - 1 && delta >= 1ULL << LEVEL_SHIFT(level + 1)) {
+        level++;
+    }
+
+    slot = (int) ((expires >> LEVEL_SHIFT(level)) & SLOT_MASK);
+    head = &wheel->slots[level][slot];
+    timer->next = head;
+    timer->prev = head->prev;
+    head->prev->next = timer;
+    head->prev = timer;
+    timer->slot = level * TIMER_WHEEL_SLOTS + slot;
+    wheel->occupied[level] |= 1ULL << slot;
+}
+
+/**
+ * Unlinks a pending timer from its slot.
+ */
+static void unlink_timer(struct timer_wheel *wheel, struct timer *timer) {
+    int level = timer->slot / TIMER_WHEEL_SLOTS;
+    int slot = timer->slot % TIMER_WHEEL_SLOTS;
+    struct timer *head = &wheel->slots[level][slot];
+
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->next = NULL;
+    timer->prev = NULL;
+    if (head->next == head) {
+        wheel->occupied[level] &= ~(1ULL << slot);
+    }
+}
+
+/**
+ * Moves the timers of a slot to `list` and empties the slot.
+ */
+static void take_slot(struct timer_wheel *wheel, int level, int slot, struct timer *list) {
+    struct timer *head = &wheel->slots[level][slot];
+
+    list_init(list);
+    if (head->next != head) {
+        list->next = head->next;
+        list->prev = head->prev;
+        list->next->prev = list;
+        list->prev->next = list;
+        list_init(head);
+    }
+    wheel->occupied[level] &= ~(1ULL << slot);
+}
+
+void timer_wheel_init(struct timer_wheel *wheel, unsigned long long now) {
+    wheel->now = now;
+    wheel->count = 0;
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        wheel->occupied[level] = 0;
+        for (int slot = 0; slot < TIMER_WHEEL_SLOTS; slot++) {
+            list_init(&wheel->slots[level][slot]);
+        }
+    }
+}
+
+void timer_init(struct timer *timer, int owner, int kind) {
+    timer->next = NULL;
+    timer->prev = NULL;
+    timer->expires = 0;
+    timer->slot = 0;
+    timer->owner = owner;
+    timer->kind = kind;
+}
+
+int timer_pending(const struct timer *timer) {
+    return timer->next != NULL;
+}
+
+void timer_wheel_add(struct timer_wheel *wheel, struct timer *timer, unsigned long long expires) {
+    if (timer_pending(timer)) {
+        unlink_timer(wheel, timer);
+    } else {
+        wheel->count++;
+    }
+    timer->expires = expires;
+    link_timer(wheel, timer);
+}
+
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer *timer) {
+    if (timer_pending(timer)) {
+        unlink_timer(wheel, timer);
+        wheel->count--;
+    }
+}
+
+long long timer_wheel_next(const struct timer_wheel *wheel) {
+    unsigned long long best = 0;
+    int found = 0;
+
+    if (wheel->count == 0) {
+        return -1;
+    }
+    for (int level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        int shift = LEVEL_SHIFT(level);
+        unsigned long long block = wheel->now >> shift;
+        unsigned long long map = wheel->occupied[level];
+        int index = (int) (block & SLOT_MASK);
+        int first = index;
+        unsigned long long rotated;
+        unsigned long long tick;
+
+        if (map == 0) {
+            continue;
+        }
+        // The current slot of a level is due now only if its block has not started yet;
+        // otherwise it holds timers of the next round of the level
+        if ((wheel->now & ((1ULL << shift) - 1)) != 0) {
+            first = index + 1;
+        }
+        rotated = first & SLOT_MASK ? map >> (first & SLOT_MASK) | map << (TIMER_WHEEL_SLOTS - (first & SLOT_MASK))
+                                    : map;
+        tick = (block + (first - index) + __builtin_ctzll(rotated)) << shift;
+        if (!found || tick < best) {
+            best = tick;
+            found = 1;
+        }
+    }
+    return (long long) best;
+}
+
+void timer_wheel_advance(struct timer_wheel *wheel, unsigned long long now, timer_callback callback, void *ctx) {
+    for (;;) {
+        long long next = timer_wheel_next(wheel);
+        unsigned long long tick;
+        struct timer due;
+
+        // Nothing happens until after `now`: jump there
+        if (next < 0 || (unsigned long long) next > now) {
+            if (now + 1 > wheel->now) {
+                wheel->now = now + 1;
+            }
+            return;
+        }
+        tick = (unsigned long long) next;
+        wheel->now = tick;
+
+        // At the start of a block of a higher level, its timers move down a level (or more)
+        for (int level = 1; level < TIMER_WHEEL_LEVELS && (tick & ((1ULL << LEVEL_SHIFT(level)) - 1)) == 0;
+                level++) {
+            struct timer moved;
+
+            take_slot(wheel, level, (int) ((tick >> LEVEL_SHIFT(level)) & SLOT_MASK), &moved);
+            while (moved.next != &moved) {
+                struct timer *timer = moved.next;
+                moved.next = timer->next;
+                timer->next->prev = &moved;
+                link_timer(wheel, timer);
+            }
+        }
+
+        // Fire this tick's timers; ones added by the callbacks land on later ticks
+        take_slot(wheel, 0, (int) (tick & SLOT_MASK), &due);
+        wheel->now = tick + 1;
+        while (due.next != &due) {
+            struct timer *timer = due.next;
+            due.next = timer->next;
+            timer->next->prev = &due;
+            timer->next = NULL;
+            timer->prev = NULL;
+            wheel->count--;
+            callback(ctx, timer);
+        }
+    }
+}
@@ -0,0 +1,86 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+// Slots per level of the wheel (6 bits of the expiry time per level)
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_BITS)
+// Levels: timers up to 2^(LEVELS * BITS) ticks ahead are told apart (at 1 ms per tick, 4.6 hours)
+#define TIMER_WHEEL_LEVELS 4
+
+/**
+ * A timer, embedded in whatever it times. It is linked into a slot of the wheel while pending.
+ */
+struct timer {
+    struct timer *next;         // Neighbours in the slot list, NULL while not pending
+    struct timer *prev;
+    unsigned long long expires; // Tick at which the timer fires
+    int slot;                   // Level * TIMER_WHEEL_SLOTS + slot it is linked into
+    int owner;                  // Free for the user: what the timer belongs to
+    int kind;                   // Free for the user: what the timer is for
+};
+
+/**
+ * Hierarchical timer wheel.
+ *
+ * Level 0 has one slot per tick for the next TIMER_WHEEL_SLOTS ticks; every further level covers
+ * TIMER_WHEEL_SLOTS times the range of the one below with slots just as much wider. A timer is
+ * linked into the slot that covers its expiry time, so adding and cancelling it is O(1) however
+ * many timers are pending. When the wheel reaches the start of a slot on a higher level, the
+ * timers of that slot are moved down (cascaded) to the level that covers them now, and level 0
+ * fires its timers tick by tick. A bit map of the occupied slots lets the wheel skip empty
+ * stretches and tell the earliest tick at which anything can happen.
+ */
+struct timer_wheel {
+    unsigned long long now;     // Next tick to be processed
+    unsigned long long occupied[TIMER_WHEEL_LEVELS];// Bit i set: slot i of that level is not empty
+    struct timer slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];// Heads of the circular slot lists
+    long count;                 // Number of pending timers
+};
+
+/**
+ * Called for every timer that fires. The timer is no longer pending; the callback may add or
+ * cancel any timer, including this one.
+ */
+typedef void (*timer_callback)(void *ctx, struct timer *timer);
+
+/**
+ * Creates an empty wheel whose time starts at tick `now`.
+ */
+void timer_wheel_init(struct timer_wheel *wheel, unsigned long long now);
+
+/**
+ * Prepares a timer that is not pending.
+ *
+ * @param owner Stored in the timer for the callback.
+ * @param kind Stored in the timer for the callback.
+ */
+void timer_init(struct timer *timer, int owner, int kind);
+
+/**
+ * @return Non-zero if the timer is pending.
+ */
+int timer_pending(const struct timer *timer);
+
+/**
+ * (Re)schedules a timer to fire at tick `expires`; a pending timer is moved. A time that has
+ * already passed fires on the next advance.
+ */
+void timer_wheel_add(struct timer_wheel *wheel, struct timer *timer, unsigned long long expires);
+
+/**
+ * Cancels a timer. Does nothing if it is not pending.
+ */
+void timer_wheel_cancel(struct timer_wheel *wheel, struct timer *timer);
+
+/**
+ * Fires every timer that expires at or before tick `now`, in order of expiry.
+ */
+void timer_wheel_advance(struct timer_wheel *wheel, unsigned long long now, timer_callback callback, void *ctx);
+
+/**
+ * @return The earliest tick at which the wheel has work (a timer fires or is cascaded), or -1 if
+ *         no timer is pending. Waiting until then never misses an expiry.
+ */
+long long timer_wheel_next(const struct timer_wheel *wheel);
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,227 @@
+// Include libraries
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "uring.h"
+
+// Buffer group the provided buffers are registered as
+#define BUFFER_GROUP 0
+
+/**
+ * Reads a value the kernel writes (ring indexes): nothing after it may be read before it.
+ */
+static unsigned load_acquire(const unsigned *p) {
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Publishes a value to the kernel: everything before it is visible before it.
+ */
+static void store_release(unsigned *p, unsigned value) {
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+int uring_init(struct uring *ring, unsigned entries) {
+    static const unsigned setup_flags[] = {
+        IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN,
+        IORING_SETUP_COOP_TASKRUN,
+        0
+    };
+    struct io_uring_params params;
+    unsigned char *sq;
+    unsigned char *cq;
+
+    memset(ring, 0, sizeof(*ring));
+    // Completion work runs only when the (single) submitting thread waits for it, not in
+    // interrupts of whatever it is doing (Linux 6.1); older kernels get a plain instance
+    for (int i = 0; i < 3; i++) {
+        memset(&params, 0, sizeof(params));
+        params.flags = setup_flags[i];
+        ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+        if (ring->fd >= 0 || errno != EINVAL) {
+            break;
+        }
+    }
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return -1;
+    }
+
+    // Map the submission ring, the completion ring (often the same mapping) and the entries
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) {
+            ring->sq_ring_size = ring->cq_ring_size;
+        }
+        ring->cq_ring_size = 0;
+    }
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                         ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        ring->sq_ring = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+    if (ring->cq_ring_size > 0) {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                             ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            ring->cq_ring = NULL;
+            uring_destroy(ring);
+            return -1;
+        }
+    }
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        ring->sqes = NULL;
+        uring_destroy(ring);
+        return -1;
+    }
+
+    sq = ring->sq_ring;
+    cq = ring->cq_ring != NULL ? ring->cq_ring : ring->sq_ring;
+    ring->sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring->sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring->sq_array = (unsigned *) (sq + params.sq_off.array);
+    ring->sq_mask = *(unsigned *) (sq + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring->cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring->cq_mask = *(unsigned *) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    // Entry i of the ring always uses SQE i
+    for (unsigned i = 0; i < ring->sq_entries; i++) {
+        ring->sq_array[i] = i;
+    }
+    return 0;
+}
+
+int uring_init_buffers(struct uring *ring, unsigned count, size_t size) {
+    struct io_uring_buf_reg reg;
+
+    ring->buf_ring_size = count * sizeof(struct io_uring_buf);
+    ring->buf_ring = mmap(NULL, ring->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (ring->buf_ring == MAP_FAILED) {
+        ring->buf_ring = NULL;
+        return -1;
+    }
+    ring->buffers = malloc(count * size);
+    if (ring->buffers == NULL) {
+        return -1;
+    }
+    ring->buf_count = count;
+    ring->buf_size = size;
+
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (unsigned long) ring->buf_ring;
+    reg.ring_entries = count;
+    reg.bgid = BUFFER_GROUP;
+    if (syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        return -1;
+    }
+
+    // Every buffer starts out free
+    for (unsigned id = 0; id < count; id++) {
+        uring_recycle(ring, id);
+    }
+    return 0;
+}
+
+struct io_uring_sqe * uring_get_sqe(struct uring *ring) {
+    unsigned tail = *ring->sq_tail + ring->sq_pending;
+    struct io_uring_sqe *sqe;
+
+    if (tail - load_acquire(ring->sq_head) >= ring->sq_entries) {
+        // Full: hand the queued entries to the kernel without waiting for anything
+        if (uring_wait(ring, 0) < 0 && errno != EINTR) {
+            return NULL;
+        }
+        tail = *ring->sq_tail + ring->sq_pending;
+        if (tail - load_acquire(ring->sq_head) >= ring->sq_entries) {
+            return NULL;
+        }
+    }
+    sqe = &ring->sqes[tail & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sq_pending++;
+    return sqe;
+}
+
+int uring_wait(struct uring *ring, long long timeout_ns) {
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    unsigned submit = ring->sq_pending;
+    unsigned flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    long ret;
+
+    // Publish the new entries, the kernel reads them during the call
+    store_release(ring->sq_tail, *ring->sq_tail + ring->sq_pending);
+    ring->sq_pending = 0;
+
+    ts.tv_sec = timeout_ns / 1000000000LL;
+    ts.tv_nsec = timeout_ns % 1000000000LL;
+    memset(&arg, 0, sizeof(arg));
+    arg.ts = (unsigned long) &ts;
+    ring->enters++;
+    ret = syscall(__NR_io_uring_enter, ring->fd, submit, timeout_ns > 0 ? 1 : 0, flags, &arg, sizeof(arg));
+    if (ret < 0 && errno != ETIME) {
+        return -1;
+    }
+    return 0;
+}
+
+struct io_uring_cqe * uring_peek(struct uring *ring) {
+    unsigned head = *ring->cq_head;
+
+    if (head == load_acquire(ring->cq_tail)) {
+        return NULL;
+    }
+    return &ring->cqes[head & ring->cq_mask];
+}
+
+void uring_advance(struct uring *ring) {
+    store_release(ring->cq_head, *ring->cq_head + 1);
+}
+
+char * uring_buffer(struct uring *ring, unsigned id) {
+    return ring->buffers + (size_t) id * ring->buf_size;
+}
+
+void uring_recycle(struct uring *ring, unsigned id) {
+    unsigned short tail = ring->buf_ring->tail;
+    struct io_uring_buf *buf = &ring->buf_ring->bufs[tail & (ring->buf_count - 1)];
+
+    buf->addr = (unsigned long) uring_buffer(ring, id);
+    buf->len = ring->buf_size;
+    buf->bid = id;
+    __atomic_store_n(&ring->buf_ring->tail, (unsigned short) (tail + 1), __ATOMIC_RELEASE);
+}
+
+void uring_destroy(struct uring *ring) {
+    if (ring->fd >= 0) {
+        close(ring->fd);
+        ring->fd = -1;
+    }
+    if (ring->sqes != NULL) {
+        munmap(ring->sqes, ring->sqes_size);
+    }
+    if (ring->cq_ring != NULL) {
+        munmap(ring->cq_ring, ring->cq_ring_size);
+    }
+    if (ring->sq_ring != NULL) {
+        munmap(ring->sq_ring, ring->sq_ring_size);
+    }
+    if (ring->buf_ring != NULL) {
+        munmap(ring->buf_ring, ring->buf_ring_size);
+    }
+    free(ring->buffers);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
@@ -0,0 +1,108 @@
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#include <linux/io_uring.h>
+
+/**
+ * Minimal io_uring instance, set up with the raw system calls (no liburing).
+ *
+ * Operations are described in submission queue entries (SQEs) that are only handed to the kernel
+ * by the next uring_wait(), so one system call submits a whole batch of connects, sends and
+ * receives and collects the completions (CQEs) of earlier ones at the same time.
+ *
+ * Receives use a ring of provided buffers registered with the kernel: a receive does not name a
+ * buffer, the kernel picks a free one from the ring when data arrives and names it in the
+ * completion. Together with multishot receives, which keep producing completions until they are
+ * cancelled, a connection needs a single submission for all of its responses and idle
+ * connections hold no buffer at all.
+ */
+struct uring {
+    int fd;                            // The io_uring file descriptor, -1 if not set up
+    // Submission queue, shared with the kernel
+    unsigned *sq_head;
+    unsigned *sq_tail;
+    unsigned *sq_array;
+    unsigned sq_mask;
+    unsigned sq_entries;
+    unsigned sq_pending;               // Entries filled in but not submitted yet
+    struct io_uring_sqe *sqes;
+    // Completion queue, shared with the kernel
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned cq_mask;
+    struct io_uring_cqe *cqes;
+    // Mappings of the rings
+    void *sq_ring;
+    size_t sq_ring_size;
+    void *cq_ring;
+    size_t cq_ring_size;
+    size_t sqes_size;
+    // Provided buffers (buffer group 0)
+    struct io_uring_buf_ring *buf_ring;// Ring of free buffers, shared with the kernel
+    size_t buf_ring_size;
+    char *buffers;                     // Memory of the buffers
+    unsigned buf_count;                // Number of buffers, a power of two
+    size_t buf_size;                   // Size of every buffer
+    unsigned long long enters;         // io_uring_enter() calls made
+};
+
+/**
+ * Creates an io_uring instance.
+ *
+ * @param entries Size of the submission queue (rounded up to a power of two by the kernel).
+ * @return 0 on success, -1 if io_uring is not available (errno is set).
+ */
+int uring_init(struct uring *ring, unsigned entries);
+
+/**
+ * Registers a ring of `count` provided buffers of `size` bytes as buffer group 0.
+ *
+ * @param count Number of buffers, a power of two.
+ * @return 0 on success, -1 if the kernel does not support buffer rings (errno is set).
+ */
+int uring_init_buffers(struct uring *ring, unsigned count, size_t size);
+
+/**
+ * Returns a cleared submission queue entry, submitting the queued ones first if the queue is
+ * full.
+ *
+ * @return The entry, or NULL if the queue is full and could not be submitted.
+ */
+struct io_uring_sqe * uring_get_sqe(struct uring *ring);
+
+/**
+ * Submits the queued entries and waits until at least one completion is available or
+ * `timeout_ns` nanoseconds have passed, all in one system call.
+ *
+ * @param timeout_ns How long to wait, 0 to only submit and collect what is there.
+ * @return 0 on success (or time out), -1 on error (errno is set; EINTR may be retried).
+ */
+int uring_wait(struct uring *ring, long long timeout_ns);
+
+/**
+ * @return The oldest unseen completion, or NULL if there is none.
+ */
+struct io_uring_cqe * uring_peek(struct uring *ring);
+
+/**
+ * Marks the completion returned by uring_peek() as seen.
+ */
+void uring_advance(struct uring *ring);
+
+/**
+ * @return The memory of provided buffer `id`.
+ */
+char * uring_buffer(struct uring *ring, unsigned id);
+
+/**
+ * Gives provided buffer `id` back to the kernel once its data has been consumed.
+ */
+void uring_recycle(struct uring *ring, unsigned id);
+
+/**
+ * Unmaps the rings, frees the buffers and closes the instance.
+ */
+void uring_destroy(struct uring *ring);
+
+#endif // URING_H
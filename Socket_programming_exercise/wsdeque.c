@@ -0,0 +1,91 @@
+// Include libraries
+#include <stdlib.h>
+#include "wsdeque.h"
+
+// The memory orderings follow "Correct and Efficient Work-Stealing for Weak Memory Models"
+// (Lê, Pop, Cohen, Zappa Nardelli, PPoPP 2013).
+
+int wsdeque_init(struct wsdeque *deque, long capacity) {
+    long size = 1;
+
+    // Round up to a power of two so that the ring index is a mask
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    deque->items = malloc(size * sizeof(*deque->items));
+    if (deque->items == NULL) {
+        return -1;
+    }
+    deque->capacity = size;
+    atomic_init(&deque->top, 0);
+    atomic_init(&deque->bottom, 0);
+    return 0;
+}
+
+void wsdeque_destroy(struct wsdeque *deque) {
+    free(deque->items);
+    deque->items = NULL;
+}
+
+int wsdeque_push(struct wsdeque *deque, long item) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+
+    if (bottom - top >= deque->capacity) {
+        return -1;
+    }
+
+    atomic_store_explicit(&deque->items[bottom & (deque->capacity - 1)], item, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return 0;
+}
+
+long wsdeque_take(struct wsdeque *deque) {
+    long bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    long top;
+    long item;
+
+    // Reserve the bottom item before looking at `top`, thieves see the reservation
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if (top > bottom) {
+        // Empty, undo the reservation
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+        return WSDEQUE_EMPTY;
+    }
+
+    item = atomic_load_explicit(&deque->items[bottom & (deque->capacity - 1)], memory_order_relaxed);
+    if (top == bottom) {
+        // Last item: race against thieves for it
+        if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                     memory_order_seq_cst, memory_order_relaxed)) {
+            item = WSDEQUE_EMPTY;
+        }
+        atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    }
+    return item;
+}
+
+long wsdeque_steal(struct wsdeque *deque) {
+    long top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    long bottom;
+    long item;
+
+    atomic_thread_fence(memory_order_seq_cst);
+    bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+
+    if (top >= bottom) {
+        return WSDEQUE_EMPTY;
+    }
+
+    item = atomic_load_explicit(&deque->items[top & (deque->capacity - 1)], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1,
+                                                 memory_order_seq_cst, memory_order_relaxed)) {
+        return WSDEQUE_ABORT;
+    }
+    return item;
+}
@@ -0,0 +1,58 @@
+#ifndef WSDEQUE_H
+#define WSDEQUE_H
+
+#include <stdatomic.h>
+
+// Returned by wsdeque_take() and wsdeque_steal() when there is nothing to hand out
+#define WSDEQUE_EMPTY (-1L)
+// Returned by wsdeque_steal() when it lost a race with another thread (try again)
+#define WSDEQUE_ABORT (-2L)
+
+/**
+ * Work-stealing deque (Chase-Lev) of non-negative work items.
+ *
+ * The owning thread pushes and takes items at the bottom, like a stack, without contention in
+ * the common case. Any other thread may steal the oldest item from the top. The capacity is
+ * fixed when the deque is created.
+ */
+struct wsdeque {
+    _Atomic long top;       // Next item to be stolen
+    _Atomic long bottom;    // Next free slot for the owner
+    long capacity;          // Number of slots, a power of two
+    _Atomic long *items;    // Ring buffer of `capacity` items
+};
+
+/**
+ * Creates an empty deque that can hold at least `capacity` items.
+ *
+ * @return 0 on success, -1 if memory allocation failed.
+ */
+int wsdeque_init(struct wsdeque *deque, long capacity);
+
+/**
+ * Frees the memory of the deque.
+ */
+void wsdeque_destroy(struct wsdeque *deque);
+
+/**
+ * Pushes an item at the bottom. Only the owner may call this.
+ *
+ * @return 0 on success, -1 if the deque is full.
+ */
+int wsdeque_push(struct wsdeque *deque, long item);
+
+/**
+ * Takes the most recently pushed item. Only the owner may call this.
+ *
+ * @return The item, or WSDEQUE_EMPTY.
+ */
+long wsdeque_take(struct wsdeque *deque);
+
+/**
+ * Steals the oldest item. Any thread may call this.
+ *
+ * @return The item, WSDEQUE_EMPTY or WSDEQUE_ABORT.
+ */
+long wsdeque_steal(struct wsdeque *deque);
+
+#endif // WSDEQUE_H
@@ -0,0 +1,185 @@
+/**
+ * Drives many non-blocking clients (http_client.h) from one epoll loop, the
+ * way a service would embed them in its own event loop: every client sends
+ * its requests one after the other over a kept-alive connection, and the
+ * loop only waits for what the clients ask for. Prints requests/sec and the
+ * latency table at the end.
+ *
+ * Build the library, then this program, from this directory:
+ *
+ *   make -C ..
+ *   gcc -O2 -o client_bench client_bench.c -I.. ../build/libhttp.a -pthread
+ *   ./client_bench localhost 5000 256 100000
+ *
+ * (the stand-in server in ../../Loopback_benchmark answers any request).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include "http_client.h"
+#include "http_template.h"
+
+// Most events taken from epoll_wait() at once
+#define MAX_EVENTS 256
+// epoll tag of the resolver's notification descriptor
+#define RESOLVER_TAG -1
+
+// One client with the socket and events it is registered with
+struct slot {
+    struct http_client client;
+    int fd;
+    unsigned long connection;
+    int events;
+};
+
+static struct slot *slots;
+static int epoll_fd;
+static long started;
+static long completed;
+static long failed;
+static long requests;
+
+/**
+ * Makes the epoll registration of a client match what it waits for.
+ */
+static void watch(struct slot *slot) {
+    int fd = http_client_fd(&slot->client);
+    int events = http_client_events(&slot->client);
+    struct epoll_event event;
+
+    if (fd < 0) {
+        // Nothing to wait for: a closed socket left the epoll set by itself, one kept alive
+        // for the next request must not wake the loop meanwhile
+        if (slot->fd >= 0 && slot->client.fd == slot->fd && slot->client.connections == slot->connection) {
+            epoll_ctl(epoll_fd, EPOLL_CTL_DEL, slot->fd, NULL);
+        }
+        slot->fd = -1;
+        return;
+    }
+    event.events = ((events & HTTP_CLIENT_READ) ? EPOLLIN : 0) | ((events & HTTP_CLIENT_WRITE) ? EPOLLOUT : 0);
+    event.data.u32 = slot - slots;
+    if (fd != slot->fd || slot->client.connections != slot->connection) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &event);
+    } else if (events != slot->events) {
+        epoll_ctl(epoll_fd, EPOLL_CTL_MOD, fd, &event);
+    }
+    slot->fd = fd;
+    slot->connection = slot->client.connections;
+    slot->events = events;
+}
+
+/**
+ * Counts a finished request and starts the next one, as long as there are
+ * requests left.
+ */
+static void next_request(struct slot *slot, int result, const struct http_client_request *request) {
+    while (result == HTTP_CLIENT_DONE || result < 0) {
+        if (result < 0) {
+            failed++;
+            fprintf(stderr, "Request failed: %s\n", http_client_strerror(result));
+        } else {
+            completed++;
+        }
+        if (started == requests) {
+            break;
+        }
+        started++;
+        result = http_client_start(&slot->client, request);
+    }
+    watch(slot);
+}
+
+int main(int argc, char *argv[]) {
+    struct epoll_event events[MAX_EVENTS];
+    struct epoll_event event;
+    struct http_client_request request;
+    struct http_template template;
+    struct http_timings timings;
+    struct resolver resolver;
+    long long start;
+    double elapsed;
+    int clients;
+
+    if (argc != 5) {
+        fprintf(stderr, "Usage: %s host port clients requests\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+    clients = atoi(argv[3]);
+    requests = atol(argv[4]);
+    if (clients < 1 || requests < 1 || resolver_init(&resolver, 1, 0, NULL) < 0
+            || http_template_init(&template, "GET", "/", argv[1], NULL, HTTP_TEMPLATE_NO_BODY) < 0) {
+        fprintf(stderr, "Cannot set up the benchmark\n");
+        return EXIT_FAILURE;
+    }
+    slots = calloc(clients, sizeof(struct slot));
+    epoll_fd = epoll_create1(0);
+    if (slots == NULL || epoll_fd < 0) {
+        fprintf(stderr, "Cannot set up the benchmark\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&request, 0, sizeof(request));
+    request.host = argv[1];
+    request.port = atoi(argv[2]);
+    request.head = template.head;
+    request.head_len = template.head_len;
+    http_timings_init(&timings);
+
+    // Lookups complete on the resolver's threads: its descriptor wakes the loop
+    event.events = EPOLLIN;
+    event.data.u32 = RESOLVER_TAG;
+    epoll_ctl(epoll_fd, EPOLL_CTL_ADD, resolver_notify_fd(&resolver), &event);
+
+    start = latency_now_ns();
+    for (int i = 0; i < clients && started < requests; i++) {
+        http_client_init(&slots[i].client, &resolver, &timings);
+        slots[i].fd = -1;
+        started++;
+        next_request(&slots[i], http_client_start(&slots[i].client, &request), &request);
+    }
+
+    while (completed + failed < requests) {
+        int ready = epoll_wait(epoll_fd, events, MAX_EVENTS, -1);
+
+        for (int i = 0; i < ready; i++) {
+            struct slot *slot;
+            int flags = 0;
+
+            if (events[i].data.u32 == (unsigned int) RESOLVER_TAG) {
+                resolver_clear_notify(&resolver);
+                for (int j = 0; j < clients; j++) {
+                    if (slots[j].client.state == HTTP_CLIENT_RESOLVING) {
+                        next_request(&slots[j], http_client_step(&slots[j].client, 0), &request);
+                    }
+                }
+                continue;
+            }
+
+            slot = &slots[events[i].data.u32];
+            if (events[i].events & (EPOLLERR | EPOLLHUP)) {
+                flags = HTTP_CLIENT_READ | HTTP_CLIENT_WRITE;
+            }
+            if (events[i].events & EPOLLIN) {
+                flags |= HTTP_CLIENT_READ;
+            }
+            if (events[i].events & EPOLLOUT) {
+                flags |= HTTP_CLIENT_WRITE;
+            }
+            next_request(slot, http_client_step(&slot->client, flags), &request);
+        }
+    }
+    elapsed = (latency_now_ns() - start) / 1e9;
+
+    printf("%ld requests (%ld failed) in %.3f s: %.1f requests/sec\n\n", completed + failed, failed, elapsed,
+           (completed + failed) / elapsed);
+    http_timings_print_table(&timings, stdout);
+
+    for (int i = 0; i < clients; i++) {
+        http_client_close(&slots[i].client);
+    }
+    free(slots);
+    http_template_free(&template);
+    resolver_destroy(&resolver);
+    return failed == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,215 @@
+/**
+ * Microbenchmark of the head scanner (http_scan.h) against the approaches it
+ * replaces: strstr() on a null-terminated copy of each piece, a memchr() per
+ * line, and a chain of case-insensitive string comparisons per header name.
+ *
+ * Build and run from this directory:
+ *
+ *   gcc -O2 -o scan_bench scan_bench.c ../http_scan.c -I..
+ *   ./scan_bench
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include "http_scan.h"
+
+// Times every variant is run
+#define ROUNDS 2000000
+
+// Typical response head of a JSON API (about 500 bytes, 12 headers)
+static const char head[] =
+    "HTTP/1.1 200 OK\r\n"
+    "Date: Fri, 16 Oct 2026 09:12:44 GMT\r\n"
+    "Server: nginx/1.25.3\r\n"
+    "Content-Type: application/json; charset=utf-8\r\n"
+    "Content-Length: 1742\r\n"
+    "Connection: keep-alive\r\n"
+    "Keep-Alive: timeout=5, max=1000\r\n"
+    "Cache-Control: no-store, no-cache, must-revalidate\r\n"
+    "Vary: Accept-Encoding, Origin\r\n"
+    "X-Request-Id: 6f1c2e7a-98d4-4b0e-a3f5-1d2c3b4a5e6f\r\n"
+    "Strict-Transport-Security: max-age=63072000; includeSubDomains\r\n"
+    "Set-Cookie: session=8c1d0e4f2a3b; Path=/; HttpOnly; Secure\r\n"
+    "X-Content-Type-Options: nosniff\r\n"
+    "\r\n"
+    "{\"id\": 1}";
+
+// Sink for results, so the compiler cannot drop the work
+static volatile long sink;
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Prints the time per head, and the throughput if `bytes` were scanned.
+ */
+static void report(const char *name, double start, size_t bytes) {
+    double ns = (now() - start) * 1e9 / ROUNDS;
+    printf("%-34s %8.1f ns/head", name, ns);
+    if (bytes > 0) {
+        printf(" %8.2f GB/s", bytes / ns);
+    }
+    printf("\n");
+}
+
+/**
+ * The old way: copy the piece so it is null-terminated, then strstr().
+ */
+static void bench_strstr(void) {
+    char copy[sizeof(head)];
+    double start = now();
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        memcpy(copy, head, sizeof(head));
+        sink += strstr(copy, "\r\n\r\n") - copy;
+    }
+    report("strstr on a copy", start, sizeof(head) - 1);
+}
+
+/**
+ * A memchr() per line, checking whether the next line is empty.
+ */
+static void bench_lines(void) {
+    double start = now();
+    int i;
+
+    for (i = 0; i < ROUNDS; i++) {
+        const char *p = head;
+        const char *end = head + sizeof(head) - 1;
+        while ((p = memchr(p, '\n', end - p)) != NULL) {
+            if (end - p >= 3 && p[1] == '\r' && p[2] == '\n') {
+                break;
+            }
+            p++;
+        }
+        sink += p - head;
+    }
+    report("memchr per line", start, sizeof(head) - 1);
+}
+
+static void bench_scan(const char *isa) {
+    char name[64];
+    double start;
+    int i;
+
+    if (http_scan_set_isa(isa) < 0) {
+        printf("http_head_scan (%s)%*s not supported by this CPU\n", isa, (int) (15 - strlen(isa)), "");
+        return;
+    }
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        struct http_head_scan scan;
+        http_head_scan_init(&scan);
+        sink += http_head_scan(&scan, head, sizeof(head) - 1);
+    }
+    snprintf(name, sizeof(name), "http_head_scan (%s)", isa);
+    report(name, start, sizeof(head) - 1);
+}
+
+/**
+ * The old header lookup: a chain of case-insensitive comparisons.
+ */
+static int lookup_chain(const char *name, size_t len) {
+    static const char *const names[] = {
+        "content-length", "transfer-encoding", "connection", "content-type", "content-encoding",
+        "keep-alive", "date", "server", "location", "set-cookie"
+    };
+    size_t i;
+
+    for (i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        if (strlen(names[i]) == len && strncasecmp(name, names[i], len) == 0) {
+            return (int) i + 1;
+        }
+    }
+    return 0;
+}
+
+static void bench_lookup(const char *status_end, const struct http_header_slice *slices, int count) {
+    double start;
+    int i, j;
+
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        for (j = 0; j < count; j++) {
+            sink += lookup_chain(status_end + slices[j].name_off, slices[j].name_len);
+        }
+    }
+    report("names: strncasecmp chain", start, 0);
+
+    start = now();
+    for (i = 0; i < ROUNDS; i++) {
+        for (j = 0; j < count; j++) {
+            sink += http_header_lookup(status_end + slices[j].name_off, slices[j].name_len);
+        }
+    }
+    report("names: perfect hash", start, 0);
+}
+
+/**
+ * Feeds the head in pieces of every size from 1 byte up, so that the
+ * terminator is split at every possible place.
+ */
+static int check_split(void) {
+    size_t len = sizeof(head) - 1;
+    long expected = strstr(head, "\r\n\r\n") + 4 - head;
+    size_t piece;
+
+    for (piece = 1; piece <= len; piece++) {
+        struct http_head_scan scan;
+        size_t pos = 0;
+        long found = -1;
+
+        http_head_scan_init(&scan);
+        while (pos < len && found < 0) {
+            size_t n = len - pos < piece ? len - pos : piece;
+            found = http_head_scan(&scan, head + pos, n);
+            if (found >= 0) {
+                found += pos;
+            }
+            pos += n;
+        }
+        if (found != expected) {
+            printf("Error! Pieces of %zu bytes: end of head at %ld, expected %ld\n", piece, found, expected);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    const char *isas[] = {"scalar", "sse2", "avx2"};
+    struct http_header_slice slices[32];
+    const char *status_end = strchr(head, '\n') + 1;
+    int count;
+    size_t i;
+
+    printf("Head of %zu bytes, %d rounds, default instruction set: %s\n\n",
+           sizeof(head) - 1, ROUNDS, http_scan_isa());
+
+    for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+        if (http_scan_set_isa(isas[i]) == 0 && check_split() < 0) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    bench_strstr();
+    bench_lines();
+    for (i = 0; i < sizeof(isas) / sizeof(isas[0]); i++) {
+        bench_scan(isas[i]);
+    }
+
+    count = http_split_headers(status_end, sizeof(head) - 1 - (status_end - head), slices, 32);
+    if (count < 0) {
+        printf("Error! Could not split the headers\n");
+        return EXIT_FAILURE;
+    }
+    printf("\n%d headers\n", count);
+    bench_lookup(status_end, slices, count);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,286 @@
+/**
+ * Batched POSTs, see http_batch.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "http_batch.h"
+#include "latency.h"
+
+/**
+ * Skips spaces, tabs and line ends.
+ */
+static const char *skip_space(const char *p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')) {
+        p++;
+    }
+    return p;
+}
+
+/**
+ * Finds the next element of a JSON array, from just after the '[' or the
+ * ',' before it. Strings are skipped as a whole and nested arrays and objects
+ * are kept together, so only the commas of the outer array separate.
+ *
+ * @param p Where to start; set to where the following element starts.
+ * @param start Receives the start of the element.
+ * @param len Receives its length, without surrounding spaces.
+ * @return 1 if an element was found, 0 at the end of the array, -1 if the
+ *         array is malformed.
+ */
+static int next_element(const char **p, const char *end, const char **start, size_t *len) {
+    const char *at = skip_space(*p, end);
+    const char *last;
+    int depth = 0;
+    int in_string = 0;
+
+    if (at < end && *at == ']') {
+        return 0;
+    }
+    *start = at;
+    for (; at < end; at++) {
+        if (in_string) {
+            if (*at == '\\') {
+                at++;
+            } else if (*at == '"') {
+                in_string = 0;
+            }
+        } else if (*at == '"') {
+            in_string = 1;
+        } else if (*at == '[' || *at == '{') {
+            depth++;
+        } else if ((*at == ']' || *at == '}') && depth > 0) {
+            depth--;
+        } else if (depth == 0 && (*at == ',' || *at == ']')) {
+            break;
+        }
+    }
+    if (at >= end || at == *start) {
+        return -1;
+    }
+
+    last = at;
+    while (last > *start && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r' || last[-1] == '\n')) {
+        last--;
+    }
+    *len = last - *start;
+    *p = *at == ',' ? at + 1 : at; // a ']' is found again by the next call
+    return 1;
+}
+
+/**
+ * Finds the next non-empty line of an NDJSON body.
+ *
+ * @return 1 if a line was found, 0 at the end of the body.
+ */
+static int next_line(const char **p, const char *end, const char **start, size_t *len) {
+    while (*p < end) {
+        const char *newline = memchr(*p, '\n', end - *p);
+        const char *line_end = newline != NULL ? newline : end;
+
+        *start = *p;
+        *len = line_end - *p;
+        *p = newline != NULL ? newline + 1 : end;
+        if (*len > 0 && (*start)[*len - 1] == '\r') {
+            (*len)--;
+        }
+        if (*len > 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Splits the answer into its elements (of a JSON array, or lines of NDJSON,
+ * whatever the format of the request was), once to count them and, if there
+ * is one per record, again to hand them to the records.
+ */
+static void fan_out(struct http_batch *batch, int status, const char *answer, size_t len) {
+    const char *end = answer != NULL ? answer + len : NULL;
+    const char *body = answer != NULL ? skip_space(answer, end) : NULL;
+    int array = body != NULL && body < end && *body == '[';
+    const char *element;
+    const char *p;
+    size_t element_len;
+    size_t count = 0;
+    size_t i;
+    int found;
+
+    if (body != NULL) {
+        p = array ? body + 1 : body;
+        while ((found = array ? next_element(&p, end, &element, &element_len)
+                              : next_line(&p, end, &element, &element_len)) > 0) {
+            count++;
+        }
+        if (found < 0) {
+            count = 0;
+        }
+    }
+
+    p = array ? body + 1 : body;
+    for (i = 0; i < batch->count; i++) {
+        struct http_batch_item *item = &batch->items[i];
+        const char *result = NULL;
+
+        element_len = 0;
+        if (count == batch->count && (array ? next_element(&p, end, &element, &element_len)
+                                            : next_line(&p, end, &element, &element_len)) > 0) {
+            result = element;
+        }
+        if (item->done != NULL) {
+            item->done(item->ctx, status, result, element_len);
+        }
+    }
+}
+
+/**
+ * Makes room for `extra` more bytes of body.
+ */
+static int reserve(struct http_batch *batch, size_t extra) {
+    size_t needed = batch->len + extra;
+    size_t capacity = batch->capacity;
+    char *body;
+
+    if (needed <= capacity) {
+        return 0;
+    }
+    while (capacity < needed) {
+        capacity *= 2;
+    }
+    body = realloc(batch->body, capacity);
+    if (body == NULL) {
+        return -1;
+    }
+    batch->body = body;
+    batch->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Empties the batch for the next records; a JSON array is opened again.
+ */
+static void reset(struct http_batch *batch) {
+    batch->len = 0;
+    batch->count = 0;
+    if (batch->format == HTTP_BATCH_JSON_ARRAY) {
+        batch->body[batch->len++] = '[';
+    }
+}
+
+int http_batch_init(struct http_batch *batch, enum http_batch_format format, size_t max_bytes,
+                    size_t max_items, int linger_ms, http_batch_send_cb send, void *ctx) {
+    memset(batch, 0, sizeof(*batch));
+    batch->format = format;
+    batch->max_bytes = max_bytes;
+    batch->max_items = max_items > 0 ? max_items : 1;
+    batch->linger_ms = linger_ms;
+    batch->send = send;
+    batch->send_ctx = ctx;
+
+    // Room for a full batch of small records from the start, never grown in the common case
+    batch->capacity = max_bytes > 1024 ? max_bytes + 1 : 1024;
+    batch->item_capacity = batch->max_items < 1024 ? batch->max_items : 1024;
+    batch->body = malloc(batch->capacity);
+    batch->items = malloc(batch->item_capacity * sizeof(struct http_batch_item));
+    if (batch->body == NULL || batch->items == NULL) {
+        http_batch_free(batch);
+        return -1;
+    }
+    reset(batch);
+    return 0;
+}
+
+int http_batch_add(struct http_batch *batch, const char *record, size_t len, http_batch_item_cb done,
+                   void *ctx) {
+    // The record, its separator and (for an array) the closing ']'
+    size_t extra = len + 1 + (batch->format == HTTP_BATCH_JSON_ARRAY);
+
+    if (batch->count > 0 && batch->len + extra > batch->max_bytes) {
+        http_batch_flush(batch);
+    }
+    if (batch->count == batch->item_capacity) {
+        size_t capacity = batch->item_capacity * 2;
+        struct http_batch_item *items = realloc(batch->items, capacity * sizeof(struct http_batch_item));
+
+        if (items == NULL) {
+            return -1;
+        }
+        batch->items = items;
+        batch->item_capacity = capacity;
+    }
+    if (reserve(batch, extra) < 0) {
+        return -1;
+    }
+
+    if (batch->count == 0) {
+        batch->oldest = latency_now_ns();
+    } else if (batch->format == HTTP_BATCH_JSON_ARRAY) {
+        batch->body[batch->len++] = ',';
+    }
+    memcpy(batch->body + batch->len, record, len);
+    batch->len += len;
+    if (batch->format == HTTP_BATCH_NDJSON) {
+        batch->body[batch->len++] = '\n';
+    }
+    batch->items[batch->count].done = done;
+    batch->items[batch->count].ctx = ctx;
+    batch->count++;
+
+    if (batch->count >= batch->max_items || batch->len + (batch->format == HTTP_BATCH_JSON_ARRAY) >= batch->max_bytes) {
+        http_batch_flush(batch);
+    } else {
+        http_batch_poll(batch);
+    }
+    return 0;
+}
+
+int http_batch_poll(struct http_batch *batch) {
+    if (batch->count == 0 || http_batch_timeout(batch) > 0) {
+        return 0;
+    }
+    http_batch_flush(batch);
+    return 1;
+}
+
+int http_batch_timeout(const struct http_batch *batch) {
+    long long waited_ms;
+
+    if (batch->count == 0) {
+        return -1;
+    }
+    waited_ms = (latency_now_ns() - batch->oldest) / 1000000;
+    return waited_ms >= batch->linger_ms ? 0 : (int) (batch->linger_ms - waited_ms);
+}
+
+void http_batch_flush(struct http_batch *batch) {
+    struct http_sink response;
+    int status;
+
+    if (batch->count == 0) {
+        return;
+    }
+    if (batch->format == HTTP_BATCH_JSON_ARRAY) {
+        batch->body[batch->len++] = ']'; // room was reserved with the last record
+    }
+
+    http_sink_memory(&response, 0);
+    status = batch->send(batch->send_ctx, batch->body, batch->len, batch->count, &response);
+    batch->batches++;
+    batch->records += batch->count;
+
+    fan_out(batch, status < 0 ? -1 : status, status < 0 || response.failed ? NULL : response.data,
+            response.len);
+    http_sink_free(&response);
+    reset(batch);
+}
+
+void http_batch_free(struct http_batch *batch) {
+    free(batch->body);
+    free(batch->items);
+    batch->body = NULL;
+    batch->items = NULL;
+    batch->len = 0;
+    batch->count = 0;
+    batch->capacity = 0;
+    batch->item_capacity = 0;
+}
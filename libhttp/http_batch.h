@@ -0,0 +1,150 @@
+/**
+ * Coalescing of small JSON records into batched POSTs.
+ *
+ * Sending every tiny record as a request of its own spends most of the time
+ * on what surrounds it: the head of the request and the answer, a round trip,
+ * and the fixed cost of a request on the server. A batch collects records for
+ * one endpoint and sends them as the body of a single POST, either as a JSON
+ * array ("[r1,r2,...]") or as newline-delimited JSON ("r1\nr2\n..."), when
+ *
+ *  - it holds `max_items` records,
+ *  - the next record would make the body longer than `max_bytes`, or
+ *  - its oldest record has waited `linger_ms` milliseconds,
+ *
+ * so a record is delayed by at most the linger time (plus the request), in
+ * exchange for far fewer requests. Keep one batch per endpoint: the batch does
+ * no I/O itself, a send callback given by the caller posts the body.
+ *
+ * Every record comes with a callback that learns how its batch went: the HTTP
+ * status of the answer (or a failure) and, when the answer is a JSON array or
+ * NDJSON with exactly one element per record, the element for that record.
+ *
+ * The linger time is only checked when a record is added or when the caller
+ * polls: an event loop waits at most http_batch_timeout() milliseconds and
+ * then calls http_batch_poll().
+ */
+#ifndef HTTP_BATCH_H
+#define HTTP_BATCH_H
+
+#include <stddef.h>
+#include "http_sink.h"
+
+// How the records are put together into a body
+enum http_batch_format {
+    HTTP_BATCH_JSON_ARRAY,       // [record,record,...]     (application/json)
+    HTTP_BATCH_NDJSON            // record\nrecord\n...    (application/x-ndjson)
+};
+
+/**
+ * Learns how the batch of a record went.
+ *
+ * @param ctx The context given with the record.
+ * @param status HTTP status of the answer to the batch, or -1 if it could not
+ *               be sent (or no answer arrived).
+ * @param result The element of the answer that belongs to this record, or
+ *               NULL if the answer does not have one element per record. It
+ *               is only valid during the call.
+ * @param len Length of `result`.
+ */
+typedef void (*http_batch_item_cb)(void *ctx, int status, const char *result, size_t len);
+
+/**
+ * Sends one batch and collects the body of the answer.
+ *
+ * @param ctx The context given to http_batch_init().
+ * @param body The body of the POST.
+ * @param len Length of `body`.
+ * @param items Number of records in the body.
+ * @param response A memory sink for the body of the answer, to be attached to
+ *                 the parser that reads it (or left empty).
+ * @return The HTTP status of the answer, or -1 on failure.
+ */
+typedef int (*http_batch_send_cb)(void *ctx, const char *body, size_t len, size_t items,
+                                  struct http_sink *response);
+
+// A record waiting in the batch: whom to tell about it
+struct http_batch_item {
+    http_batch_item_cb done;
+    void *ctx;
+};
+
+struct http_batch {
+    enum http_batch_format format;
+    size_t max_bytes;            // flush before the body would grow beyond this
+    size_t max_items;            // flush once this many records are waiting
+    int linger_ms;               // flush once the oldest record waited this long
+
+    http_batch_send_cb send;
+    void *send_ctx;
+
+    char *body;                  // records added so far, already delimited
+    size_t len;
+    size_t capacity;
+    struct http_batch_item *items;
+    size_t count;                // records waiting
+    size_t item_capacity;
+    long long oldest;            // latency_now_ns() when the first waiting record was added
+
+    unsigned long long batches;  // batches sent
+    unsigned long long records;  // records sent in them
+};
+
+/**
+ * Creates an empty batch.
+ *
+ * @param batch The batch.
+ * @param format JSON array or NDJSON.
+ * @param max_bytes Largest body (a single record longer than that is still
+ *                  sent, on its own).
+ * @param max_items Most records per batch (at least 1).
+ * @param linger_ms Longest time a record waits for others (0: a record is
+ *                  sent at the next poll).
+ * @param send Sends a full batch.
+ * @param ctx Passed to `send`.
+ * @return 0, or -1 if memory ran out.
+ */
+int http_batch_init(struct http_batch *batch, enum http_batch_format format, size_t max_bytes,
+                    size_t max_items, int linger_ms, http_batch_send_cb send, void *ctx);
+
+/**
+ * Adds a record (a complete JSON value, without a newline) and sends the
+ * batch if that filled it. The record is copied.
+ *
+ * @param batch The batch.
+ * @param record The record.
+ * @param len Length of `record`.
+ * @param done Called once the batch of the record was answered or failed
+ *             (may be NULL). It must not add records to this batch.
+ * @param ctx Passed to `done`.
+ * @return 0, or -1 if memory ran out (the record was not added).
+ */
+int http_batch_add(struct http_batch *batch, const char *record, size_t len, http_batch_item_cb done,
+                   void *ctx);
+
+/**
+ * Sends the batch if its oldest record has waited for the linger time.
+ *
+ * @return 1 if a batch was sent, 0 if not.
+ */
+int http_batch_poll(struct http_batch *batch);
+
+/**
+ * @return Milliseconds until the linger time of the oldest record is over
+ *         (0 if it is), or -1 if no record is waiting: a timeout for poll()
+ *         or epoll_wait().
+ */
+int http_batch_timeout(const struct http_batch *batch);
+
+/**
+ * Sends the waiting records now, whatever the thresholds (e.g. before the
+ * program exits). Nothing happens when no record is waiting.
+ */
+void http_batch_flush(struct http_batch *batch);
+
+/**
+ * Frees the buffers of a batch. Records still waiting are dropped without a
+ * call to their callbacks: flush first to send them.
+ */
+void http_batch_free(struct http_batch *batch);
+
+#endif // HTTP_BATCH_H
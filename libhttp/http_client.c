@@ -0,0 +1,476 @@
+/**
+ * Non-blocking HTTP/1.1 client connections, see http_client.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include "http_client.h"
+
+// Bytes read from the socket at a time
+#define HTTP_CLIENT_RECV_SIZE 16384
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+static int try_connect(struct http_client *client);
+static int reconnect(struct http_client *client);
+
+/**
+ * Ends the phase that started at `phase_started` and starts the next one.
+ */
+static void end_phase(struct http_client *client, enum http_phase phase) {
+    long long now = latency_now_ns();
+
+    if (client->timings != NULL) {
+        http_timings_record(client->timings, phase, client->phase_started, now);
+    }
+    client->phase_started = now;
+}
+
+/**
+ * Closes the socket, if there is one.
+ */
+static void close_socket(struct http_client *client) {
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+    }
+    client->keep_alive = 0;
+}
+
+/**
+ * Lets go of the addresses of the host (the lookup or the numeric address).
+ */
+static void release_addresses(struct http_client *client) {
+    if (client->lookup != NULL) {
+        resolver_release(client->resolver, client->lookup);
+        client->lookup = NULL;
+    }
+    if (client->numeric != NULL) {
+        freeaddrinfo(client->numeric);
+        client->numeric = NULL;
+    }
+    client->address = NULL;
+}
+
+/**
+ * Gives the request up.
+ *
+ * @return `error`, for the caller to pass on.
+ */
+static int fail(struct http_client *client, int error, int sys_error) {
+    close_socket(client);
+    release_addresses(client);
+    client->state = HTTP_CLIENT_ERROR;
+    client->error = error;
+    client->sys_error = sys_error;
+    return error;
+}
+
+/**
+ * Prepares the parser for the response, with the callbacks of the request.
+ */
+static void reset_parser(struct http_client *client) {
+    http_parser_init(&client->parser, client->request.head_request);
+    client->parser.on_header = client->request.on_header;
+    client->parser.header_ctx = client->request.header_ctx;
+    if (client->request.sink != NULL) {
+        http_sink_attach(client->request.sink, &client->parser);
+    }
+}
+
+/**
+ * The addresses of the host are known: starts connecting to the first one.
+ */
+static int addresses_ready(struct http_client *client) {
+    if (client->lookup != NULL) {
+        if (client->lookup->error != 0) {
+            return fail(client, HTTP_CLIENT_ERR_RESOLVE, client->lookup->error);
+        }
+        client->address = client->lookup->addresses;
+    } else {
+        client->address = client->numeric;
+    }
+    end_phase(client, HTTP_PHASE_DNS);
+    return try_connect(client);
+}
+
+/**
+ * Looks the host up: with the resolver (the answer may be cached already) or,
+ * without one, as a numeric address, which never blocks.
+ */
+static int resolve(struct http_client *client) {
+    struct addrinfo hints;
+    int error;
+
+    client->phase_started = latency_now_ns();
+    if (client->resolver != NULL) {
+        client->lookup = resolver_start(client->resolver, client->host);
+        if (client->lookup == NULL) {
+            return fail(client, HTTP_CLIENT_ERR_MEMORY, 0);
+        }
+        client->state = HTTP_CLIENT_RESOLVING;
+        if (!resolver_ready(client->resolver, client->lookup)) {
+            return client->state;
+        }
+        return addresses_ready(client);
+    }
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_NUMERICHOST;
+    error = getaddrinfo(client->host, NULL, &hints, &client->numeric);
+    if (error != 0) {
+        client->numeric = NULL;
+        return fail(client, HTTP_CLIENT_ERR_RESOLVE, error);
+    }
+    return addresses_ready(client);
+}
+
+/**
+ * Sends as much of the request as the socket accepts.
+ */
+static int write_request(struct http_client *client) {
+    const struct http_client_request *request = &client->request;
+    size_t total = request->head_len + request->body_len;
+
+    while (client->sent < total) {
+        struct iovec iov[2];
+        struct msghdr message;
+        ssize_t written;
+
+        memset(&message, 0, sizeof(message));
+        message.msg_iov = iov;
+        if (client->sent < request->head_len) {
+            iov[0].iov_base = (char *) request->head + client->sent;
+            iov[0].iov_len = request->head_len - client->sent;
+            iov[1].iov_base = (char *) request->body;
+            iov[1].iov_len = request->body_len;
+            message.msg_iovlen = request->body_len > 0 ? 2 : 1;
+        } else {
+            iov[0].iov_base = (char *) request->body + (client->sent - request->head_len);
+            iov[0].iov_len = total - client->sent;
+            message.msg_iovlen = 1;
+        }
+
+        written = sendmsg(client->fd, &message, MSG_NOSIGNAL);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return client->state;
+            }
+            if (client->reused) {
+                // The server dropped the idle connection: this request never reached it
+                return reconnect(client);
+            }
+            return fail(client, HTTP_CLIENT_ERR_SEND, errno);
+        }
+        client->sent += written;
+    }
+
+    end_phase(client, HTTP_PHASE_SEND);
+    client->state = HTTP_CLIENT_READING_HEADERS;
+    return client->state;
+}
+
+/**
+ * The connection is established: starts writing the request.
+ */
+static int connected(struct http_client *client) {
+    int one = 1;
+
+    setsockopt(client->fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    end_phase(client, HTTP_PHASE_CONNECT);
+    release_addresses(client);
+    client->state = HTTP_CLIENT_WRITING;
+    return write_request(client);
+}
+
+/**
+ * Opens a non-blocking socket to the current address and starts connecting,
+ * moving on to the next address whenever one fails straight away.
+ */
+static int try_connect(struct http_client *client) {
+    int error = ECONNREFUSED;
+
+    for (; client->address != NULL; client->address = client->address->ai_next) {
+        const struct addrinfo *address = client->address;
+        struct sockaddr_storage target;
+
+        if (address->ai_addrlen > sizeof(target)
+                || (address->ai_family != AF_INET && address->ai_family != AF_INET6)) {
+            continue;
+        }
+        memcpy(&target, address->ai_addr, address->ai_addrlen);
+        if (address->ai_family == AF_INET) {
+            ((struct sockaddr_in *) &target)->sin_port = htons(client->port);
+        } else {
+            ((struct sockaddr_in6 *) &target)->sin6_port = htons(client->port);
+        }
+
+        client->fd = socket(address->ai_family, SOCK_STREAM, 0);
+        if (client->fd < 0) {
+            error = errno;
+            continue;
+        }
+        client->connections++;
+        fcntl(client->fd, F_SETFL, fcntl(client->fd, F_GETFL) | O_NONBLOCK);
+        fcntl(client->fd, F_SETFD, FD_CLOEXEC);
+#ifdef SO_NOSIGPIPE
+        {
+            int one = 1;
+            setsockopt(client->fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+        }
+#endif
+
+        client->state = HTTP_CLIENT_CONNECTING;
+        if (connect(client->fd, (struct sockaddr *) &target, address->ai_addrlen) == 0) {
+            return connected(client);
+        }
+        if (errno == EINPROGRESS || errno == EINTR) {
+            return client->state;
+        }
+        error = errno;
+        close_socket(client);
+    }
+    return fail(client, HTTP_CLIENT_ERR_CONNECT, error);
+}
+
+/**
+ * The socket of a connect under way became ready: connected, or on to the
+ * next address.
+ */
+static int finish_connect(struct http_client *client) {
+    int error = 0;
+    socklen_t len = sizeof(error);
+
+    if (getsockopt(client->fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0) {
+        error = errno;
+    }
+    if (error == 0) {
+        return connected(client);
+    }
+    if (error == EINPROGRESS) {
+        return client->state;
+    }
+    close_socket(client);
+    client->address = client->address->ai_next;
+    if (client->address == NULL) {
+        return fail(client, HTTP_CLIENT_ERR_CONNECT, error);
+    }
+    return try_connect(client);
+}
+
+/**
+ * A reused connection was closed before the response started: sends the
+ * request again on a new one.
+ *
+ * @return The new state, or an error code if that was not possible.
+ */
+static int reconnect(struct http_client *client) {
+    client->reused = 0;
+    client->sent = 0;
+    close_socket(client);
+    reset_parser(client);
+    return resolve(client);
+}
+
+/**
+ * Reads and parses what has arrived of the response.
+ */
+static int read_response(struct http_client *client) {
+    char buffer[HTTP_CLIENT_RECV_SIZE];
+
+    for (;;) {
+        ssize_t received = recv(client->fd, buffer, sizeof(buffer), 0);
+        long consumed;
+
+        if (received < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {
+                return client->state;
+            }
+            if (client->reused && client->received == 0) {
+                return reconnect(client);
+            }
+            return fail(client, HTTP_CLIENT_ERR_RECV, errno);
+        }
+        if (received == 0) {
+            if (client->reused && client->received == 0) {
+                return reconnect(client);
+            }
+            if (http_parser_finish(&client->parser) < 0) {
+                return fail(client, HTTP_CLIENT_ERR_CLOSED, 0);
+            }
+            client->parser.keep_alive = 0;
+            break;
+        }
+
+        if (client->received == 0) {
+            // FIRST_BYTE and TOTAL are measured from the start of the request
+            if (client->timings != NULL) {
+                http_timings_record(client->timings, HTTP_PHASE_FIRST_BYTE, client->started, latency_now_ns());
+            }
+        }
+        client->received += received;
+
+        consumed = http_parser_feed(&client->parser, buffer, received);
+        if (consumed < 0) {
+            return fail(client, HTTP_CLIENT_ERR_PROTOCOL, 0);
+        }
+        if (http_parser_done(&client->parser)) {
+            if (consumed < received) {
+                // Bytes after the response that nobody asked for: the connection is out of step
+                client->parser.keep_alive = 0;
+            }
+            break;
+        }
+        if (client->parser.state != HTTP_PARSE_STATUS_LINE && client->parser.state != HTTP_PARSE_HEADERS) {
+            client->state = HTTP_CLIENT_READING_BODY;
+        }
+    }
+
+    if (client->timings != NULL) {
+        http_timings_record(client->timings, HTTP_PHASE_TOTAL, client->started, latency_now_ns());
+    }
+    client->keep_alive = client->parser.keep_alive;
+    if (!client->keep_alive) {
+        close_socket(client);
+    }
+    client->state = HTTP_CLIENT_DONE;
+    return client->state;
+}
+
+void http_client_init(struct http_client *client, struct resolver *resolver, struct http_timings *timings) {
+    memset(client, 0, sizeof(*client));
+    client->state = HTTP_CLIENT_IDLE;
+    client->fd = -1;
+    client->resolver = resolver;
+    client->timings = timings;
+}
+
+int http_client_start(struct http_client *client, const struct http_client_request *request) {
+    if (client->state != HTTP_CLIENT_IDLE && client->state != HTTP_CLIENT_DONE
+            && client->state != HTTP_CLIENT_ERROR) {
+        return HTTP_CLIENT_ERR_STATE;
+    }
+
+    client->request = *request;
+    client->error = HTTP_CLIENT_OK;
+    client->sys_error = 0;
+    client->sent = 0;
+    client->received = 0;
+    client->started = latency_now_ns();
+    client->phase_started = client->started;
+    reset_parser(client);
+
+    if (client->fd >= 0 && client->keep_alive && client->port == request->port
+            && strcmp(client->host, request->host) == 0) {
+        client->reused = 1;
+        client->state = HTTP_CLIENT_WRITING;
+        return write_request(client);
+    }
+
+    close_socket(client);
+    client->reused = 0;
+    if (strlen(request->host) >= sizeof(client->host)) {
+        return fail(client, HTTP_CLIENT_ERR_RESOLVE, EAI_NONAME);
+    }
+    strcpy(client->host, request->host);
+    client->port = request->port;
+    return resolve(client);
+}
+
+int http_client_step(struct http_client *client, int events) {
+    switch (client->state) {
+        case HTTP_CLIENT_RESOLVING:
+            if (!resolver_ready(client->resolver, client->lookup)) {
+                return client->state;
+            }
+            return addresses_ready(client);
+        case HTTP_CLIENT_CONNECTING:
+            return events != 0 ? finish_connect(client) : (int) client->state;
+        case HTTP_CLIENT_WRITING:
+            return (events & HTTP_CLIENT_WRITE) ? write_request(client) : (int) client->state;
+        case HTTP_CLIENT_READING_HEADERS:
+        case HTTP_CLIENT_READING_BODY:
+            return (events & HTTP_CLIENT_READ) ? read_response(client) : (int) client->state;
+        case HTTP_CLIENT_ERROR:
+            return client->error;
+        default:
+            return client->state;
+    }
+}
+
+int http_client_fd(const struct http_client *client) {
+    switch (client->state) {
+        case HTTP_CLIENT_CONNECTING:
+        case HTTP_CLIENT_WRITING:
+        case HTTP_CLIENT_READING_HEADERS:
+        case HTTP_CLIENT_READING_BODY:
+            return client->fd;
+        default:
+            return -1;
+    }
+}
+
+int http_client_events(const struct http_client *client) {
+    switch (client->state) {
+        case HTTP_CLIENT_CONNECTING:
+        case HTTP_CLIENT_WRITING:
+            return HTTP_CLIENT_WRITE;
+        case HTTP_CLIENT_READING_HEADERS:
+        case HTTP_CLIENT_READING_BODY:
+            return HTTP_CLIENT_READ;
+        default:
+            return 0;
+    }
+}
+
+int http_client_status(const struct http_client *client) {
+    return client->parser.state != HTTP_PARSE_STATUS_LINE ? client->parser.status_code : 0;
+}
+
+const char *http_client_strerror(int error) {
+    switch (error) {
+        case HTTP_CLIENT_OK:
+            return "no error";
+        case HTTP_CLIENT_ERR_RESOLVE:
+            return "the host name could not be resolved";
+        case HTTP_CLIENT_ERR_CONNECT:
+            return "the connection could not be established";
+        case HTTP_CLIENT_ERR_SEND:
+            return "the request could not be sent";
+        case HTTP_CLIENT_ERR_RECV:
+            return "the response could not be received";
+        case HTTP_CLIENT_ERR_CLOSED:
+            return "the connection was closed before the response was complete";
+        case HTTP_CLIENT_ERR_PROTOCOL:
+            return "the response is malformed";
+        case HTTP_CLIENT_ERR_MEMORY:
+            return "out of memory";
+        case HTTP_CLIENT_ERR_STATE:
+            return "not allowed in this state";
+        default:
+            return "unknown error";
+    }
+}
+
+void http_client_close(struct http_client *client) {
+    close_socket(client);
+    release_addresses(client);
+    client->state = HTTP_CLIENT_IDLE;
+    client->reused = 0;
+}
@@ -0,0 +1,184 @@
+/**
+ * Non-blocking HTTP/1.1 client connections, driven by readiness events.
+ *
+ * A client carries one request at a time through an explicit state machine:
+ *
+ *   RESOLVING -> CONNECTING -> WRITING -> READING_HEADERS -> READING_BODY -> DONE
+ *
+ * and ends in ERROR from any state when something fails. No call ever blocks:
+ * the client opens a non-blocking socket, does as much work as the socket
+ * allows and then tells the caller what to wait for (readable or writable).
+ * The caller waits in its own event loop (epoll, poll, kqueue, ...) and calls
+ * http_client_step() when that happens, so one thread can drive thousands of
+ * clients. Nothing is printed and the process is never terminated: failures
+ * are returned as HTTP_CLIENT_ERR_* codes.
+ *
+ * Host names are looked up by the asynchronous resolver (resolver.h), whose
+ * notification descriptor becomes readable when a lookup completes; clients
+ * without a resolver only accept numeric addresses. When a host has several
+ * addresses, they are tried in turn.
+ *
+ * After a response that leaves the connection open (keep-alive), the next
+ * request to the same host and port is sent on the same connection. If such
+ * a reused connection turns out to have been closed by the server before any
+ * byte of the response arrived, the request is sent once more on a new one.
+ *
+ * The response is parsed by the incremental parser (http_parser.h): headers
+ * and body bytes are handed to the callbacks and the sink of the request as
+ * they arrive, nothing is collected by the client itself.
+ *
+ * The client uses POSIX sockets and is not available on Windows.
+ */
+#ifndef HTTP_CLIENT_H
+#define HTTP_CLIENT_H
+
+#include <stddef.h>
+#include <netdb.h>
+#include "http_parser.h"
+#include "http_sink.h"
+#include "latency.h"
+#include "resolver.h"
+
+// Readiness events, as passed to http_client_step() and returned by http_client_events()
+#define HTTP_CLIENT_READ 1
+#define HTTP_CLIENT_WRITE 2
+
+// Where a client is in the life of its request
+enum http_client_state {
+    HTTP_CLIENT_IDLE,            // no request started yet
+    HTTP_CLIENT_RESOLVING,       // waiting for the resolver
+    HTTP_CLIENT_CONNECTING,      // non-blocking connect() under way
+    HTTP_CLIENT_WRITING,         // sending the head and the body
+    HTTP_CLIENT_READING_HEADERS, // status line and headers of the response
+    HTTP_CLIENT_READING_BODY,    // body of the response
+    HTTP_CLIENT_DONE,            // the response is complete
+    HTTP_CLIENT_ERROR            // the request failed, see `error`
+};
+
+// Why a request failed (negative, so they can share a return value with a state)
+enum http_client_error {
+    HTTP_CLIENT_OK = 0,
+    HTTP_CLIENT_ERR_RESOLVE = -1,    // the host name could not be resolved (`sys_error`: EAI_*)
+    HTTP_CLIENT_ERR_CONNECT = -2,    // no address accepted the connection (`sys_error`: errno)
+    HTTP_CLIENT_ERR_SEND = -3,       // writing the request failed (`sys_error`: errno)
+    HTTP_CLIENT_ERR_RECV = -4,       // reading the response failed (`sys_error`: errno)
+    HTTP_CLIENT_ERR_CLOSED = -5,     // the server closed the connection before the response was complete
+    HTTP_CLIENT_ERR_PROTOCOL = -6,   // the response is malformed
+    HTTP_CLIENT_ERR_MEMORY = -7,     // memory ran out
+    HTTP_CLIENT_ERR_STATE = -8       // the call is not allowed in the current state
+};
+
+/**
+ * One request. The client keeps pointers to everything given here, which must
+ * stay valid until the request is done (or failed).
+ */
+struct http_client_request {
+    const char *host;            // host name or numeric address to connect to
+    int port;                    // port to connect to
+    const char *head;            // request line and headers, including the empty line
+                                 // (e.g. from an http_template)
+    size_t head_len;             // length of `head`
+    const char *body;            // body, or NULL
+    size_t body_len;             // length of `body`
+    int head_request;            // HEAD request: the response has no body
+    http_header_cb on_header;    // optional, called for every header of the response
+    void *header_ctx;            // passed to on_header
+    struct http_sink *sink;      // optional, receives the body of the response
+};
+
+struct http_client {
+    enum http_client_state state;
+    int error;                   // HTTP_CLIENT_ERR_* once the state is HTTP_CLIENT_ERROR
+    int sys_error;               // errno (or EAI_* for ERR_RESOLVE) behind `error`, 0 if none
+    int fd;                      // socket, -1 while there is none
+    int keep_alive;              // may the connection carry the next request?
+    int reused;                  // the request went out on a connection kept from before
+    unsigned long connections;   // sockets opened so far (a new socket may get the number
+                                 // of a closed one, this tells them apart)
+    struct http_client_request request;
+    size_t sent;                 // bytes of head and body written so far
+    unsigned long long received; // bytes of the response read so far
+    struct http_parser parser;
+
+    struct resolver *resolver;   // looks host names up, NULL for numeric addresses only
+    struct resolver_entry *lookup;// held while its addresses are in use
+    struct addrinfo *numeric;    // address list of a numeric host (without a resolver)
+    const struct addrinfo *address;// address connected to (or being tried)
+    char host[RESOLVER_NAME_MAX];// host and port the connection belongs to
+    int port;
+
+    struct http_timings *timings;// phases of every request are recorded here, or NULL
+    long long started;           // latency_now_ns() when the request was started
+    long long phase_started;     // ... when the current phase started
+};
+
+/**
+ * Prepares a client. It opens no connection until a request is started.
+ *
+ * @param client The client.
+ * @param resolver Resolver for host names, shared by any number of clients,
+ *                 or NULL to accept numeric addresses only.
+ * @param timings Histograms the phases of every request are recorded in, or
+ *                NULL.
+ */
+void http_client_init(struct http_client *client, struct resolver *resolver, struct http_timings *timings);
+
+/**
+ * Starts a request and carries it as far as possible without blocking.
+ *
+ * The client must be idle, done or failed. A connection kept alive to the
+ * same host and port is reused, any other one is closed.
+ *
+ * @param client The client.
+ * @param request The request (see struct http_client_request).
+ * @return The new state, or a negative HTTP_CLIENT_ERR_* code if the request
+ *         failed already.
+ */
+int http_client_start(struct http_client *client, const struct http_client_request *request);
+
+/**
+ * Carries the request on after the socket became ready.
+ *
+ * In HTTP_CLIENT_RESOLVING there is no socket yet: call it (with `events` 0)
+ * whenever the resolver's notification descriptor was readable.
+ *
+ * @param client The client.
+ * @param events The events that occurred (HTTP_CLIENT_READ, HTTP_CLIENT_WRITE);
+ *               error and hang-up conditions count as both.
+ * @return The new state, or a negative HTTP_CLIENT_ERR_* code if the request
+ *         failed.
+ */
+int http_client_step(struct http_client *client, int events);
+
+/**
+ * @return The socket the caller has to wait on, or -1 if there is none
+ *         (resolving, done, failed). It changes when a connection is opened,
+ *         so compare it (and `connections`, as a new socket may reuse the
+ *         number of the old one) after every call.
+ */
+int http_client_fd(const struct http_client *client);
+
+/**
+ * @return The events the caller has to wait for on http_client_fd():
+ *         HTTP_CLIENT_READ or HTTP_CLIENT_WRITE, 0 if none.
+ */
+int http_client_events(const struct http_client *client);
+
+/**
+ * @return The status code of the response (valid in HTTP_CLIENT_READING_BODY
+ *         and HTTP_CLIENT_DONE), 0 before the status line was read.
+ */
+int http_client_status(const struct http_client *client);
+
+/**
+ * @return A description of an HTTP_CLIENT_ERR_* code.
+ */
+const char *http_client_strerror(int error);
+
+/**
+ * Closes the connection (which cancels a request under way) and releases
+ * what the client holds. The client is idle again and may be started anew.
+ */
+void http_client_close(struct http_client *client);
+
+#endif // HTTP_CLIENT_H
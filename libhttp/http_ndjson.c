@@ -0,0 +1,130 @@
+/**
+ * NDJSON record splitter, see http_ndjson.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "http_ndjson.h"
+
+/**
+ * Passes one line to the callback, without its CR and unless it is empty
+ * (servers send empty lines to keep a quiet stream alive).
+ */
+static void emit(struct http_ndjson *ndjson, const char *line, size_t len, long long now) {
+    if (len > 0 && line[len - 1] == '\r') {
+        len--;
+    }
+    if (len == 0) {
+        return;
+    }
+
+    if (ndjson->timings != NULL) {
+        if (ndjson->records == 0) {
+            http_timings_record(ndjson->timings, HTTP_PHASE_FIRST_RECORD, ndjson->start, now);
+        } else {
+            http_timings_record(ndjson->timings, HTTP_PHASE_INTER_RECORD, ndjson->last, now);
+        }
+    }
+    ndjson->last = now;
+    ndjson->records++;
+    ndjson->on_record(ndjson->ctx, line, len);
+}
+
+/**
+ * Appends the start of a record that continues in the next piece.
+ */
+static int keep_partial(struct http_ndjson *ndjson, const char *data, size_t len) {
+    size_t needed = ndjson->partial_len + len;
+
+    if (ndjson->limit > 0 && needed > ndjson->limit) {
+        return -1;
+    }
+    if (needed > ndjson->capacity) {
+        size_t capacity = ndjson->capacity < 1024 ? 1024 : ndjson->capacity;
+        char *partial;
+
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+        partial = realloc(ndjson->partial, capacity);
+        if (partial == NULL) {
+            return -1;
+        }
+        ndjson->partial = partial;
+        ndjson->capacity = capacity;
+    }
+    memcpy(ndjson->partial + ndjson->partial_len, data, len);
+    ndjson->partial_len = needed;
+    return 0;
+}
+
+void http_ndjson_init(struct http_ndjson *ndjson, http_record_cb on_record, void *ctx, size_t limit) {
+    memset(ndjson, 0, sizeof(*ndjson));
+    ndjson->on_record = on_record;
+    ndjson->ctx = ctx;
+    ndjson->limit = limit;
+}
+
+void http_ndjson_start(struct http_ndjson *ndjson, struct http_timings *timings, long long start_ns) {
+    ndjson->failed = 0;
+    ndjson->records = 0;
+    ndjson->partial_len = 0;
+    ndjson->timings = timings;
+    ndjson->start = start_ns;
+    ndjson->last = start_ns;
+}
+
+void http_ndjson_feed(void *ctx, const char *data, size_t len) {
+    struct http_ndjson *ndjson = ctx;
+    const char *end = data + len;
+    const char *newline = memchr(data, '\n', len);
+    long long now;
+
+    if (ndjson->failed) {
+        return;
+    }
+    if (newline == NULL) {
+        if (keep_partial(ndjson, data, len) < 0) {
+            ndjson->failed = 1;
+        }
+        return;
+    }
+
+    // Every record completed by this piece arrived now
+    now = latency_now_ns();
+
+    // Complete the record begun by the previous piece
+    if (ndjson->partial_len > 0) {
+        if (keep_partial(ndjson, data, newline - data) < 0) {
+            ndjson->failed = 1;
+            return;
+        }
+        emit(ndjson, ndjson->partial, ndjson->partial_len, now);
+        ndjson->partial_len = 0;
+    } else {
+        emit(ndjson, data, newline - data, now);
+    }
+    data = newline + 1;
+
+    // Whole records are passed straight from the piece
+    while (data < end && (newline = memchr(data, '\n', end - data)) != NULL) {
+        emit(ndjson, data, newline - data, now);
+        data = newline + 1;
+    }
+    if (data < end && keep_partial(ndjson, data, end - data) < 0) {
+        ndjson->failed = 1;
+    }
+}
+
+void http_ndjson_finish(struct http_ndjson *ndjson) {
+    if (!ndjson->failed && ndjson->partial_len > 0) {
+        emit(ndjson, ndjson->partial, ndjson->partial_len, latency_now_ns());
+    }
+    ndjson->partial_len = 0;
+}
+
+void http_ndjson_free(struct http_ndjson *ndjson) {
+    free(ndjson->partial);
+    ndjson->partial = NULL;
+    ndjson->partial_len = 0;
+    ndjson->capacity = 0;
+}
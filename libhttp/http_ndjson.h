@@ -0,0 +1,81 @@
+/**
+ * Newline-delimited JSON (NDJSON) records of a streamed response body.
+ *
+ * Streaming APIs, e.g. LLM completions requested with "stream": true, answer
+ * with one JSON object per line, each sent as soon as it is produced (usually
+ * with chunked encoding). The splitter is fed the de-chunked body while the
+ * parser decodes it and hands every record to a callback the moment its
+ * newline arrives, instead of waiting for the end of the response. Records
+ * are passed straight out of the receive buffer; only a record that is split
+ * across two reads is copied, into a buffer that is reused for the next one.
+ *
+ * When timings are given, the time from the start of the request to the
+ * first record (time to first token) and the gaps between records are
+ * recorded in HTTP_PHASE_FIRST_RECORD and HTTP_PHASE_INTER_RECORD.
+ */
+#ifndef HTTP_NDJSON_H
+#define HTTP_NDJSON_H
+
+#include <stddef.h>
+#include "latency.h"
+
+/**
+ * Receives one record: a line without its line end (never empty).
+ */
+typedef void (*http_record_cb)(void *ctx, const char *record, size_t len);
+
+struct http_ndjson {
+    http_record_cb on_record;
+    void *ctx;
+    int failed;                  // set once a record exceeded `limit` or memory ran out
+    unsigned long long records;  // records of the current response
+
+    char *partial;               // start of a record split across reads
+    size_t partial_len;
+    size_t capacity;
+    size_t limit;                // refuse records longer than this (0: no limit)
+
+    struct http_timings *timings; // NULL: nothing is measured
+    long long start;             // start of the request (latency_now_ns())
+    long long last;              // arrival of the previous record
+};
+
+/**
+ * Creates a splitter.
+ *
+ * @param ndjson The splitter.
+ * @param on_record Called with every record.
+ * @param ctx Passed to `on_record`.
+ * @param limit The longest record accepted (0 for no limit).
+ */
+void http_ndjson_init(struct http_ndjson *ndjson, http_record_cb on_record, void *ctx, size_t limit);
+
+/**
+ * Prepares the splitter for the body of a new response.
+ *
+ * @param ndjson The splitter.
+ * @param timings Receives the record timings, or NULL.
+ * @param start_ns When the request was started (latency_now_ns()).
+ */
+void http_ndjson_start(struct http_ndjson *ndjson, struct http_timings *timings, long long start_ns);
+
+/**
+ * Feeds the next piece of the body. The signature is that of a body callback,
+ * so the splitter can be connected with http_sink_callback().
+ *
+ * @param ctx The splitter.
+ */
+void http_ndjson_feed(void *ctx, const char *data, size_t len);
+
+/**
+ * Passes on a last record that was not terminated by a newline. Call this
+ * once the response is complete.
+ */
+void http_ndjson_finish(struct http_ndjson *ndjson);
+
+/**
+ * Frees the buffer of a splitter.
+ */
+void http_ndjson_free(struct http_ndjson *ndjson);
+
+#endif // HTTP_NDJSON_H
@@ -0,0 +1,343 @@
+/**
+ * Incremental HTTP/1.1 response parser, see http_parser.h.
+ */
+#include <string.h>
+#include <ctype.h>
+#include "http_parser.h"
+#include "http_scan.h"
+
+/**
+ * Compares a (not null-terminated) token with a lower-case literal, ignoring
+ * the case of the token.
+ */
+static int token_equals(const char *token, size_t len, const char *literal) {
+    size_t i;
+
+    for (i = 0; i < len; i++) {
+        if (literal[i] == '\0' || tolower((unsigned char) token[i]) != literal[i]) {
+            return 0;
+        }
+    }
+    return literal[len] == '\0';
+}
+
+/**
+ * Checks whether a comma separated header value contains the given token,
+ * e.g. "chunked" in "gzip, chunked".
+ */
+static int value_has_token(const char *value, size_t len, const char *token) {
+    size_t start = 0;
+    size_t end;
+
+    while (start < len) {
+        // Skip separators and white space before the token
+        while (start < len && (value[start] == ',' || value[start] == ' ' || value[start] == '\t')) {
+            start++;
+        }
+        end = start;
+        while (end < len && value[end] != ',') {
+            end++;
+        }
+        // Trim trailing white space of the token
+        size_t token_end = end;
+        while (token_end > start && (value[token_end - 1] == ' ' || value[token_end - 1] == '\t')) {
+            token_end--;
+        }
+        if (token_end > start && token_equals(value + start, token_end - start, token)) {
+            return 1;
+        }
+        start = end;
+    }
+    return 0;
+}
+
+/**
+ * Parses "HTTP/1.x SSS Reason".
+ */
+static int parse_status_line(struct http_parser *parser, const char *line, size_t len) {
+    if (len < 12 || memcmp(line, "HTTP/1.", 7) != 0 || (line[7] != '0' && line[7] != '1') || line[8] != ' ') {
+        return -1;
+    }
+    if (!isdigit((unsigned char) line[9]) || !isdigit((unsigned char) line[10])
+            || !isdigit((unsigned char) line[11])) {
+        return -1;
+    }
+
+    parser->http_minor = line[7] - '0';
+    parser->status_code = (line[9] - '0') * 100 + (line[10] - '0') * 10 + (line[11] - '0');
+    // HTTP/1.1 connections persist by default, HTTP/1.0 ones do not
+    parser->keep_alive = parser->http_minor == 1;
+    return 0;
+}
+
+/**
+ * Parses one "Name: value" line and remembers the headers that affect framing.
+ */
+static int parse_header_line(struct http_parser *parser, const char *line, size_t len) {
+    const char *colon = memchr(line, ':', len);
+    if (colon == NULL || colon == line) {
+        return -1;
+    }
+
+    size_t name_len = colon - line;
+    const char *value = colon + 1;
+    size_t value_len = len - name_len - 1;
+
+    // Strip optional white space around the value
+    while (value_len > 0 && (*value == ' ' || *value == '\t')) {
+        value++;
+        value_len--;
+    }
+    while (value_len > 0 && (value[value_len - 1] == ' ' || value[value_len - 1] == '\t')) {
+        value_len--;
+    }
+
+    if (parser->state == HTTP_PARSE_HEADERS) {
+        unsigned long long length = 0;
+        size_t i;
+
+        switch (http_header_lookup(line, name_len)) {
+            case HTTP_HEADER_CONTENT_LENGTH:
+                if (value_len == 0) {
+                    return -1;
+                }
+                for (i = 0; i < value_len; i++) {
+                    if (!isdigit((unsigned char) value[i])) {
+                        return -1;
+                    }
+                    length = length * 10 + (value[i] - '0');
+                }
+                parser->content_length = (long long) length;
+                break;
+            case HTTP_HEADER_TRANSFER_ENCODING:
+                parser->chunked = value_has_token(value, value_len, "chunked");
+                break;
+            case HTTP_HEADER_CONNECTION:
+                if (value_has_token(value, value_len, "close")) {
+                    parser->keep_alive = 0;
+                } else if (value_has_token(value, value_len, "keep-alive")) {
+                    parser->keep_alive = 1;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (parser->on_header != NULL) {
+        parser->on_header(parser->header_ctx, line, name_len, value, value_len);
+    }
+    return 0;
+}
+
+/**
+ * Decides how the body is delimited once the empty line after the headers
+ * was seen (RFC 9112, section 6.3).
+ */
+static void end_of_headers(struct http_parser *parser) {
+    // Interim responses (100 Continue, ...) are followed by the real one
+    if (parser->status_code >= 100 && parser->status_code < 200) {
+        int head_request = parser->head_request;
+        http_body_cb on_body = parser->on_body;
+        http_header_cb on_header = parser->on_header;
+        void *ctx = parser->ctx;
+        void *header_ctx = parser->header_ctx;
+
+        http_parser_init(parser, head_request);
+        parser->on_body = on_body;
+        parser->on_header = on_header;
+        parser->ctx = ctx;
+        parser->header_ctx = header_ctx;
+        return;
+    }
+
+    if (parser->head_request || parser->status_code == 204 || parser->status_code == 304) {
+        parser->state = HTTP_PARSE_DONE;
+    } else if (parser->chunked) {
+        parser->state = HTTP_PARSE_CHUNK_SIZE;
+    } else if (parser->content_length >= 0) {
+        parser->remaining = (unsigned long long) parser->content_length;
+        parser->state = parser->remaining > 0 ? HTTP_PARSE_BODY_LENGTH : HTTP_PARSE_DONE;
+    } else {
+        // No framing information: the body ends when the server closes
+        parser->keep_alive = 0;
+        parser->state = HTTP_PARSE_BODY_UNTIL_CLOSE;
+    }
+}
+
+/**
+ * Parses "1a2b[;extension]".
+ */
+static int parse_chunk_size(struct http_parser *parser, const char *line, size_t len) {
+    unsigned long long size = 0;
+    size_t i;
+
+    for (i = 0; i < len && line[i] != ';' && line[i] != ' ' && line[i] != '\t'; i++) {
+        int digit;
+        char c = line[i];
+
+        if (c >= '0' && c <= '9') {
+            digit = c - '0';
+        } else if (c >= 'a' && c <= 'f') {
+            digit = c - 'a' + 10;
+        } else if (c >= 'A' && c <= 'F') {
+            digit = c - 'A' + 10;
+        } else {
+            return -1;
+        }
+        // Refuse sizes that would overflow
+        if (size > (~0ULL >> 4)) {
+            return -1;
+        }
+        size = (size << 4) | (unsigned long long) digit;
+    }
+    if (i == 0) {
+        return -1;
+    }
+
+    parser->remaining = size;
+    parser->state = size > 0 ? HTTP_PARSE_CHUNK_DATA : HTTP_PARSE_TRAILERS;
+    return 0;
+}
+
+/**
+ * Handles one complete line (without its CRLF) in a line-oriented state.
+ */
+static int process_line(struct http_parser *parser, const char *line, size_t len) {
+    switch (parser->state) {
+        case HTTP_PARSE_STATUS_LINE:
+            // Tolerate stray empty lines before the status line
+            if (len == 0) {
+                return 0;
+            }
+            if (parse_status_line(parser, line, len) < 0) {
+                return -1;
+            }
+            parser->state = HTTP_PARSE_HEADERS;
+            return 0;
+        case HTTP_PARSE_HEADERS:
+            if (len == 0) {
+                end_of_headers(parser);
+                return 0;
+            }
+            return parse_header_line(parser, line, len);
+        case HTTP_PARSE_CHUNK_SIZE:
+            return parse_chunk_size(parser, line, len);
+        case HTTP_PARSE_CHUNK_DATA_END:
+            if (len != 0) {
+                return -1;
+            }
+            parser->state = HTTP_PARSE_CHUNK_SIZE;
+            return 0;
+        case HTTP_PARSE_TRAILERS:
+            if (len == 0) {
+                parser->state = HTTP_PARSE_DONE;
+                return 0;
+            }
+            return parse_header_line(parser, line, len);
+        default:
+            return -1;
+    }
+}
+
+void http_parser_init(struct http_parser *parser, int head_request) {
+    parser->state = HTTP_PARSE_STATUS_LINE;
+    parser->status_code = 0;
+    parser->http_minor = 1;
+    parser->keep_alive = 0;
+    parser->chunked = 0;
+    parser->content_length = -1;
+    parser->remaining = 0;
+    parser->head_request = head_request;
+    parser->line_len = 0;
+    parser->on_header = NULL;
+    parser->header_ctx = NULL;
+    parser->on_body = NULL;
+    parser->ctx = NULL;
+}
+
+long http_parser_feed(struct http_parser *parser, const char *data, size_t len) {
+    size_t pos = 0;
+
+    while (pos < len && parser->state != HTTP_PARSE_DONE) {
+        switch (parser->state) {
+            case HTTP_PARSE_BODY_LENGTH:
+            case HTTP_PARSE_CHUNK_DATA: {
+                size_t n = len - pos;
+                if (n > parser->remaining) {
+                    n = (size_t) parser->remaining;
+                }
+                if (parser->on_body != NULL) {
+                    parser->on_body(parser->ctx, data + pos, n);
+                }
+                pos += n;
+                parser->remaining -= n;
+                if (parser->remaining == 0) {
+                    parser->state = parser->state == HTTP_PARSE_CHUNK_DATA
+                        ? HTTP_PARSE_CHUNK_DATA_END : HTTP_PARSE_DONE;
+                }
+                break;
+            }
+            case HTTP_PARSE_BODY_UNTIL_CLOSE:
+                if (parser->on_body != NULL) {
+                    parser->on_body(parser->ctx, data + pos, len - pos);
+                }
+                pos = len;
+                break;
+            case HTTP_PARSE_ERROR:
+                return -1;
+            default: {
+                // Line-oriented states: find the end of the current line
+                const char *newline = memchr(data + pos, '\n', len - pos);
+                size_t chunk_len = (newline != NULL ? (size_t) (newline - (data + pos)) : len - pos);
+                const char *line;
+                size_t line_len;
+
+                if (newline != NULL && parser->line_len == 0) {
+                    // Whole line available in the input, parse it in place
+                    line = data + pos;
+                    line_len = chunk_len;
+                } else {
+                    // Line spans several reads, collect it in the line buffer
+                    if (parser->line_len + chunk_len > HTTP_PARSER_LINE_MAX) {
+                        parser->state = HTTP_PARSE_ERROR;
+                        return -1;
+                    }
+                    memcpy(parser->line + parser->line_len, data + pos, chunk_len);
+                    parser->line_len += chunk_len;
+                    if (newline == NULL) {
+                        pos = len;
+                        break;
+                    }
+                    line = parser->line;
+                    line_len = parser->line_len;
+                }
+                pos += chunk_len + 1; // consume the line and its '\n'
+                parser->line_len = 0;
+
+                // Drop the '\r' of the CRLF (a bare LF is tolerated)
+                if (line_len > 0 && line[line_len - 1] == '\r') {
+                    line_len--;
+                }
+                if (process_line(parser, line, line_len) < 0) {
+                    parser->state = HTTP_PARSE_ERROR;
+                    return -1;
+                }
+                break;
+            }
+        }
+    }
+
+    return (long) pos;
+}
+
+int http_parser_finish(struct http_parser *parser) {
+    if (parser->state == HTTP_PARSE_BODY_UNTIL_CLOSE) {
+        parser->state = HTTP_PARSE_DONE;
+    }
+    return parser->state == HTTP_PARSE_DONE ? 0 : -1;
+}
+
+int http_parser_done(const struct http_parser *parser) {
+    return parser->state == HTTP_PARSE_DONE;
+}
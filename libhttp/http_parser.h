@@ -0,0 +1,98 @@
+/**
+ * Incremental HTTP/1.1 response parser.
+ *
+ * The parser is fed whatever `recv()` returned, in pieces of any size, and
+ * keeps enough state to continue where the previous piece ended. It reads the
+ * status line and the headers and then uses `Content-Length` or
+ * `Transfer-Encoding: chunked` to find the end of the body, so a client can
+ * tell that a response is complete without waiting for the server to close
+ * the connection (or for a timeout to fire).
+ *
+ * The parser does not allocate. Headers and (de-chunked) body bytes are handed
+ * to optional callbacks as they are recognised.
+ */
+#ifndef HTTP_PARSER_H
+#define HTTP_PARSER_H
+
+#include <stddef.h>
+
+// Longest status, header, chunk-size or trailer line that is accepted
+#define HTTP_PARSER_LINE_MAX 8192
+
+// Where the parser is within the response
+enum http_parser_state {
+    HTTP_PARSE_STATUS_LINE,     // waiting for "HTTP/1.x 200 OK"
+    HTTP_PARSE_HEADERS,         // header lines until the empty line
+    HTTP_PARSE_BODY_LENGTH,     // body delimited by Content-Length
+    HTTP_PARSE_BODY_UNTIL_CLOSE,// body delimited by the connection closing
+    HTTP_PARSE_CHUNK_SIZE,      // hexadecimal chunk size line
+    HTTP_PARSE_CHUNK_DATA,      // chunk payload
+    HTTP_PARSE_CHUNK_DATA_END,  // CRLF that follows every chunk payload
+    HTTP_PARSE_TRAILERS,        // trailer lines after the last (0) chunk
+    HTTP_PARSE_DONE,            // a complete response has been parsed
+    HTTP_PARSE_ERROR            // malformed input, the connection is unusable
+};
+
+// Called for every header (and trailer) line. The strings are not
+// null-terminated and are only valid during the call.
+typedef void (*http_header_cb)(void *ctx, const char *name, size_t name_len,
+                               const char *value, size_t value_len);
+
+// Called for every piece of body data, after chunked framing was removed.
+typedef void (*http_body_cb)(void *ctx, const char *data, size_t len);
+
+struct http_parser {
+    enum http_parser_state state;
+    int status_code;               // e.g. 200, valid once the status line was read
+    int http_minor;                // 0 for HTTP/1.0, 1 for HTTP/1.1
+    int keep_alive;                // may the connection carry another request?
+    int chunked;                   // Transfer-Encoding: chunked
+    long long content_length;      // -1 if the header was absent
+    unsigned long long remaining;  // body or chunk bytes still expected
+    int head_request;              // response to HEAD: headers only, never a body
+    size_t line_len;               // bytes of a partial line kept in `line`
+    char line[HTTP_PARSER_LINE_MAX];
+
+    http_header_cb on_header;      // optional
+    void *header_ctx;              // passed to on_header
+    http_body_cb on_body;          // optional (see http_sink.h)
+    void *ctx;                     // passed to on_body
+};
+
+/**
+ * Prepares the parser for a new response.
+ *
+ * @param parser The parser to initialise.
+ * @param head_request Non-zero if the response answers a HEAD request (such a
+ *                     response never has a body, whatever its headers say).
+ */
+void http_parser_init(struct http_parser *parser, int head_request);
+
+/**
+ * Feeds received bytes to the parser.
+ *
+ * Parsing stops at the end of the response, so bytes that belong to a
+ * following (pipelined) response are left unconsumed.
+ *
+ * @param parser The parser.
+ * @param data The received bytes.
+ * @param len Number of bytes in `data`.
+ * @return The number of bytes consumed, or -1 if the response is malformed.
+ */
+long http_parser_feed(struct http_parser *parser, const char *data, size_t len);
+
+/**
+ * Tells the parser that the peer closed the connection.
+ *
+ * @param parser The parser.
+ * @return 0 if the response is complete (either it already was, or its body
+ *         was delimited by the close), -1 if it was cut short.
+ */
+int http_parser_finish(struct http_parser *parser);
+
+/**
+ * @return Non-zero once a complete response has been parsed.
+ */
+int http_parser_done(const struct http_parser *parser);
+
+#endif // HTTP_PARSER_H
@@ -0,0 +1,281 @@
+/**
+ * Fast scanning of HTTP heads, see http_scan.h.
+ */
+#include <string.h>
+#include "http_scan.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+  #define HTTP_SCAN_X86
+  #include <immintrin.h>
+#endif
+
+// Searches data[start, len) for the end of a head, see head_end_scalar()
+typedef long (*head_end_fn)(const char *data, size_t start, size_t len);
+
+// Slots of the perfect hash of the well-known header names
+#define KNOWN_SLOTS 16
+
+// The well-known headers, each in the slot given by known_slot()
+static const struct {
+    const char *name;            // lower case
+    size_t len;
+    enum http_header_id id;
+} known_headers[KNOWN_SLOTS] = {
+    [0] = {"set-cookie", 10, HTTP_HEADER_SET_COOKIE},
+    [1] = {"date", 4, HTTP_HEADER_DATE},
+    [4] = {"content-type", 12, HTTP_HEADER_CONTENT_TYPE},
+    [5] = {"server", 6, HTTP_HEADER_SERVER},
+    [8] = {"keep-alive", 10, HTTP_HEADER_KEEP_ALIVE},
+    [9] = {"connection", 10, HTTP_HEADER_CONNECTION},
+    [10] = {"location", 8, HTTP_HEADER_LOCATION},
+    [11] = {"content-length", 14, HTTP_HEADER_CONTENT_LENGTH},
+    [13] = {"transfer-encoding", 17, HTTP_HEADER_TRANSFER_ENCODING},
+    [14] = {"content-encoding", 16, HTTP_HEADER_CONTENT_ENCODING},
+};
+
+static int lower(int c) {
+    return c >= 'A' && c <= 'Z' ? c + ('a' - 'A') : c;
+}
+
+/**
+ * The perfect hash: length, first and last character tell all the well-known
+ * names apart (the constants were searched for that).
+ */
+static unsigned int known_slot(const char *name, size_t len) {
+    return (unsigned int) (len * 2 + lower((unsigned char) name[0]) * 13
+                           + lower((unsigned char) name[len - 1])) % KNOWN_SLOTS;
+}
+
+/**
+ * Checks whether the LF at `pos` is followed by an empty line.
+ *
+ * @return The offset past the empty line, or -1.
+ */
+static long empty_line_after(const char *data, size_t pos, size_t len) {
+    if (pos + 1 < len && data[pos + 1] == '\n') {
+        return (long) pos + 2;
+    }
+    if (pos + 2 < len && data[pos + 1] == '\r' && data[pos + 2] == '\n') {
+        return (long) pos + 3;
+    }
+    return -1;
+}
+
+/**
+ * Finds an LF followed by an empty line in data[start, len), one line at a
+ * time.
+ *
+ * @return The offset past the empty line, or -1.
+ */
+static long head_end_scalar(const char *data, size_t start, size_t len) {
+    const char *end = data + len;
+    const char *p = data + start;
+
+    while (p < end && (p = memchr(p, '\n', end - p)) != NULL) {
+        long found = empty_line_after(data, p - data, len);
+        if (found >= 0) {
+            return found;
+        }
+        p++;
+    }
+    return -1;
+}
+
+#ifdef HTTP_SCAN_X86
+/**
+ * Same as head_end_scalar(), 16 bytes at a time: a byte is a candidate if it
+ * is an LF and the byte after it is a CR or an LF, so ordinary line ends are
+ * skipped without looking at them one by one.
+ */
+__attribute__((target("sse2")))
+static long head_end_sse2(const char *data, size_t start, size_t len) {
+    const __m128i lf = _mm_set1_epi8('\n');
+    const __m128i cr = _mm_set1_epi8('\r');
+    size_t i = start;
+
+    for (; i + 17 <= len; i += 16) {
+        __m128i here = _mm_loadu_si128((const __m128i *) (data + i));
+        __m128i next = _mm_loadu_si128((const __m128i *) (data + i + 1));
+        __m128i line_break = _mm_or_si128(_mm_cmpeq_epi8(next, lf), _mm_cmpeq_epi8(next, cr));
+        unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(here, lf), line_break));
+
+        while (mask != 0) {
+            long found = empty_line_after(data, i + __builtin_ctz(mask), len);
+            if (found >= 0) {
+                return found;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return head_end_scalar(data, i, len);
+}
+
+/**
+ * Same as head_end_sse2(), 32 bytes at a time.
+ */
+__attribute__((target("avx2")))
+static long head_end_avx2(const char *data, size_t start, size_t len) {
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i cr = _mm256_set1_epi8('\r');
+    size_t i = start;
+
+    for (; i + 33 <= len; i += 32) {
+        __m256i here = _mm256_loadu_si256((const __m256i *) (data + i));
+        __m256i next = _mm256_loadu_si256((const __m256i *) (data + i + 1));
+        __m256i line_break = _mm256_or_si256(_mm256_cmpeq_epi8(next, lf), _mm256_cmpeq_epi8(next, cr));
+        unsigned int mask = (unsigned int) _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(here, lf), line_break));
+
+        while (mask != 0) {
+            long found = empty_line_after(data, i + __builtin_ctz(mask), len);
+            if (found >= 0) {
+                return found;
+            }
+            mask &= mask - 1;
+        }
+    }
+    return head_end_sse2(data, i, len);
+}
+#endif
+
+// The version in use, and its name
+static head_end_fn head_end = head_end_scalar;
+static const char *head_end_isa = "scalar";
+
+#ifdef HTTP_SCAN_X86
+/**
+ * Picks the widest instruction set the CPU supports, once, before main().
+ */
+__attribute__((constructor))
+static void choose_isa(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        http_scan_set_isa("avx2");
+    } else if (__builtin_cpu_supports("sse2")) {
+        http_scan_set_isa("sse2");
+    }
+}
+#endif
+
+int http_scan_set_isa(const char *isa) {
+    if (strcmp(isa, "scalar") == 0) {
+        head_end = head_end_scalar;
+        head_end_isa = "scalar";
+        return 0;
+    }
+#ifdef HTTP_SCAN_X86
+    __builtin_cpu_init();
+    if (strcmp(isa, "sse2") == 0 && __builtin_cpu_supports("sse2")) {
+        head_end = head_end_sse2;
+        head_end_isa = "sse2";
+        return 0;
+    }
+    if (strcmp(isa, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+        head_end = head_end_avx2;
+        head_end_isa = "avx2";
+        return 0;
+    }
+#endif
+    return -1;
+}
+
+const char *http_scan_isa(void) {
+    return head_end_isa;
+}
+
+void http_head_scan_init(struct http_head_scan *scan) {
+    scan->state = 0;
+}
+
+long http_head_scan(struct http_head_scan *scan, const char *data, size_t len) {
+    size_t i = 0;
+    long found;
+
+    // Finish a terminator that began at the end of the previous piece
+    while (i < len && scan->state != 0) {
+        char c = data[i++];
+        if (c == '\n') {
+            scan->state = 0;
+            return (long) i;
+        }
+        scan->state = c == '\r' && scan->state == 1 ? 2 : 0;
+    }
+    if (i == len) {
+        return -1;
+    }
+
+    found = head_end(data, i, len);
+    if (found >= 0) {
+        return found;
+    }
+
+    // Remember a terminator that may continue in the next piece
+    if (data[len - 1] == '\n') {
+        scan->state = 1;
+    } else if (data[len - 1] == '\r' && len - i >= 2 && data[len - 2] == '\n') {
+        scan->state = 2;
+    }
+    return -1;
+}
+
+int http_split_headers(const char *head, size_t len, struct http_header_slice *slices, int max) {
+    size_t pos = 0;
+    int count = 0;
+
+    while (pos < len) {
+        const char *newline = memchr(head + pos, '\n', len - pos);
+        size_t end = newline != NULL ? (size_t) (newline - head) : len;
+        size_t next = newline != NULL ? end + 1 : len;
+        const char *colon;
+        struct http_header_slice *slice;
+        size_t value;
+
+        if (end > pos && head[end - 1] == '\r') {
+            end--;
+        }
+        if (end == pos) {
+            break;  // the empty line that ends the head
+        }
+        colon = memchr(head + pos, ':', end - pos);
+        if (colon == NULL || colon == head + pos || count == max) {
+            return -1;
+        }
+
+        slice = &slices[count++];
+        slice->name_off = (unsigned int) pos;
+        slice->name_len = (unsigned int) (colon - (head + pos));
+        slice->id = http_header_lookup(head + pos, slice->name_len);
+
+        // Strip optional white space around the value
+        value = colon + 1 - head;
+        while (value < end && (head[value] == ' ' || head[value] == '\t')) {
+            value++;
+        }
+        while (end > value && (head[end - 1] == ' ' || head[end - 1] == '\t')) {
+            end--;
+        }
+        slice->value_off = (unsigned int) value;
+        slice->value_len = (unsigned int) (end - value);
+        pos = next;
+    }
+    return count;
+}
+
+enum http_header_id http_header_lookup(const char *name, size_t len) {
+    unsigned int slot;
+    size_t i;
+
+    if (len == 0 || len > 17) {
+        return HTTP_HEADER_OTHER;
+    }
+    slot = known_slot(name, len);
+    if (known_headers[slot].len != len) {
+        return HTTP_HEADER_OTHER;
+    }
+    for (i = 0; i < len; i++) {
+        if (lower((unsigned char) name[i]) != known_headers[slot].name[i]) {
+            return HTTP_HEADER_OTHER;
+        }
+    }
+    return known_headers[slot].id;
+}
@@ -0,0 +1,98 @@
+/**
+ * Fast scanning of HTTP heads.
+ *
+ * - http_head_scan() finds the empty line that ends a head. It is fed the
+ *   pieces returned by recv() and remembers a partial terminator at the end
+ *   of a piece, so "\r\n" + "\r\n" split across two reads is still found.
+ *   The bytes are compared 16 (SSE2) or 32 (AVX2) at a time; the instruction
+ *   set is picked at run time, with a scalar version for other CPUs.
+ * - http_split_headers() cuts a complete head into (offset, length) slices
+ *   of names and values without copying anything.
+ * - http_header_lookup() recognises the well-known headers with a perfect
+ *   hash: one table probe and one comparison instead of a chain of string
+ *   comparisons.
+ */
+#ifndef HTTP_SCAN_H
+#define HTTP_SCAN_H
+
+#include <stddef.h>
+
+// Headers recognised by http_header_lookup()
+enum http_header_id {
+    HTTP_HEADER_OTHER,
+    HTTP_HEADER_CONTENT_LENGTH,
+    HTTP_HEADER_TRANSFER_ENCODING,
+    HTTP_HEADER_CONNECTION,
+    HTTP_HEADER_CONTENT_TYPE,
+    HTTP_HEADER_CONTENT_ENCODING,
+    HTTP_HEADER_KEEP_ALIVE,
+    HTTP_HEADER_DATE,
+    HTTP_HEADER_SERVER,
+    HTTP_HEADER_LOCATION,
+    HTTP_HEADER_SET_COOKIE
+};
+
+// Progress of the search for the end of a head, across pieces of input
+struct http_head_scan {
+    int state;                   // 0, 1 after a LF, 2 after LF CR
+};
+
+// One header line of a head, as offsets into the head
+struct http_header_slice {
+    unsigned int name_off;
+    unsigned int name_len;
+    unsigned int value_off;      // white space around the value is excluded
+    unsigned int value_len;
+    enum http_header_id id;
+};
+
+/**
+ * Prepares a scan for a new head.
+ */
+void http_head_scan_init(struct http_head_scan *scan);
+
+/**
+ * Looks for the end of the head in the next piece of input.
+ *
+ * @param scan The scan, carried from one piece to the next.
+ * @param data The piece.
+ * @param len Number of bytes in `data`.
+ * @return The offset in `data` just past the empty line that ends the head,
+ *         or -1 if the head does not end in this piece.
+ */
+long http_head_scan(struct http_head_scan *scan, const char *data, size_t len);
+
+/**
+ * Cuts the header lines of a head into slices. Lines end with CRLF or a bare
+ * LF; the split stops at the first empty line or at the end of `head`.
+ *
+ * @param head The header lines (without the request or status line).
+ * @param len Number of bytes in `head`.
+ * @param slices Receives one slice per header.
+ * @param max Number of entries in `slices`.
+ * @return The number of headers, or -1 if a line has no colon or there are
+ *         more than `max` headers.
+ */
+int http_split_headers(const char *head, size_t len, struct http_header_slice *slices, int max);
+
+/**
+ * Identifies a header name, ignoring its case.
+ *
+ * @return The id of a well-known header, or HTTP_HEADER_OTHER.
+ */
+enum http_header_id http_header_lookup(const char *name, size_t len);
+
+/**
+ * @return The instruction set the scanner uses: "avx2", "sse2" or "scalar".
+ */
+const char *http_scan_isa(void);
+
+/**
+ * Forces the instruction set of the scanner, e.g. to compare them.
+ *
+ * @param isa "avx2", "sse2" or "scalar".
+ * @return 0 on success, -1 if the CPU does not support `isa`.
+ */
+int http_scan_set_isa(const char *isa);
+
+#endif // HTTP_SCAN_H
@@ -0,0 +1,149 @@
+/**
+ * Response sinks, see http_sink.h.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifdef _WIN32
+  #include <io.h>
+  #define write _write
+#else
+  #include <unistd.h>
+#endif
+#include "http_sink.h"
+
+/**
+ * Makes room for `extra` more bytes in a memory sink. The first allocation
+ * uses the Content-Length of the response when it is known, so a framed body
+ * is allocated exactly once; otherwise the buffer doubles as needed.
+ */
+static int reserve(struct http_sink *sink, size_t extra) {
+    size_t needed = sink->len + extra;
+    size_t capacity = sink->capacity;
+    char *data;
+
+    if (sink->limit > 0 && needed > sink->limit) {
+        return -1;
+    }
+    if (needed <= capacity && sink->data != NULL) {
+        return 0;
+    }
+
+    if (sink->data == NULL && sink->parser != NULL && sink->parser->content_length >= 0
+            && !sink->parser->chunked && (size_t) sink->parser->content_length >= needed) {
+        capacity = (size_t) sink->parser->content_length;
+    } else {
+        if (capacity < 4096) {
+            capacity = 4096;
+        }
+        while (capacity < needed) {
+            capacity *= 2;
+        }
+    }
+    if (sink->limit > 0 && capacity > sink->limit) {
+        capacity = sink->limit;
+    }
+
+    data = realloc(sink->data, capacity + 1);  // +1 for the terminator
+    if (data == NULL) {
+        return -1;
+    }
+    sink->data = data;
+    sink->capacity = capacity;
+    return 0;
+}
+
+/**
+ * Parser body callback: routes a piece of the body to the sink.
+ */
+static void sink_write(void *ctx, const char *data, size_t len) {
+    struct http_sink *sink = ctx;
+
+    if (sink->failed) {
+        return;
+    }
+    sink->total += len;
+
+    switch (sink->type) {
+        case HTTP_SINK_CALLBACK:
+            sink->callback(sink->ctx, data, len);
+            break;
+        case HTTP_SINK_FD:
+            while (len > 0) {
+                long written = write(sink->fd, data, (unsigned) len);
+                if (written < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    sink->failed = 1;
+                    return;
+                }
+                data += written;
+                len -= (size_t) written;
+            }
+            break;
+        case HTTP_SINK_MEMORY:
+            if (reserve(sink, len) < 0) {
+                sink->failed = 1;
+                return;
+            }
+            memcpy(sink->data + sink->len, data, len);
+            sink->len += len;
+            sink->data[sink->len] = '\0';
+            break;
+    }
+}
+
+/**
+ * Sets the fields common to every sink.
+ */
+static void sink_init(struct http_sink *sink, enum http_sink_type type) {
+    memset(sink, 0, sizeof(*sink));
+    sink->type = type;
+    sink->fd = -1;
+}
+
+void http_sink_callback(struct http_sink *sink, http_body_cb callback, void *ctx) {
+    sink_init(sink, HTTP_SINK_CALLBACK);
+    sink->callback = callback;
+    sink->ctx = ctx;
+}
+
+void http_sink_fd(struct http_sink *sink, int fd) {
+    sink_init(sink, HTTP_SINK_FD);
+    sink->fd = fd;
+}
+
+void http_sink_memory(struct http_sink *sink, size_t limit) {
+    sink_init(sink, HTTP_SINK_MEMORY);
+    sink->limit = limit;
+}
+
+void http_sink_attach(struct http_sink *sink, struct http_parser *parser) {
+    sink->parser = parser;
+    parser->on_body = sink_write;
+    parser->ctx = sink;
+}
+
+char *http_sink_take(struct http_sink *sink, size_t *len) {
+    char *data = sink->data;
+
+    // A response without a body still yields an (empty) string
+    if (data == NULL) {
+        data = calloc(1, 1);
+    }
+    if (len != NULL) {
+        *len = sink->len;
+    }
+    sink->data = NULL;
+    sink->len = 0;
+    sink->capacity = 0;
+    return data;
+}
+
+void http_sink_free(struct http_sink *sink) {
+    free(sink->data);
+    sink->data = NULL;
+    sink->len = 0;
+    sink->capacity = 0;
+}
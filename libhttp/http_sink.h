@@ -0,0 +1,88 @@
+/**
+ * Response sinks: where the body of a response goes while it is parsed.
+ *
+ * A sink is attached to an http_parser and receives the (de-chunked) body
+ * piece by piece, as it arrives. Three kinds are available:
+ *
+ *  - callback: every piece is handed to a user function,
+ *  - fd:       every piece is written straight to a file descriptor (a file,
+ *              a pipe, stdout), so downloads of any size use constant memory,
+ *  - memory:   the body is collected in one buffer; when the response has a
+ *              Content-Length, the buffer is allocated once with exactly that
+ *              size instead of being grown piece by piece.
+ */
+#ifndef HTTP_SINK_H
+#define HTTP_SINK_H
+
+#include <stddef.h>
+#include "http_parser.h"
+
+enum http_sink_type {
+    HTTP_SINK_CALLBACK,
+    HTTP_SINK_FD,
+    HTTP_SINK_MEMORY
+};
+
+struct http_sink {
+    enum http_sink_type type;
+    int failed;                  // set once a write or an allocation failed
+    unsigned long long total;    // body bytes received so far
+
+    // HTTP_SINK_CALLBACK
+    http_body_cb callback;
+    void *ctx;
+
+    // HTTP_SINK_FD
+    int fd;
+
+    // HTTP_SINK_MEMORY
+    char *data;                  // null-terminated body (owned by the sink)
+    size_t len;                  // body bytes in `data`
+    size_t capacity;             // allocated bytes, excluding the terminator
+    size_t limit;                // refuse bodies larger than this (0: no limit)
+
+    const struct http_parser *parser; // set by http_sink_attach()
+};
+
+/**
+ * Creates a sink that passes every piece of the body to `callback`.
+ */
+void http_sink_callback(struct http_sink *sink, http_body_cb callback, void *ctx);
+
+/**
+ * Creates a sink that writes the body to the file descriptor `fd`. The
+ * descriptor is not closed by the sink.
+ */
+void http_sink_fd(struct http_sink *sink, int fd);
+
+/**
+ * Creates a sink that collects the body in memory.
+ *
+ * @param sink The sink.
+ * @param limit The largest body accepted (0 for no limit); a larger body makes
+ *              the sink fail instead of exhausting memory.
+ */
+void http_sink_memory(struct http_sink *sink, size_t limit);
+
+/**
+ * Connects a sink to a parser, so that the parser's body callback feeds it.
+ * Call this after http_parser_init() and before the first http_parser_feed().
+ */
+void http_sink_attach(struct http_sink *sink, struct http_parser *parser);
+
+/**
+ * Hands over the body collected by a memory sink.
+ *
+ * @param sink The sink.
+ * @param len Receives the length of the body (may be NULL).
+ * @return The null-terminated body (to be freed by the caller), or NULL if
+ *         memory could not be allocated. The sink no longer owns it.
+ */
+char *http_sink_take(struct http_sink *sink, size_t *len);
+
+/**
+ * Frees what a sink holds (the buffer of a memory sink).
+ */
+void http_sink_free(struct http_sink *sink);
+
+#endif // HTTP_SINK_H
@@ -0,0 +1,125 @@
+/**
+ * Pre-compiled request heads, see http_template.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "http_template.h"
+
+// Header name in front of the Content-Length field
+#define LENGTH_HEADER "Content-Length:"
+
+// Marks a template without a Content-Length field
+#define NO_LENGTH_FIELD ((size_t) -1)
+
+/**
+ * Makes room for a head of `len` bytes (plus the terminator).
+ */
+static int reserve(struct http_template *tpl, size_t len) {
+    char *head;
+
+    if (len <= tpl->capacity && tpl->head != NULL) {
+        return 0;
+    }
+    head = realloc(tpl->head, len + 1);
+    if (head == NULL) {
+        return -1;
+    }
+    tpl->head = head;
+    tpl->capacity = len;
+    return 0;
+}
+
+int http_template_init(struct http_template *tpl, const char *method, const char *path,
+                       const char *host, const char *headers, enum http_template_body body) {
+    const char *framing = "";
+    size_t method_len = strlen(method);
+    int len;
+
+    memset(tpl, 0, sizeof(*tpl));
+    tpl->length_field = NO_LENGTH_FIELD;
+    if (headers == NULL) {
+        headers = "";
+    }
+    if (body == HTTP_TEMPLATE_CHUNKED) {
+        framing = "Transfer-Encoding: chunked\r\n";
+    }
+
+    // Everything after the path: measure, then format once
+    len = snprintf(NULL, 0, " HTTP/1.1\r\nHost: %s\r\n%s%s", host, headers, framing);
+    tpl->rest_len = len + 2;
+    if (body == HTTP_TEMPLATE_LENGTH) {
+        tpl->length_field = len + strlen(LENGTH_HEADER);
+        tpl->rest_len += strlen(LENGTH_HEADER) + HTTP_TEMPLATE_LENGTH_WIDTH + 2;
+    }
+    tpl->rest = malloc(tpl->rest_len + 1);
+    if (tpl->rest == NULL) {
+        return -1;
+    }
+    snprintf(tpl->rest, tpl->rest_len + 1, " HTTP/1.1\r\nHost: %s\r\n%s%s", host, headers, framing);
+    if (body == HTTP_TEMPLATE_LENGTH) {
+        // The value is right-aligned in a field of spaces, see http_template_set_length()
+        snprintf(tpl->rest + len, tpl->rest_len + 1 - len, "%s%*d\r\n", LENGTH_HEADER,
+                 HTTP_TEMPLATE_LENGTH_WIDTH, 0);
+    }
+    memcpy(tpl->rest + tpl->rest_len - 2, "\r\n", 3);
+
+    // The method and its space never change, the path follows
+    if (reserve(tpl, method_len + 1 + strlen(path) + tpl->rest_len) < 0) {
+        free(tpl->rest);
+        tpl->rest = NULL;
+        return -1;
+    }
+    memcpy(tpl->head, method, method_len);
+    tpl->head[method_len] = ' ';
+    tpl->path_offset = method_len + 1;
+    tpl->path_len = (size_t) -1;  // forces the rest to be copied in
+    return http_template_set_path(tpl, path, strlen(path));
+}
+
+int http_template_set_path(struct http_template *tpl, const char *path, size_t len) {
+    if (len != tpl->path_len) {
+        // The rest moves with the end of the path (it carries the current Content-Length along)
+        size_t head_len = tpl->path_offset + len + tpl->rest_len;
+        const char *rest = tpl->rest;
+
+        if (reserve(tpl, head_len) < 0) {
+            return -1;
+        }
+        if (tpl->path_len != (size_t) -1) {
+            rest = tpl->head + tpl->path_offset + tpl->path_len;
+        }
+        memmove(tpl->head + tpl->path_offset + len, rest, tpl->rest_len);
+        tpl->head[head_len] = '\0';
+        tpl->head_len = head_len;
+        tpl->path_len = len;
+    }
+    memcpy(tpl->head + tpl->path_offset, path, len);
+    return 0;
+}
+
+void http_template_set_length(struct http_template *tpl, size_t body_len) {
+    char *field;
+    int i = HTTP_TEMPLATE_LENGTH_WIDTH;
+
+    if (tpl->length_field == NO_LENGTH_FIELD) {
+        return;
+    }
+    field = tpl->head + tpl->path_offset + tpl->path_len + tpl->length_field;
+
+    // Digits from the right, spaces in front
+    do {
+        field[--i] = (char) ('0' + body_len % 10);
+        body_len /= 10;
+    } while (body_len > 0 && i > 0);
+    while (i > 0) {
+        field[--i] = ' ';
+    }
+}
+
+void http_template_free(struct http_template *tpl) {
+    free(tpl->head);
+    free(tpl->rest);
+    tpl->head = NULL;
+    tpl->rest = NULL;
+}
@@ -0,0 +1,78 @@
+/**
+ * Pre-compiled request heads.
+ *
+ * Requests of one workload usually differ only in their body and path: the
+ * method, the headers and their order stay the same. A template formats those
+ * constant bytes once. Per request, only the variable fields are patched in
+ * place:
+ *
+ *  - the Content-Length digits, written right-aligned into a field of
+ *    HTTP_TEMPLATE_LENGTH_WIDTH characters that is padded with spaces (white
+ *    space before a header value is allowed), so the head never changes size
+ *    when the body does,
+ *  - the path, which is copied in front of the constant rest of the head.
+ *
+ * Building a request is then a couple of memcpy() calls and a few digit
+ * stores instead of a snprintf() of the whole head.
+ */
+#ifndef HTTP_TEMPLATE_H
+#define HTTP_TEMPLATE_H
+
+#include <stddef.h>
+
+// Characters reserved for the value of Content-Length (enough for any size_t)
+#define HTTP_TEMPLATE_LENGTH_WIDTH 20
+
+// How the body of the requests is framed
+enum http_template_body {
+    HTTP_TEMPLATE_NO_BODY,       // no body, no framing header
+    HTTP_TEMPLATE_LENGTH,        // Content-Length, patched per request
+    HTTP_TEMPLATE_CHUNKED        // Transfer-Encoding: chunked
+};
+
+struct http_template {
+    char *head;                  // the current head (null-terminated)
+    size_t head_len;             // length of the current head
+    size_t capacity;             // allocated bytes, excluding the terminator
+    size_t path_offset;          // where the path starts (after the method)
+    size_t path_len;             // length of the current path
+    char *rest;                  // constant bytes that follow the path
+    size_t rest_len;             // length of `rest`
+    size_t length_field;         // offset of the Content-Length value in `rest`,
+                                 // or (size_t) -1 without one
+};
+
+/**
+ * Formats the constant bytes of a request head once.
+ *
+ * @param tpl The template to create.
+ * @param method The method, e.g. "POST".
+ * @param path The initial path, e.g. "/api" (see http_template_set_path).
+ * @param host The value of the Host header.
+ * @param headers Further header lines, each ending with "\r\n", or NULL.
+ * @param body How the body is framed.
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int http_template_init(struct http_template *tpl, const char *method, const char *path,
+                       const char *host, const char *headers, enum http_template_body body);
+
+/**
+ * Replaces the path. The constant rest of the head is copied behind it, and
+ * only when the length of the path changes.
+ *
+ * @return 0 on success, -1 if memory could not be allocated.
+ */
+int http_template_set_path(struct http_template *tpl, const char *path, size_t len);
+
+/**
+ * Writes the Content-Length of the next request into the head, in place.
+ * Does nothing for a template without a Content-Length header.
+ */
+void http_template_set_length(struct http_template *tpl, size_t body_len);
+
+/**
+ * Frees the memory of a template.
+ */
+void http_template_free(struct http_template *tpl);
+
+#endif // HTTP_TEMPLATE_H
@@ -0,0 +1,220 @@
+/**
+ * Latency histograms and per-phase request timings, see latency.h.
+ */
+#include <string.h>
+#ifdef _WIN32
+  #include <windows.h>
+#else
+  #include <time.h>
+#endif
+#include "latency.h"
+
+// Half of the sub-buckets: above the exact range, a bucket holds values with the same top bits
+#define HISTOGRAM_HALF (HISTOGRAM_SUB_BUCKETS / 2)
+
+// Names of the phases, in the order of enum http_phase
+static const char *const phase_names[HTTP_PHASE_COUNT] = {
+    "dns", "connect", "send", "first_byte", "total", "corrected", "first_record", "inter_record"
+};
+
+// Percentiles that are reported
+static const double report_percentiles[] = {50.0, 90.0, 99.0, 99.9};
+
+long long latency_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) {
+        QueryPerformanceFrequency(&frequency);
+    }
+    QueryPerformanceCounter(&counter);
+    return (long long) ((double) counter.QuadPart * 1e9 / (double) frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (long long) now.tv_sec * 1000000000LL + now.tv_nsec;
+#endif
+}
+
+/**
+ * @return The index of the highest set bit of a non-zero value.
+ */
+static int highest_bit(unsigned long long value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) {
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+/**
+ * Maps a value to its counter: small values have one each, larger ones share
+ * a bucket with the values that have the same HISTOGRAM_SUB_BITS top bits.
+ */
+static int counts_index(unsigned long long value) {
+    int shift;
+
+    if (value < HISTOGRAM_SUB_BUCKETS) {
+        return (int) value;
+    }
+    // Shift that brings the value into [HALF, SUB_BUCKETS)
+    shift = highest_bit(value) - (HISTOGRAM_SUB_BITS - 1);
+    if (shift > HISTOGRAM_MAX_SHIFT) {
+        return HISTOGRAM_COUNTS - 1;
+    }
+    return HISTOGRAM_SUB_BUCKETS + (shift - 1) * HISTOGRAM_HALF + (int) (value >> shift) - HISTOGRAM_HALF;
+}
+
+/**
+ * @return The largest value counted by the counter at `index`.
+ */
+static unsigned long long highest_value_at(int index) {
+    int shift;
+    unsigned long long sub_bucket;
+
+    if (index < HISTOGRAM_SUB_BUCKETS) {
+        return (unsigned long long) index;
+    }
+    shift = (index - HISTOGRAM_SUB_BUCKETS) / HISTOGRAM_HALF + 1;
+    sub_bucket = (unsigned long long) ((index - HISTOGRAM_SUB_BUCKETS) % HISTOGRAM_HALF + HISTOGRAM_HALF);
+    return ((sub_bucket + 1) << shift) - 1;
+}
+
+void histogram_init(struct histogram *histogram) {
+    memset(histogram, 0, sizeof(*histogram));
+}
+
+void histogram_record(struct histogram *histogram, unsigned long long value) {
+    histogram->counts[counts_index(value)]++;
+    if (histogram->total == 0 || value < histogram->min) {
+        histogram->min = value;
+    }
+    if (value > histogram->max) {
+        histogram->max = value;
+    }
+    histogram->total++;
+    histogram->sum += (double) value;
+}
+
+void histogram_merge(struct histogram *target, const struct histogram *source) {
+    int i;
+
+    if (source->total == 0) {
+        return;
+    }
+    for (i = 0; i < HISTOGRAM_COUNTS; i++) {
+        target->counts[i] += source->counts[i];
+    }
+    if (target->total == 0 || source->min < target->min) {
+        target->min = source->min;
+    }
+    if (source->max > target->max) {
+        target->max = source->max;
+    }
+    target->total += source->total;
+    target->sum += source->sum;
+}
+
+unsigned long long histogram_percentile(const struct histogram *histogram, double percentile) {
+    double rank;
+    unsigned long long target;
+    unsigned long long seen = 0;
+    int i;
+
+    if (histogram->total == 0) {
+        return 0;
+    }
+    if (percentile >= 100.0) {
+        return histogram->max;
+    }
+
+    // Rank of the value we are after, rounded up (at least the first one)
+    rank = percentile / 100.0 * (double) histogram->total;
+    target = (unsigned long long) rank;
+    if ((double) target < rank || target == 0) {
+        target++;
+    }
+
+    for (i = 0; i < HISTOGRAM_COUNTS; i++) {
+        seen += histogram->counts[i];
+        if (seen >= target) {
+            unsigned long long value = highest_value_at(i);
+            // A bucket may reach beyond the largest value that was actually seen
+            return value < histogram->max ? value : histogram->max;
+        }
+    }
+    return histogram->max;
+}
+
+double histogram_mean(const struct histogram *histogram) {
+    return histogram->total > 0 ? histogram->sum / (double) histogram->total : 0.0;
+}
+
+void http_timings_init(struct http_timings *timings) {
+    int i;
+
+    for (i = 0; i < HTTP_PHASE_COUNT; i++) {
+        histogram_init(&timings->phases[i]);
+    }
+}
+
+void http_timings_record(struct http_timings *timings, enum http_phase phase, long long start_ns, long long end_ns) {
+    histogram_record(&timings->phases[phase], end_ns > start_ns ? (unsigned long long) (end_ns - start_ns) : 0);
+}
+
+void http_timings_merge(struct http_timings *target, const struct http_timings *source) {
+    int i;
+
+    for (i = 0; i < HTTP_PHASE_COUNT; i++) {
+        histogram_merge(&target->phases[i], &source->phases[i]);
+    }
+}
+
+void http_timings_print_table(const struct http_timings *timings, FILE *out) {
+    size_t p;
+    int i;
+
+    fprintf(out, "%-12s %9s %10s %10s %10s %10s %10s %10s %10s\n", "Phase (ms)", "count", "min", "mean",
+            "p50", "p90", "p99", "p99.9", "max");
+    for (i = 0; i < HTTP_PHASE_COUNT; i++) {
+        const struct histogram *histogram = &timings->phases[i];
+
+        if (histogram->total == 0) {
+            continue;
+        }
+        fprintf(out, "%-12s %9llu %10.3f %10.3f", phase_names[i], histogram->total, histogram->min / 1e6,
+                histogram_mean(histogram) / 1e6);
+        for (p = 0; p < sizeof(report_percentiles) / sizeof(report_percentiles[0]); p++) {
+            fprintf(out, " %10.3f", histogram_percentile(histogram, report_percentiles[p]) / 1e6);
+        }
+        fprintf(out, " %10.3f\n", histogram->max / 1e6);
+    }
+}
+
+void http_timings_print_json(const struct http_timings *timings, FILE *out) {
+    int first = 1;
+    int i;
+
+    fprintf(out, "{\"unit\": \"us\", \"phases\": {");
+    for (i = 0; i < HTTP_PHASE_COUNT; i++) {
+        const struct histogram *histogram = &timings->phases[i];
+
+        if (histogram->total == 0) {
+            continue;
+        }
+        fprintf(out, "%s\n  \"%s\": {\"count\": %llu, \"min\": %.3f, \"mean\": %.3f, \"p50\": %.3f, "
+                "\"p90\": %.3f, \"p99\": %.3f, \"p99.9\": %.3f, \"max\": %.3f}",
+                first ? "" : ",", phase_names[i], histogram->total, histogram->min / 1e3,
+                histogram_mean(histogram) / 1e3, histogram_percentile(histogram, 50.0) / 1e3,
+                histogram_percentile(histogram, 90.0) / 1e3, histogram_percentile(histogram, 99.0) / 1e3,
+                histogram_percentile(histogram, 99.9) / 1e3, histogram->max / 1e3);
+        first = 0;
+    }
+    fprintf(out, "\n}}\n");
+}
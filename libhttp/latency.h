@@ -0,0 +1,120 @@
+/**
+ * Latency histograms and per-phase request timings.
+ *
+ * A histogram records values (nanoseconds) HDR-style: values below 256 are
+ * counted exactly, larger ones in log-linear buckets whose width is at most
+ * 1/128 of the value, so every percentile is reported within 0.8 % however
+ * large the range. Recording is a few instructions and never allocates,
+ * which makes it cheap enough to run for every request of a benchmark.
+ *
+ * The timings group one histogram per phase of a request, so that a slow
+ * tail can be attributed to name resolution, connection setup, sending,
+ * waiting for the server or the transfer of the response.
+ *
+ * A client that only sends the next request once the previous one is
+ * answered backs off whenever the server stalls, and the requests it would
+ * have sent in the meantime are never measured ("coordinated omission").
+ * A client that sends on a fixed schedule instead records the corrected
+ * latency as well: measured from the time the schedule said the request was
+ * due, not from the time it actually left.
+ */
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <stdio.h>
+
+// Values below HISTOGRAM_SUB_BUCKETS are exact, larger ones keep this many significant bits
+#define HISTOGRAM_SUB_BITS 8
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+// Largest value that can be told apart from larger ones: 2^(HISTOGRAM_MAX_SHIFT + SUB_BITS)
+// nanoseconds, i.e. about 4.9 hours; larger values are counted in the last bucket
+#define HISTOGRAM_MAX_SHIFT 36
+#define HISTOGRAM_COUNTS (HISTOGRAM_SUB_BUCKETS + HISTOGRAM_MAX_SHIFT * (HISTOGRAM_SUB_BUCKETS / 2))
+
+struct histogram {
+    unsigned long long counts[HISTOGRAM_COUNTS];
+    unsigned long long total;      // number of recorded values
+    unsigned long long min;        // smallest recorded value (exact)
+    unsigned long long max;        // largest recorded value (exact)
+    double sum;                    // for the mean
+};
+
+// Phases of one request/response cycle
+enum http_phase {
+    HTTP_PHASE_DNS,                // resolving the host name
+    HTTP_PHASE_CONNECT,            // TCP connection setup
+    HTTP_PHASE_SEND,               // writing the request
+    HTTP_PHASE_FIRST_BYTE,         // start of the request until the first response byte
+    HTTP_PHASE_TOTAL,              // start of the request until the response is complete
+    HTTP_PHASE_CORRECTED,          // intended send time until the response is complete (open
+                                   // loop): includes the time the request waited to be sent
+    HTTP_PHASE_FIRST_RECORD,       // start of the request until the first streamed record
+    HTTP_PHASE_INTER_RECORD,       // gap between two consecutive streamed records
+    HTTP_PHASE_COUNT
+};
+
+struct http_timings {
+    struct histogram phases[HTTP_PHASE_COUNT];
+};
+
+/**
+ * @return A monotonic timestamp in nanoseconds (only differences are meaningful).
+ */
+long long latency_now_ns(void);
+
+/**
+ * Empties a histogram.
+ */
+void histogram_init(struct histogram *histogram);
+
+/**
+ * Records one value (nanoseconds).
+ */
+void histogram_record(struct histogram *histogram, unsigned long long value);
+
+/**
+ * Adds every value recorded in `source` to `target`.
+ */
+void histogram_merge(struct histogram *target, const struct histogram *source);
+
+/**
+ * @param histogram The histogram.
+ * @param percentile The percentile, from 0 to 100 (e.g. 99.9).
+ * @return The value below or at which `percentile` % of the values lie, or 0
+ *         if the histogram is empty.
+ */
+unsigned long long histogram_percentile(const struct histogram *histogram, double percentile);
+
+/**
+ * @return The mean of the recorded values, or 0 if the histogram is empty.
+ */
+double histogram_mean(const struct histogram *histogram);
+
+/**
+ * Empties all phase histograms.
+ */
+void http_timings_init(struct http_timings *timings);
+
+/**
+ * Records the duration of a phase that started at `start_ns` and ended at
+ * `end_ns` (both from latency_now_ns()).
+ */
+void http_timings_record(struct http_timings *timings, enum http_phase phase, long long start_ns, long long end_ns);
+
+/**
+ * Adds every value recorded in `source` to `target`.
+ */
+void http_timings_merge(struct http_timings *target, const struct http_timings *source);
+
+/**
+ * Prints count, min, mean, p50, p90, p99, p99.9 and max of every phase that
+ * has values, in milliseconds, as a table.
+ */
+void http_timings_print_table(const struct http_timings *timings, FILE *out);
+
+/**
+ * Writes the same figures as a JSON object, in microseconds.
+ */
+void http_timings_print_json(const struct http_timings *timings, FILE *out);
+
+#endif // LATENCY_H
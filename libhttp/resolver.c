@@ -0,0 +1,537 @@
+/**
+ * Asynchronous host name resolver, see resolver.h.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <arpa/nameser.h>
+#include <resolv.h>
+#include "resolver.h"
+
+// Longest line of a hosts file that is looked at
+#define HOSTS_LINE_MAX 1024
+
+/**
+ * @return The monotonic clock in seconds (not affected by changes of the wall clock).
+ */
+static time_t monotonic_seconds(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec;
+}
+
+/**
+ * Frees an address list built by append_addresses().
+ */
+static void free_addresses(struct addrinfo *addresses) {
+    while (addresses != NULL) {
+        struct addrinfo *next = addresses->ai_next;
+        free(addresses);
+        addresses = next;
+    }
+}
+
+/**
+ * Appends copies of the addresses returned by getaddrinfo() to a list owned by
+ * the resolver, so that answers from several calls can be merged and the
+ * result freed in one place. Every node carries its socket address in the
+ * same allocation.
+ *
+ * @return 0 on success, -1 if memory ran out.
+ */
+static int append_addresses(struct addrinfo ***tail, const struct addrinfo *source) {
+    for (; source != NULL; source = source->ai_next) {
+        struct addrinfo *copy = malloc(sizeof(struct addrinfo) + source->ai_addrlen);
+        if (copy == NULL) {
+            return -1;
+        }
+        memcpy(copy, source, sizeof(struct addrinfo));
+        copy->ai_addr = (struct sockaddr *) (copy + 1);
+        memcpy(copy->ai_addr, source->ai_addr, source->ai_addrlen);
+        copy->ai_canonname = NULL;
+        copy->ai_next = NULL;
+        **tail = copy;
+        *tail = &copy->ai_next;
+    }
+    return 0;
+}
+
+/**
+ * Looks a name up in a hosts-style file ("address name [aliases...]", '#'
+ * starts a comment). Every matching line contributes its address.
+ *
+ * @return 0 if the name was found, EAI_NONAME if it was not, another EAI_*
+ *         error if the file cannot be read.
+ */
+static int lookup_hosts_file(const char *path, const char *name, const struct addrinfo *hints,
+                             struct addrinfo **addresses) {
+    char line[HOSTS_LINE_MAX];
+    struct addrinfo **tail = addresses;
+    FILE *file = fopen(path, "r");
+
+    if (file == NULL) {
+        return EAI_SYSTEM;
+    }
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char *comment = strchr(line, '#');
+        char *save;
+        char *address;
+        char *alias;
+
+        if (comment != NULL) {
+            *comment = '\0';
+        }
+        address = strtok_r(line, " \t\r\n", &save);
+        if (address == NULL) {
+            continue;
+        }
+        while ((alias = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+            if (strcasecmp(alias, name) == 0) {
+                struct addrinfo numeric = *hints;
+                struct addrinfo *result;
+
+                numeric.ai_flags |= AI_NUMERICHOST;
+                if (getaddrinfo(address, NULL, &numeric, &result) == 0) {
+                    int failed = append_addresses(&tail, result);
+                    freeaddrinfo(result);
+                    if (failed) {
+                        fclose(file);
+                        free_addresses(*addresses);
+                        *addresses = NULL;
+                        return EAI_MEMORY;
+                    }
+                }
+                break;
+            }
+        }
+    }
+
+    fclose(file);
+    return *addresses != NULL ? 0 : EAI_NONAME;
+}
+
+/**
+ * Skips a (possibly compressed) domain name in a DNS message.
+ *
+ * @return The offset after the name, or -1 if the message is truncated.
+ */
+static int skip_name(const unsigned char *message, int len, int pos) {
+    while (pos < len) {
+        int label = message[pos];
+        if (label == 0) {
+            return pos + 1;
+        }
+        if ((label & 0xc0) == 0xc0) {
+            return pos + 2;  // a pointer ends the name
+        }
+        pos += label + 1;
+    }
+    return -1;
+}
+
+/**
+ * Reads the smallest TTL of the answer records of a DNS response.
+ *
+ * @return The TTL in seconds, or -1 if the response has no answer.
+ */
+static long answer_ttl(const unsigned char *message, int len) {
+    int questions;
+    int answers;
+    int pos = HFIXEDSZ;
+    long ttl = -1;
+
+    if (len < HFIXEDSZ) {
+        return -1;
+    }
+    questions = (message[4] << 8) | message[5];
+    answers = (message[6] << 8) | message[7];
+
+    while (questions-- > 0 && pos >= 0) {
+        pos = skip_name(message, len, pos);
+        if (pos >= 0) {
+            pos += QFIXEDSZ;  // type and class
+        }
+    }
+    while (answers-- > 0 && pos >= 0) {
+        long record_ttl;
+        int data_len;
+
+        pos = skip_name(message, len, pos);
+        if (pos < 0 || pos + RRFIXEDSZ > len) {
+            break;
+        }
+        // type (2), class (2), TTL (4), data length (2)
+        record_ttl = ((long) message[pos + 4] << 24) | ((long) message[pos + 5] << 16)
+            | ((long) message[pos + 6] << 8) | (long) message[pos + 7];
+        data_len = (message[pos + 8] << 8) | message[pos + 9];
+        if (ttl < 0 || record_ttl < ttl) {
+            ttl = record_ttl;
+        }
+        pos += RRFIXEDSZ + data_len;
+    }
+    return ttl;
+}
+
+/**
+ * Asks DNS for the TTL of a name's address records. getaddrinfo() does not
+ * report TTLs, so this is a separate (cheap, usually cached upstream) query.
+ *
+ * @return The TTL in seconds, or -1 if DNS has no answer (e.g. the name
+ *         comes from /etc/hosts).
+ */
+static long query_ttl(const char *name) {
+    unsigned char answer[NS_PACKETSZ * 2];
+    struct __res_state state;
+    long ttl = -1;
+    int len;
+
+    memset(&state, 0, sizeof(state));
+    if (res_ninit(&state) != 0) {
+        return -1;
+    }
+    len = res_nquery(&state, name, C_IN, T_A, answer, sizeof(answer));
+    if (len <= 0) {
+        len = res_nquery(&state, name, C_IN, T_AAAA, answer, sizeof(answer));
+    }
+    if (len > 0) {
+        ttl = answer_ttl(answer, len < (int) sizeof(answer) ? len : (int) sizeof(answer));
+    }
+    res_nclose(&state);
+    return ttl;
+}
+
+/**
+ * Resolves one name. Runs on a resolver thread, without holding the lock.
+ *
+ * @return 0 or an EAI_* error; on success `addresses` and `ttl` are set.
+ */
+static int resolve_name(const struct resolver *resolver, const char *name, struct addrinfo **addresses,
+                        long *ttl) {
+    struct addrinfo hints;
+    struct addrinfo *result;
+    struct addrinfo **tail = addresses;
+    unsigned char numeric[sizeof(struct in6_addr)];
+    int error;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;      // IPv4 and IPv6
+    hints.ai_socktype = SOCK_STREAM;  // TCP connection
+
+    *addresses = NULL;
+    *ttl = resolver->default_ttl;
+
+    if (resolver->hosts_file != NULL) {
+        error = lookup_hosts_file(resolver->hosts_file, name, &hints, addresses);
+        if (error != EAI_NONAME) {
+            return error;
+        }
+    }
+
+    error = getaddrinfo(name, NULL, &hints, &result);
+    if (error != 0) {
+        return error;
+    }
+    error = append_addresses(&tail, result) < 0 ? EAI_MEMORY : 0;
+    freeaddrinfo(result);
+    if (error != 0) {
+        free_addresses(*addresses);
+        *addresses = NULL;
+        return error;
+    }
+
+    // Names from DNS live as long as their records, anything else keeps the default TTL
+    if (inet_pton(AF_INET, name, numeric) != 1 && inet_pton(AF_INET6, name, numeric) != 1) {
+        long dns_ttl = query_ttl(name);
+        if (dns_ttl >= 0) {
+            *ttl = dns_ttl;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Frees an entry once nobody holds it any more. Called with the lock held.
+ */
+static void put_entry(struct resolver_entry *entry) {
+    if (--entry->refs == 0) {
+        free_addresses(entry->addresses);
+        free(entry);
+    }
+}
+
+/**
+ * Body of a resolver thread: takes queued lookups until the resolver stops.
+ */
+static void *resolver_thread(void *arg) {
+    struct resolver *resolver = arg;
+
+    pthread_mutex_lock(&resolver->lock);
+    for (;;) {
+        struct resolver_entry *entry;
+        struct addrinfo *addresses;
+        long ttl;
+        int error;
+
+        while (!resolver->stopping && resolver->queue == NULL) {
+            pthread_cond_wait(&resolver->job_ready, &resolver->lock);
+        }
+        if (resolver->stopping) {
+            break;
+        }
+
+        entry = resolver->queue;
+        resolver->queue = entry->next_job;
+        if (resolver->queue == NULL) {
+            resolver->queue_tail = NULL;
+        }
+        entry->state = RESOLVER_RUNNING;
+        entry->refs++;  // keeps the entry alive while the lock is dropped
+        pthread_mutex_unlock(&resolver->lock);
+
+        error = resolve_name(resolver, entry->name, &addresses, &ttl);
+
+        pthread_mutex_lock(&resolver->lock);
+        entry->error = error;
+        entry->addresses = addresses;
+        // Failures are not cached: the next caller tries again
+        entry->expires = monotonic_seconds() + (error == 0 ? ttl : 0);
+        entry->state = RESOLVER_DONE;
+        pthread_cond_broadcast(&resolver->job_done);
+        if (resolver->notify[1] >= 0) {
+            // A full pipe is readable already, nothing is lost when this fails
+            ssize_t written = write(resolver->notify[1], "", 1);
+            (void) written;
+        }
+        put_entry(entry);
+    }
+    pthread_mutex_unlock(&resolver->lock);
+    return NULL;
+}
+
+int resolver_init(struct resolver *resolver, int threads, int default_ttl, const char *hosts_file) {
+    pthread_condattr_t attributes;
+    int i;
+
+    memset(resolver, 0, sizeof(*resolver));
+    resolver->default_ttl = default_ttl > 0 ? default_ttl : RESOLVER_DEFAULT_TTL;
+    resolver->hosts_file = hosts_file;
+    resolver->notify[0] = -1;
+    resolver->notify[1] = -1;
+
+    resolver->threads = calloc(threads, sizeof(pthread_t));
+    if (resolver->threads == NULL) {
+        return -1;
+    }
+
+    pthread_mutex_init(&resolver->lock, NULL);
+    pthread_cond_init(&resolver->job_ready, NULL);
+    // Timed waits use the monotonic clock, like the expiry times
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(&resolver->job_done, &attributes);
+    pthread_condattr_destroy(&attributes);
+
+    for (i = 0; i < threads; i++) {
+        if (pthread_create(&resolver->threads[i], NULL, resolver_thread, resolver) != 0) {
+            break;
+        }
+        resolver->thread_count++;
+    }
+    if (resolver->thread_count == 0) {
+        resolver_destroy(resolver);
+        return -1;
+    }
+    return 0;
+}
+
+struct resolver_entry *resolver_start(struct resolver *resolver, const char *name) {
+    struct resolver_entry **link;
+    struct resolver_entry *entry;
+    time_t now = monotonic_seconds();
+
+    if (strlen(name) >= RESOLVER_NAME_MAX) {
+        return NULL;
+    }
+
+    pthread_mutex_lock(&resolver->lock);
+
+    // Hand out a fresh or pending answer, dropping expired ones on the way
+    link = &resolver->cache;
+    while ((entry = *link) != NULL) {
+        if (entry->state == RESOLVER_DONE && now >= entry->expires) {
+            *link = entry->next;
+            entry->cached = 0;
+            put_entry(entry);
+            continue;
+        }
+        if (strcasecmp(entry->name, name) == 0) {
+            entry->refs++;
+            pthread_mutex_unlock(&resolver->lock);
+            return entry;
+        }
+        link = &entry->next;
+    }
+
+    // Not cached: queue a lookup that every caller of this name will share
+    entry = calloc(1, sizeof(struct resolver_entry));
+    if (entry == NULL) {
+        pthread_mutex_unlock(&resolver->lock);
+        return NULL;
+    }
+    strcpy(entry->name, name);
+    entry->state = RESOLVER_QUEUED;
+    entry->refs = 2;  // the cache and the caller
+    entry->cached = 1;
+    entry->next = resolver->cache;
+    resolver->cache = entry;
+
+    if (resolver->queue_tail != NULL) {
+        resolver->queue_tail->next_job = entry;
+    } else {
+        resolver->queue = entry;
+    }
+    resolver->queue_tail = entry;
+    pthread_cond_signal(&resolver->job_ready);
+
+    pthread_mutex_unlock(&resolver->lock);
+    return entry;
+}
+
+int resolver_ready(struct resolver *resolver, struct resolver_entry *entry) {
+    int ready;
+
+    pthread_mutex_lock(&resolver->lock);
+    ready = entry->state == RESOLVER_DONE;
+    pthread_mutex_unlock(&resolver->lock);
+    return ready;
+}
+
+int resolver_notify_fd(struct resolver *resolver) {
+    int fds[2];
+    int fd;
+    int i;
+
+    pthread_mutex_lock(&resolver->lock);
+    if (resolver->notify[0] < 0) {
+        if (pipe(fds) == 0) {
+            for (i = 0; i < 2; i++) {
+                fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+                fcntl(fds[i], F_SETFD, FD_CLOEXEC);
+            }
+            resolver->notify[0] = fds[0];
+            resolver->notify[1] = fds[1];
+        }
+    }
+    fd = resolver->notify[0];
+    pthread_mutex_unlock(&resolver->lock);
+    return fd;
+}
+
+void resolver_clear_notify(struct resolver *resolver) {
+    char drain[64];
+
+    if (resolver->notify[0] >= 0) {
+        while (read(resolver->notify[0], drain, sizeof(drain)) > 0) {
+        }
+    }
+}
+
+int resolver_wait(struct resolver *resolver, struct resolver_entry *entry, int timeout_ms) {
+    struct timespec deadline;
+    int result = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    if (timeout_ms >= 0) {
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (long) (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+    }
+
+    pthread_mutex_lock(&resolver->lock);
+    while (entry->state != RESOLVER_DONE) {
+        if (timeout_ms < 0) {
+            pthread_cond_wait(&resolver->job_done, &resolver->lock);
+        } else if (pthread_cond_timedwait(&resolver->job_done, &resolver->lock, &deadline) == ETIMEDOUT) {
+            result = entry->state == RESOLVER_DONE ? 0 : -1;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&resolver->lock);
+    return result;
+}
+
+void resolver_release(struct resolver *resolver, struct resolver_entry *entry) {
+    pthread_mutex_lock(&resolver->lock);
+    put_entry(entry);
+    pthread_mutex_unlock(&resolver->lock);
+}
+
+int resolver_lookup(struct resolver *resolver, const char *name, int timeout_ms,
+                    struct resolver_entry **entry) {
+    struct resolver_entry *found = resolver_start(resolver, name);
+    int error;
+
+    if (found == NULL) {
+        return strlen(name) >= RESOLVER_NAME_MAX ? EAI_NONAME : EAI_MEMORY;
+    }
+    if (resolver_wait(resolver, found, timeout_ms) < 0) {
+        resolver_release(resolver, found);
+        return EAI_AGAIN;
+    }
+    error = found->error;
+    if (error != 0) {
+        resolver_release(resolver, found);
+        return error;
+    }
+    *entry = found;
+    return 0;
+}
+
+void resolver_destroy(struct resolver *resolver) {
+    struct resolver_entry *entry;
+    int i;
+
+    pthread_mutex_lock(&resolver->lock);
+    resolver->stopping = 1;
+    pthread_cond_broadcast(&resolver->job_ready);
+    pthread_mutex_unlock(&resolver->lock);
+
+    for (i = 0; i < resolver->thread_count; i++) {
+        pthread_join(resolver->threads[i], NULL);
+    }
+    free(resolver->threads);
+    resolver->threads = NULL;
+    resolver->thread_count = 0;
+
+    // Only the cache's references are left
+    while ((entry = resolver->cache) != NULL) {
+        resolver->cache = entry->next;
+        entry->cached = 0;
+        put_entry(entry);
+    }
+    resolver->queue = NULL;
+    resolver->queue_tail = NULL;
+
+    for (i = 0; i < 2; i++) {
+        if (resolver->notify[i] >= 0) {
+            close(resolver->notify[i]);
+            resolver->notify[i] = -1;
+        }
+    }
+
+    pthread_mutex_destroy(&resolver->lock);
+    pthread_cond_destroy(&resolver->job_ready);
+    pthread_cond_destroy(&resolver->job_done);
+}
@@ -0,0 +1,151 @@
+/**
+ * Asynchronous host name resolver with a TTL-aware cache.
+ *
+ * Lookups run on a small pool of resolver threads, so the thread that needs
+ * an address can start the lookup early, carry on (read input, open other
+ * connections, ...) and only wait when it actually needs the result. Results
+ * are cached for the TTL of their DNS records (or a default TTL for names
+ * that do not come from DNS, e.g. /etc/hosts). A lookup for a name that is
+ * already being resolved does not start a second query: every caller waits
+ * for the same one.
+ *
+ * For tests, the resolver can be pointed at a hosts-style file (lines of
+ * "address name [aliases...]") that is consulted before the system resolver.
+ *
+ * The resolver uses POSIX threads and is not available on Windows.
+ */
+#ifndef RESOLVER_H
+#define RESOLVER_H
+
+#include <pthread.h>
+#include <time.h>
+#include <netdb.h>
+
+// Longest host name that can be resolved
+#define RESOLVER_NAME_MAX 256
+// Seconds an answer is cached when its TTL is unknown
+#define RESOLVER_DEFAULT_TTL 60
+
+// Where a cache entry is in its life
+enum resolver_state {
+    RESOLVER_QUEUED,            // waiting for a resolver thread
+    RESOLVER_RUNNING,           // being resolved
+    RESOLVER_DONE               // `error` and `addresses` are valid
+};
+
+/**
+ * The (shared) result of resolving one name. Entries are reference counted:
+ * the addresses stay valid until the entry is released, even when the cache
+ * has moved on to a fresher answer.
+ */
+struct resolver_entry {
+    char name[RESOLVER_NAME_MAX];
+    enum resolver_state state;
+    int error;                       // getaddrinfo() error (EAI_*), 0 on success
+    struct addrinfo *addresses;      // every address of the name, in preference order
+    time_t expires;                  // monotonic time (seconds) the answer expires
+    int refs;                        // the cache and every caller holding the entry
+    int cached;                      // still listed in the cache
+    struct resolver_entry *next;     // next entry of the cache
+    struct resolver_entry *next_job; // next entry waiting for a resolver thread
+};
+
+struct resolver {
+    pthread_mutex_t lock;            // protects everything below
+    pthread_cond_t job_ready;        // signalled when a lookup is queued
+    pthread_cond_t job_done;         // signalled when a lookup completes
+    pthread_t *threads;
+    int thread_count;
+    int stopping;
+    struct resolver_entry *cache;    // every entry that may still be handed out
+    struct resolver_entry *queue;    // oldest queued lookup
+    struct resolver_entry *queue_tail;
+    int default_ttl;
+    const char *hosts_file;          // fixture consulted first, or NULL
+    int notify[2];                   // pipe written to when a lookup completes,
+                                     // -1 until resolver_notify_fd() is called
+};
+
+/**
+ * Starts the resolver threads.
+ *
+ * @param resolver The resolver.
+ * @param threads Number of resolver threads (lookups that run in parallel).
+ * @param default_ttl Seconds to cache answers without a TTL (0 for
+ *                    RESOLVER_DEFAULT_TTL).
+ * @param hosts_file Hosts-style file consulted before the system resolver, or
+ *                   NULL. The string must outlive the resolver.
+ * @return 0 on success, -1 if the threads could not be started.
+ */
+int resolver_init(struct resolver *resolver, int threads, int default_ttl, const char *hosts_file);
+
+/**
+ * Starts resolving a name, unless a fresh answer is cached or a lookup for
+ * the name is already under way. Never blocks on the network.
+ *
+ * @param resolver The resolver.
+ * @param name The host name (or numeric address) to resolve.
+ * @return The entry for the name, to be passed to resolver_wait() and
+ *         resolver_release(), or NULL if the name is too long or memory ran
+ *         out.
+ */
+struct resolver_entry *resolver_start(struct resolver *resolver, const char *name);
+
+/**
+ * @return Non-zero once the lookup of `entry` has completed.
+ */
+int resolver_ready(struct resolver *resolver, struct resolver_entry *entry);
+
+/**
+ * Returns a file descriptor that becomes readable whenever a lookup completes,
+ * so that an event loop can wait for lookups together with its sockets
+ * instead of polling resolver_ready(). Call resolver_clear_notify() once it
+ * was readable, then check the entries that are still pending.
+ *
+ * @param resolver The resolver.
+ * @return The (non-blocking) descriptor, or -1 if it could not be created.
+ */
+int resolver_notify_fd(struct resolver *resolver);
+
+/**
+ * Empties the descriptor returned by resolver_notify_fd(), so that it only
+ * becomes readable again when the next lookup completes.
+ */
+void resolver_clear_notify(struct resolver *resolver);
+
+/**
+ * Waits for the lookup of `entry` to complete.
+ *
+ * @param resolver The resolver.
+ * @param entry The entry returned by resolver_start().
+ * @param timeout_ms How long to wait (-1 to wait as long as it takes).
+ * @return 0 if the lookup completed (check `entry->error`), -1 on timeout.
+ */
+int resolver_wait(struct resolver *resolver, struct resolver_entry *entry, int timeout_ms);
+
+/**
+ * Releases an entry returned by resolver_start(). Its addresses must not be
+ * used afterwards.
+ */
+void resolver_release(struct resolver *resolver, struct resolver_entry *entry);
+
+/**
+ * Resolves a name and waits for the answer: resolver_start() followed by
+ * resolver_wait().
+ *
+ * @param resolver The resolver.
+ * @param name The host name to resolve.
+ * @param timeout_ms How long to wait (-1 to wait as long as it takes).
+ * @param entry Receives the entry (to be released) on success.
+ * @return 0 on success, otherwise an EAI_* error (EAI_AGAIN on timeout).
+ */
+int resolver_lookup(struct resolver *resolver, const char *name, int timeout_ms,
+                    struct resolver_entry **entry);
+
+/**
+ * Stops the resolver threads and frees the cache. Entries still held by
+ * callers must have been released.
+ */
+void resolver_destroy(struct resolver *resolver);
+
+#endif // RESOLVER_H
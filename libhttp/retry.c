@@ -0,0 +1,62 @@
+/**
+ * Retry backoff and budget, see retry.h.
+ */
+#include "retry.h"
+
+void retry_budget_init(struct retry_budget *budget, double ratio, int reserve) {
+    budget->deposit = (long) (ratio * 1000 + 0.5);
+    budget->capacity = (long) reserve * 1000;
+    if (budget->capacity < 1000) {
+        budget->capacity = 1000;  // one retry must always fit
+    }
+    atomic_init(&budget->balance, budget->capacity);
+}
+
+void retry_budget_deposit(struct retry_budget *budget) {
+    long balance = atomic_load_explicit(&budget->balance, memory_order_relaxed);
+
+    while (balance < budget->capacity) {
+        long target = balance + budget->deposit;
+        if (target > budget->capacity) {
+            target = budget->capacity;
+        }
+        if (atomic_compare_exchange_weak_explicit(&budget->balance, &balance, target,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return;
+        }
+    }
+}
+
+int retry_budget_withdraw(struct retry_budget *budget) {
+    long balance = atomic_load_explicit(&budget->balance, memory_order_relaxed);
+
+    while (balance >= 1000) {
+        if (atomic_compare_exchange_weak_explicit(&budget->balance, &balance, balance - 1000,
+                                                  memory_order_relaxed, memory_order_relaxed)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int retry_backoff_ms(const struct retry_policy *policy, int retry, unsigned long long *rng) {
+    long long limit = policy->base_delay_ms;
+    unsigned long long x = *rng;
+
+    while (retry-- > 0 && limit < policy->max_delay_ms) {
+        limit *= 2;
+    }
+    if (limit > policy->max_delay_ms) {
+        limit = policy->max_delay_ms;
+    }
+    if (limit <= 0) {
+        return 0;
+    }
+
+    // xorshift64*
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *rng = x;
+    return (int) ((x * 0x2545F4914F6CDD1DULL >> 11) % (unsigned long long) (limit + 1));
+}
@@ -0,0 +1,70 @@
+/**
+ * Retries with jittered exponential backoff, limited by a retry budget.
+ *
+ * A failed request (no connection, a lost connection, a 5xx answer) is often
+ * worth another try, but retrying blindly turns an overloaded server into a
+ * more overloaded one: every client multiplies its load by the number of
+ * attempts exactly when the server can least afford it.
+ *
+ *  - The backoff before retry n is drawn uniformly between 0 and
+ *    min(max_delay, base_delay * 2^n) ("full jitter"), so clients that failed
+ *    together do not come back together.
+ *  - The budget is a token bucket shared by everything that retries (and
+ *    hedges): every request sent adds `ratio` of a token, up to `reserve`
+ *    tokens, and every retry takes a whole one. Retries therefore never add
+ *    more than `ratio` (e.g. 10 %) to the load, plus a small initial reserve,
+ *    however many requests fail.
+ */
+#ifndef RETRY_H
+#define RETRY_H
+
+#include <stdatomic.h>
+
+// Retry settings
+struct retry_policy {
+    int max_retries;             // retries after the first attempt (0: none)
+    int base_delay_ms;           // backoff limit before the first retry
+    int max_delay_ms;            // largest backoff limit
+    int retry_5xx;               // also retry requests answered with a 5xx status
+};
+
+// Token bucket of retries, may be shared by several threads
+struct retry_budget {
+    _Atomic long balance;        // available retries, in thousandths
+    long deposit;                // thousandths of a retry earned per request
+    long capacity;               // most thousandths that can be saved up
+};
+
+/**
+ * Creates a budget.
+ *
+ * @param budget The budget.
+ * @param ratio Retries allowed per request sent, e.g. 0.1.
+ * @param reserve Retries available from the start, and the most that can be
+ *                saved up.
+ */
+void retry_budget_init(struct retry_budget *budget, double ratio, int reserve);
+
+/**
+ * Credits the budget with one request sent (not a retry).
+ */
+void retry_budget_deposit(struct retry_budget *budget);
+
+/**
+ * Takes one retry from the budget.
+ *
+ * @return 1 if the retry may go ahead, 0 if the budget is exhausted.
+ */
+int retry_budget_withdraw(struct retry_budget *budget);
+
+/**
+ * Draws the backoff before a retry.
+ *
+ * @param policy The retry settings.
+ * @param retry Number of retries made so far (0 before the first).
+ * @param rng State of the random numbers (xorshift64*), not 0.
+ * @return The delay in milliseconds.
+ */
+int retry_backoff_ms(const struct retry_policy *policy, int retry, unsigned long long *rng);
+
+#endif // RETRY_H